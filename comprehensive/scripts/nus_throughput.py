@@ -0,0 +1,126 @@
+"""
+Description: Throughput of the NUS UART bridge with binary data
+
+Random bytes, including CR, LF and zero, are written to the UART of the bridge
+and read back from the other end of the Bluetooth link: the UART of a central
+running central_uart, or the same port when the peer loops the data back. The
+data is compared byte by byte, so it also checks that the bridge does not
+rewrite or drop bytes, e.g. with CONFIG_BT_NUS_UART_BINARY.
+
+With --duration, the transfer is repeated with new data until the time is over
+or a transfer fails, to soak test the bridge.
+
+pyserial is required.
+"""
+import argparse
+import os
+import threading
+import time
+
+
+def open_port(name, baudrate, rtscts):
+    import serial
+    return serial.Serial(name, baudrate, rtscts=rtscts, timeout=0.1)
+
+
+def writer(port, data, chunk):
+    for pos in range(0, len(data), chunk):
+        port.write(data[pos:pos + chunk])
+    port.flush()
+
+
+def run(tx, rx, size, chunk, idle):
+    """
+    Send size random bytes on tx, return the bytes received on rx and the time
+    from the first byte sent to the last byte received.
+    """
+    data = os.urandom(size)
+    received = bytearray()
+
+    rx.reset_input_buffer()
+    thread = threading.Thread(target=writer, args=(tx, data, chunk))
+    start = time.monotonic()
+    last = start
+    thread.start()
+
+    # Stop when all is received, or nothing is received for idle seconds
+    while len(received) < size and time.monotonic() - last < idle:
+        part = rx.read(4096)
+        if part:
+            received += part
+            last = time.monotonic()
+
+    thread.join()
+    return data, bytes(received), last - start
+
+
+def report(data, received, elapsed):
+    print('Sent:      {} bytes'.format(len(data)))
+    print('Received:  {} bytes in {:.2f} s'.format(len(received), elapsed))
+    if elapsed > 0:
+        print('Throughput: {:.1f} kbit/s'.format(len(received) * 8 / elapsed / 1000))
+
+    mismatch = next((i for i, (a, b) in enumerate(zip(data, received)) if a != b), None)
+    if mismatch is not None:
+        print('Mismatch at byte {}: sent 0x{:02X}, received 0x{:02X}'.format(
+            mismatch, data[mismatch], received[mismatch]))
+        return False
+    if len(received) != len(data):
+        print('Lost:      {} bytes'.format(len(data) - len(received)))
+        return False
+
+    print('Data:      identical')
+    return True
+
+
+def soak(tx, rx, size, chunk, idle, duration):
+    """
+    Repeat transfers of size bytes for duration seconds, stop at the first one
+    which is lost or corrupted. Return True if all were identical.
+    """
+    start = time.monotonic()
+    rounds = 0
+    total = 0
+    busy = 0.0
+
+    while time.monotonic() - start < duration:
+        rounds += 1
+        print('Round {}, {:.0f} s left'.format(rounds, duration - (time.monotonic() - start)))
+        data, received, elapsed = run(tx, rx, size, chunk, idle)
+        ok = report(data, received, elapsed)
+        total += len(received)
+        busy += elapsed
+        if not ok:
+            break
+
+    print('Soak:      {} rounds, {} bytes in {:.0f} s'.format(rounds, total, time.monotonic() - start))
+    if busy > 0:
+        print('Average:   {:.1f} kbit/s'.format(total * 8 / busy / 1000))
+    print('Result:    {}'.format('passed' if ok else 'FAILED in round {}'.format(rounds)))
+    return ok
+
+
+if __name__ == '__main__':
+    """
+    Usage: python nus_throughput.py <bridge-port> [peer-port] [options]
+    """
+    parser = argparse.ArgumentParser(description='Throughput of the NUS UART bridge')
+    parser.add_argument('port', help='UART of the NUS bridge')
+    parser.add_argument('peer', nargs='?', help='UART of the peer, default: the bridge port, loopback')
+    parser.add_argument('--baudrate', type=int, default=115200)
+    parser.add_argument('--rtscts', action='store_true', help='enable HW flow control')
+    parser.add_argument('--size', type=int, default=100000, help='bytes to send')
+    parser.add_argument('--chunk', type=int, default=256, help='bytes per write to the port')
+    parser.add_argument('--idle', type=float, default=3.0, help='seconds without data to stop')
+    parser.add_argument('--duration', type=float, help='repeat transfers for this many seconds, soak test')
+    args = parser.parse_args()
+
+    tx = open_port(args.port, args.baudrate, args.rtscts)
+    rx = open_port(args.peer, args.baudrate, args.rtscts) if args.peer else tx
+
+    if args.duration:
+        ok = soak(tx, rx, args.size, args.chunk, args.idle, args.duration)
+    else:
+        ok = report(*run(tx, rx, args.size, args.chunk, args.idle))
+
+    exit(0 if ok else 1)
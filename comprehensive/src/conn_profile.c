@@ -0,0 +1,184 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/** @file
+ *  @brief Connection parameter profiles implementation
+ */
+#include "conn_profile.h"
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/conn.h>
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(conn_profile);
+
+/* Windows below half the rate before going back to low power */
+#define IDLE_WINDOWS 3
+
+/* Interval in units of 1.25 ms, supervision timeout in units of 10 ms */
+static const struct bt_le_conn_param profile_params[] = {
+	[CONN_PROFILE_LOW_POWER] = BT_LE_CONN_PARAM_INIT(80, 100, 4, 600),
+	[CONN_PROFILE_THROUGHPUT] = BT_LE_CONN_PARAM_INIT(12, 24, 0, 400),
+};
+
+static const char *const profile_names[] = {
+	[CONN_PROFILE_LOW_POWER] = "low power",
+	[CONN_PROFILE_THROUGHPUT] = "throughput",
+};
+
+static enum conn_profile current = CONN_PROFILE_LOW_POWER;
+static bool auto_switch = true;
+static atomic_t traffic;
+static uint8_t idle_windows;
+
+static void rate_work_handler(struct k_work *work);
+
+static K_WORK_DELAYABLE_DEFINE(rate_work, rate_work_handler);
+
+static void params_request(struct bt_conn *conn, void *data)
+{
+	ARG_UNUSED(data);
+
+	int err = bt_conn_le_param_update(conn, &profile_params[current]);
+
+	if (err && (err != -EALREADY)) {
+		LOG_WRN("Connection parameters update failed (err %d)", err);
+	}
+}
+
+static void count_conn(struct bt_conn *conn, void *data)
+{
+	ARG_UNUSED(conn);
+
+	(*(size_t *)data)++;
+}
+
+static void profile_apply(enum conn_profile profile)
+{
+	if (profile == current) {
+		return;
+	}
+
+	current = profile;
+	LOG_INF("Connection profile %s", profile_names[profile]);
+
+	bt_conn_foreach(BT_CONN_TYPE_LE, params_request, NULL);
+}
+
+static void rate_work_handler(struct k_work *work)
+{
+	uint32_t rate = atomic_clear(&traffic) * MSEC_PER_SEC /
+			CONFIG_BT_NUS_CONN_PROFILE_WINDOW;
+	size_t conn_count = 0;
+
+	bt_conn_foreach(BT_CONN_TYPE_LE, count_conn, &conn_count);
+	if (!conn_count) {
+		return;
+	}
+
+	if (auto_switch) {
+		if (rate >= CONFIG_BT_NUS_CONN_PROFILE_RATE) {
+			idle_windows = 0;
+			profile_apply(CONN_PROFILE_THROUGHPUT);
+		} else if (rate < (CONFIG_BT_NUS_CONN_PROFILE_RATE / 2)) {
+			if (++idle_windows >= IDLE_WINDOWS) {
+				profile_apply(CONN_PROFILE_LOW_POWER);
+			}
+		} else {
+			idle_windows = 0;
+		}
+	}
+
+	k_work_reschedule(&rate_work, K_MSEC(CONFIG_BT_NUS_CONN_PROFILE_WINDOW));
+}
+
+void conn_profile_traffic(size_t len)
+{
+	atomic_add(&traffic, len);
+}
+
+void conn_profile_set(enum conn_profile profile, bool auto_mode)
+{
+	auto_switch = auto_mode;
+	idle_windows = 0;
+	profile_apply(profile);
+}
+
+enum conn_profile conn_profile_get(void)
+{
+	return current;
+}
+
+const char *conn_profile_name(enum conn_profile profile)
+{
+	return profile_names[profile];
+}
+
+static void connected(struct bt_conn *conn, uint8_t err)
+{
+	const struct bt_conn_le_phy_param phy = {
+		.options = BT_CONN_LE_PHY_OPT_NONE,
+		.pref_tx_phy = BT_GAP_LE_PHY_2M,
+		.pref_rx_phy = BT_GAP_LE_PHY_2M,
+	};
+	const struct bt_conn_le_data_len_param data_len = {
+		.tx_max_len = BT_GAP_DATA_LEN_MAX,
+		.tx_max_time = BT_GAP_DATA_TIME_MAX,
+	};
+
+	if (err) {
+		return;
+	}
+
+	/* 2M PHY and long packets shorten the radio time of both profiles */
+	err = bt_conn_le_phy_update(conn, &phy);
+	if (err) {
+		LOG_WRN("PHY update failed (err %d)", err);
+	}
+
+	err = bt_conn_le_data_len_update(conn, &data_len);
+	if (err) {
+		LOG_WRN("Data length update failed (err %d)", err);
+	}
+
+	params_request(conn, NULL);
+
+	k_work_reschedule(&rate_work, K_MSEC(CONFIG_BT_NUS_CONN_PROFILE_WINDOW));
+}
+
+static void le_param_updated(struct bt_conn *conn, uint16_t interval,
+			     uint16_t latency, uint16_t timeout)
+{
+	ARG_UNUSED(conn);
+
+	LOG_INF("Connection interval %u.%02u ms, latency %u, timeout %u ms",
+		(interval * 125) / 100, (interval * 125) % 100, latency,
+		timeout * 10);
+}
+
+static void le_phy_updated(struct bt_conn *conn,
+			   struct bt_conn_le_phy_info *param)
+{
+	ARG_UNUSED(conn);
+
+	LOG_INF("PHY TX %u, RX %u", param->tx_phy, param->rx_phy);
+}
+
+static void le_data_len_updated(struct bt_conn *conn,
+				struct bt_conn_le_data_len_info *info)
+{
+	ARG_UNUSED(conn);
+
+	LOG_INF("Data length TX %u bytes, RX %u bytes", info->tx_max_len,
+		info->rx_max_len);
+}
+
+BT_CONN_CB_DEFINE(conn_profile_callbacks) = {
+	.connected = connected,
+	.le_param_updated = le_param_updated,
+	.le_phy_updated = le_phy_updated,
+	.le_data_len_updated = le_data_len_updated,
+};
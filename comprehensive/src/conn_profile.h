@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/** @file
+ *  @brief Connection parameter profiles
+ */
+
+/**
+ * @brief Connection parameter profiles of the NUS connections
+ * @defgroup conn_profile Connection profiles
+ * @{
+ *
+ * This module requests 2M PHY and the largest data length on each new
+ * connection, and the connection interval and peripheral latency of the
+ * current profile. The profile follows the data rate of the bridge unless
+ * it is set by the user.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/** @brief Connection parameter profiles */
+enum conn_profile {
+	/** Long connection interval and peripheral latency */
+	CONN_PROFILE_LOW_POWER,
+	/** Short connection interval, no peripheral latency */
+	CONN_PROFILE_THROUGHPUT,
+};
+
+/**
+ * @brief Account data sent or received by the bridge
+ *
+ * The profile is switched to throughput when the rate of the accounted
+ * data reaches CONFIG_BT_NUS_CONN_PROFILE_RATE, and back to low power
+ * when it stays below half of it.
+ *
+ * @param len Number of bytes
+ */
+void conn_profile_traffic(size_t len);
+
+/**
+ * @brief Set the profile of all connections
+ *
+ * @param profile     Profile to request
+ * @param auto_switch Keep switching the profile on the data rate
+ */
+void conn_profile_set(enum conn_profile profile, bool auto_switch);
+
+/**
+ * @brief Get the current profile
+ *
+ * @return Current profile
+ */
+enum conn_profile conn_profile_get(void);
+
+/**
+ * @brief Get the name of a profile
+ *
+ * @param profile Profile
+ * @return Name of the profile
+ */
+const char *conn_profile_name(enum conn_profile profile);
+
+/** @} */
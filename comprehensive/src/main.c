@@ -8,10 +8,13 @@
  *  @brief Nordic UART Bridge Service (NUS) sample
  */
 #include "uart_async_adapter.h"
+#include "conn_profile.h"
+#include "nus_stats.h"
 
 #include <zephyr/types.h>
 #include <zephyr/kernel.h>
 #include <zephyr/drivers/uart.h>
+#include <zephyr/net/buf.h>
 #include <zephyr/usb/usb_device.h>
 
 #include <zephyr/device.h>
@@ -28,8 +31,11 @@
 #include <dk_buttons_and_leds.h>
 
 #include <zephyr/settings/settings.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/shell/shell.h>
 
 #include <stdio.h>
+#include <stdlib.h>
 
 #include <zephyr/logging/log.h>
 
@@ -54,9 +60,28 @@ LOG_MODULE_REGISTER(LOG_MODULE_NAME);
 #define UART_WAIT_FOR_BUF_DELAY K_MSEC(50)
 #define UART_WAIT_FOR_RX CONFIG_BT_NUS_UART_RX_WAIT_TIME
 
+/* NUS payload of the largest ATT MTU of this build */
+#define NUS_TX_LEN_MAX (CONFIG_BT_L2CAP_TX_MTU - 3)
+#define NUS_TX_LEN_DEFAULT (BT_ATT_DEFAULT_LE_MTU - 3)
+
+/* Retry of a notification the stack had no buffer for */
+#define NUS_TX_RETRY_DELAY 10
+
+#define NUS_CONN_COUNT CONFIG_BT_MAX_CONN
+
+/* UART frames of CONFIG_BT_NUS_UART_ADDRESSING: connection index and
+ * payload length, then the payload. Index 0xFF sends to all connections.
+ */
+#define NUS_UART_HEADER_LEN 2
+#define NUS_UART_ADDR_ALL 0xFF
+
+BUILD_ASSERT(!IS_ENABLED(CONFIG_BT_NUS_UART_ADDRESSING) ||
+	     (NUS_TX_LEN_MAX <= UINT8_MAX),
+	     "Payload of a notification must fit the UART frame length");
+BUILD_ASSERT(NUS_CONN_COUNT < NUS_UART_ADDR_ALL);
+
 static K_SEM_DEFINE(ble_init_ok, 0, 1);
 
-static struct bt_conn *current_conn;
 static struct bt_conn *auth_conn;
 
 static const struct device *uart = DEVICE_DT_GET(DT_CHOSEN(nordic_nus_uart));
@@ -68,9 +93,66 @@ struct uart_data_t {
 	uint16_t len;
 };
 
+K_MEM_SLAB_DEFINE_STATIC(uart_tx_slab, sizeof(struct uart_data_t),
+			 CONFIG_BT_NUS_UART_TX_BUF_COUNT, 4);
+
+/* UART RX receives into the data of net_bufs. The data is shared by
+ * clones, slices of it queued for the connections, and is freed with
+ * the last of them: it is not copied until a notification spans
+ * several slices. A pointer to the net_buf is stored in front of the
+ * data given to the UART driver.
+ */
+#define UART_RX_BUF_SIZE (sizeof(struct net_buf *) + UART_BUF_SIZE)
+#define UART_RX_BUF_COUNT (CONFIG_BT_NUS_UART_RX_BUF_COUNT + \
+			   CONFIG_BT_NUS_CONN_BUF_COUNT)
+/* Data of the buffers receiving, with the overhead of the k_heap. An
+ * allocation takes the data, a ref count byte and a chunk header of 4
+ * bytes (8 in heaps over 256 KB), in units of 8 bytes: +16 covers it
+ * with at least 8 bytes to spare. +64 covers the heap header with its
+ * buckets, at most 56 bytes up to 1 KB with CONFIG_SYS_HEAP_RUNTIME_STATS,
+ * and 8 bytes of end marker. A larger heap takes up to 8 bytes more per
+ * doubling, less than the spare bytes of its buffers.
+ */
+#define UART_RX_HEAP_SIZE (CONFIG_BT_NUS_UART_RX_BUF_COUNT * \
+			   ROUND_UP(UART_RX_BUF_SIZE + 16, 8) + 64)
+
+static void uart_rx_buf_destroy(struct net_buf *buf);
+
+NET_BUF_POOL_VAR_DEFINE(uart_rx_bufs, UART_RX_BUF_COUNT, UART_RX_HEAP_SIZE,
+			sizeof(uint32_t), uart_rx_buf_destroy);
+
 static K_FIFO_DEFINE(fifo_uart_tx_data);
 static K_FIFO_DEFINE(fifo_uart_rx_data);
 
+/* Connection of the bridge, with its UART data to notify */
+struct nus_conn {
+	struct bt_conn *conn;
+	/* Slices of the RX buffers, chained as fragments */
+	struct net_buf *frags;
+	/* Notifications which can be handed to the stack before one
+	 * completes.
+	 */
+	atomic_t credits;
+
+	/* Notification spanning several fragments */
+	uint8_t data[NUS_TX_LEN_MAX];
+};
+
+static struct nus_conn nus_conns[NUS_CONN_COUNT];
+static K_MUTEX_DEFINE(nus_conns_lock);
+
+/* Wakes ble_write_thread() on UART data and completed notifications */
+static K_SEM_DEFINE(nus_tx_wake, 0, 1);
+
+/* UART RX waits for a free buffer */
+static atomic_t uart_rx_paused;
+
+/* RX buffers in fifo_uart_rx_data or held by nus_demux() */
+static atomic_t uart_rx_queued;
+
+/* UART RX stays disabled while the shell sends test data */
+static atomic_t uart_rx_held;
+
 static const struct bt_data ad[] = {
 	BT_DATA_BYTES(BT_DATA_FLAGS, (BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR)),
 	BT_DATA(BT_DATA_NAME_COMPLETE, DEVICE_NAME, DEVICE_NAME_LEN),
@@ -86,14 +168,288 @@ UART_ASYNC_ADAPTER_INST_DEFINE(async_adapter);
 static const struct device *const async_adapter;
 #endif
 
+static struct uart_data_t *uart_buf_alloc(void)
+{
+	struct uart_data_t *buf;
+
+	if (k_mem_slab_alloc(&uart_tx_slab, (void **)&buf, K_NO_WAIT)) {
+		nus_stats_add(NUS_STATS_UART_TX_ALLOC_FAILURES, 1);
+		return NULL;
+	}
+
+	nus_stats_pool_alloc(NUS_STATS_POOL_UART_TX);
+
+	buf->len = 0;
+
+	return buf;
+}
+
+static void uart_buf_free(struct uart_data_t *buf)
+{
+	nus_stats_pool_free(NUS_STATS_POOL_UART_TX);
+	k_mem_slab_free(&uart_tx_slab, (void **)&buf);
+}
+
+/* Uptime in milliseconds when the data was received on UART */
+static uint32_t *uart_rx_buf_time(struct net_buf *buf)
+{
+	return net_buf_user_data(buf);
+}
+
+static struct net_buf *uart_rx_buf_alloc(k_timeout_t timeout)
+{
+	struct net_buf *buf = net_buf_alloc_len(&uart_rx_bufs, UART_RX_BUF_SIZE,
+						timeout);
+
+	if (!buf) {
+		nus_stats_add(NUS_STATS_UART_RX_ALLOC_FAILURES, 1);
+		return NULL;
+	}
+
+	nus_stats_pool_alloc(NUS_STATS_POOL_UART_RX);
+
+	net_buf_add_mem(buf, &buf, sizeof(buf));
+	net_buf_pull(buf, sizeof(buf));
+
+	return buf;
+}
+
+/* RX buffer of the data pointer given to the UART driver */
+static struct net_buf *uart_rx_buf_get(uint8_t *data)
+{
+	struct net_buf *buf;
+
+	memcpy(&buf, data - sizeof(buf), sizeof(buf));
+
+	return buf;
+}
+
+/* Clone of len bytes at offset of an RX buffer, sharing its data */
+static struct net_buf *uart_rx_buf_slice(struct net_buf *buf, size_t offset,
+					 size_t len)
+{
+	struct net_buf *slice = net_buf_clone(buf, K_NO_WAIT);
+
+	if (!slice) {
+		nus_stats_add(NUS_STATS_UART_RX_ALLOC_FAILURES, 1);
+		return NULL;
+	}
+
+	nus_stats_pool_alloc(NUS_STATS_POOL_UART_RX);
+
+	net_buf_pull(slice, offset);
+	slice->len = len;
+	*uart_rx_buf_time(slice) = *uart_rx_buf_time(buf);
+
+	return slice;
+}
+
+static void uart_rx_buf_destroy(struct net_buf *buf)
+{
+	nus_stats_pool_free(NUS_STATS_POOL_UART_RX);
+	net_buf_destroy(buf);
+
+	/* Resume UART RX as soon as a buffer is free */
+	if (atomic_cas(&uart_rx_paused, 1, 0)) {
+		k_work_reschedule(&uart_work, K_NO_WAIT);
+	}
+}
+
+/* No RX buffer is free, UART RX stays disabled until ble_write_thread()
+ * frees one. With hardware flow control, RTS holds off the sender.
+ */
+static void uart_rx_pause(void)
+{
+	LOG_DBG("UART RX paused, no receive buffer");
+	nus_stats_add(NUS_STATS_UART_RX_PAUSES, 1);
+	atomic_set(&uart_rx_paused, 1);
+	k_work_reschedule(&uart_work, UART_WAIT_FOR_BUF_DELAY);
+}
+
+/* Log the CPU cycles per byte of the UART async adapter interrupts since
+ * the last report.
+ */
+static void uart_adapter_stats_report(void)
+{
+	struct uart_async_adapter_stats stats;
+
+	uart_async_adapter_stats_get(async_adapter, &stats);
+	if (!stats.rx_bytes && !stats.tx_bytes) {
+		return;
+	}
+
+	LOG_INF("UART adapter: RX %u bytes, %u cycles/byte, TX %u bytes, %u cycles/byte",
+		stats.rx_bytes, stats.rx_cycles / MAX(stats.rx_bytes, 1),
+		stats.tx_bytes, stats.tx_cycles / MAX(stats.tx_bytes, 1));
+}
+
+#if defined(CONFIG_BT_NUS_STATS)
+/* Increase of a statistic since the last report, from zero after a
+ * reset.
+ */
+static uint32_t nus_stats_delta(uint32_t now, uint32_t last)
+{
+	now = sys_le32_to_cpu(now);
+	last = sys_le32_to_cpu(last);
+
+	return (now >= last) ? (now - last) : now;
+}
+
+/* Log the statistics. The buffers used at most and the lost data when
+ * they change. The rate and payload efficiency of the notifications
+ * since the last report, efficiency is the share of the ATT MTU
+ * carrying data, and the bytes copied to notifications spanning several
+ * RX buffers. Then the data rates and latency of each connection.
+ * Latency is from UART reception to the notification being handed to
+ * the stack, the maximum is since the statistics were cleared.
+ */
+static void nus_stats_report(void)
+{
+	static struct nus_stats last;
+	static int64_t last_report;
+	int64_t now = k_uptime_get();
+	uint32_t elapsed = MAX(now - last_report, 1);
+	struct nus_stats stats;
+	uint32_t notifications;
+	uint32_t bytes;
+
+	nus_stats_get(&stats);
+	last_report = now;
+
+	if ((stats.pool_max[NUS_STATS_POOL_UART_RX] !=
+	     last.pool_max[NUS_STATS_POOL_UART_RX]) ||
+	    nus_stats_delta(stats.counters[NUS_STATS_UART_RX_ALLOC_FAILURES],
+			    last.counters[NUS_STATS_UART_RX_ALLOC_FAILURES])) {
+		LOG_INF("UART RX buffers: %u of %u used at most, "
+			"%u allocation failures",
+			sys_le16_to_cpu(stats.pool_max[NUS_STATS_POOL_UART_RX]),
+			UART_RX_BUF_COUNT,
+			sys_le32_to_cpu(stats.counters[NUS_STATS_UART_RX_ALLOC_FAILURES]));
+	}
+
+	if ((stats.pool_max[NUS_STATS_POOL_UART_TX] !=
+	     last.pool_max[NUS_STATS_POOL_UART_TX]) ||
+	    nus_stats_delta(stats.counters[NUS_STATS_UART_TX_ALLOC_FAILURES],
+			    last.counters[NUS_STATS_UART_TX_ALLOC_FAILURES])) {
+		LOG_INF("UART TX buffers: %u of %u used at most, "
+			"%u allocation failures",
+			sys_le16_to_cpu(stats.pool_max[NUS_STATS_POOL_UART_TX]),
+			CONFIG_BT_NUS_UART_TX_BUF_COUNT,
+			sys_le32_to_cpu(stats.counters[NUS_STATS_UART_TX_ALLOC_FAILURES]));
+	}
+
+	notifications = nus_stats_delta(stats.counters[NUS_STATS_BLE_TX_NOTIFICATIONS],
+					last.counters[NUS_STATS_BLE_TX_NOTIFICATIONS]);
+	bytes = nus_stats_delta(stats.counters[NUS_STATS_BLE_TX_BYTES],
+				last.counters[NUS_STATS_BLE_TX_BYTES]);
+
+	if (notifications) {
+		uint32_t capacity =
+			nus_stats_delta(stats.counters[NUS_STATS_BLE_TX_CAPACITY],
+					last.counters[NUS_STATS_BLE_TX_CAPACITY]);
+
+		LOG_INF("NUS TX: %u notifications/s, %u B/s, %u%% payload efficiency, "
+			"%u flushed by timeout",
+			(uint32_t)((uint64_t)notifications * MSEC_PER_SEC /
+				   elapsed),
+			(uint32_t)((uint64_t)bytes * MSEC_PER_SEC / elapsed),
+			(uint32_t)((uint64_t)bytes * 100 / MAX(capacity, 1)),
+			nus_stats_delta(stats.counters[NUS_STATS_BLE_TX_FLUSH_TIMEOUTS],
+					last.counters[NUS_STATS_BLE_TX_FLUSH_TIMEOUTS]));
+		LOG_INF("NUS TX: %u of %u notifications copied, %u of %u bytes",
+			nus_stats_delta(stats.counters[NUS_STATS_BLE_TX_COPIES],
+					last.counters[NUS_STATS_BLE_TX_COPIES]),
+			notifications,
+			nus_stats_delta(stats.counters[NUS_STATS_BLE_TX_COPIED_BYTES],
+					last.counters[NUS_STATS_BLE_TX_COPIED_BYTES]),
+			bytes);
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(stats.conns); i++) {
+		struct nus_stats_conn *nc = &stats.conns[i];
+		struct nus_stats_conn *lc = &last.conns[i];
+		uint32_t count = nus_stats_delta(nc->notifications,
+						 lc->notifications);
+		uint32_t tx = nus_stats_delta(nc->tx_bytes, lc->tx_bytes);
+		uint32_t rx = nus_stats_delta(nc->rx_bytes, lc->rx_bytes);
+		uint32_t latency = nus_stats_delta(nc->latency_sum,
+						   lc->latency_sum);
+
+		if (!count && !rx) {
+			continue;
+		}
+
+		LOG_INF("NUS conn %zu: TX %u B/s, RX %u B/s, "
+			"latency %u ms average, %u ms max", i,
+			(uint32_t)((uint64_t)tx * MSEC_PER_SEC / elapsed),
+			(uint32_t)((uint64_t)rx * MSEC_PER_SEC / elapsed),
+			count ? (latency / count) : 0,
+			sys_le32_to_cpu(nc->latency_max));
+	}
+
+	if (nus_stats_delta(stats.counters[NUS_STATS_LOST_BYTES],
+			    last.counters[NUS_STATS_LOST_BYTES]) ||
+	    nus_stats_delta(stats.counters[NUS_STATS_UART_RX_ERRORS],
+			    last.counters[NUS_STATS_UART_RX_ERRORS]) ||
+	    nus_stats_delta(stats.counters[NUS_STATS_UART_RX_PAUSES],
+			    last.counters[NUS_STATS_UART_RX_PAUSES])) {
+		LOG_INF("NUS loss: %u bytes not sent, %u UART RX errors, "
+			"%u UART RX pauses",
+			sys_le32_to_cpu(stats.counters[NUS_STATS_LOST_BYTES]),
+			sys_le32_to_cpu(stats.counters[NUS_STATS_UART_RX_ERRORS]),
+			sys_le32_to_cpu(stats.counters[NUS_STATS_UART_RX_PAUSES]));
+	}
+
+	last = stats;
+}
+#endif
+
+/* Hand received data to ble_write_thread(). */
+static void uart_rx_queue(struct net_buf *buf)
+{
+	if (IS_ENABLED(CONFIG_BT_NUS_CONN_PROFILE)) {
+		conn_profile_traffic(buf->len);
+	}
+
+	nus_stats_add(NUS_STATS_UART_RX_BYTES, buf->len);
+	nus_stats_queue_put(NUS_STATS_QUEUE_UART_RX);
+
+	if (IS_ENABLED(CONFIG_BT_NUS_TX_AGGREGATE) ||
+	    IS_ENABLED(CONFIG_BT_NUS_STATS)) {
+		*uart_rx_buf_time(buf) = k_uptime_get_32();
+	}
+
+	atomic_inc(&uart_rx_queued);
+	net_buf_put(&fifo_uart_rx_data, buf);
+	k_sem_give(&nus_tx_wake);
+}
+
+/* Queue a slice of the buffer being received into, returns false when
+ * no buffer is free.
+ */
+static bool uart_rx_forward(struct net_buf *buf, size_t offset, size_t len)
+{
+	struct net_buf *slice = uart_rx_buf_slice(buf, offset, len);
+
+	if (!slice) {
+		return false;
+	}
+
+	uart_rx_queue(slice);
+
+	return true;
+}
+
 static void uart_cb(const struct device *dev, struct uart_event *evt, void *user_data)
 {
 	ARG_UNUSED(dev);
 
 	static size_t aborted_len;
 	struct uart_data_t *buf;
+	struct net_buf *rx;
 	static uint8_t *aborted_buf;
 	static bool disable_req;
+	static uint8_t *rx_held;
 
 	switch (evt->type) {
 	case UART_TX_DONE:
@@ -113,13 +469,16 @@ static void uart_cb(const struct device *dev, struct uart_event *evt, void *user
 					   data);
 		}
 
-		k_free(buf);
+		uart_buf_free(buf);
+		nus_stats_add(NUS_STATS_UART_TX_BYTES, evt->data.tx.len);
 
 		buf = k_fifo_get(&fifo_uart_tx_data, K_NO_WAIT);
 		if (!buf) {
 			return;
 		}
 
+		nus_stats_queue_get(NUS_STATS_QUEUE_UART_TX);
+
 		if (uart_tx(uart, buf->data, buf->len, SYS_FOREVER_MS)) {
 			LOG_WRN("Failed to send data over UART");
 		}
@@ -128,15 +487,31 @@ static void uart_cb(const struct device *dev, struct uart_event *evt, void *user
 
 	case UART_RX_RDY:
 		LOG_DBG("UART_RX_RDY");
-		buf = CONTAINER_OF(evt->data.rx.buf, struct uart_data_t, data);
-		buf->len += evt->data.rx.len;
+		rx = uart_rx_buf_get(evt->data.rx.buf);
+		net_buf_add(rx, evt->data.rx.len);
+
+		/* In binary mode, buffers are chained by UART_RX_BUF_REQUEST
+		 * and the data is forwarded as it arrives, a buffer is only
+		 * released by the driver when it is full.
+		 */
+		if (IS_ENABLED(CONFIG_BT_NUS_UART_BINARY)) {
+			if (!rx_held && !uart_rx_forward(rx, evt->data.rx.offset,
+							 evt->data.rx.len)) {
+				/* Out of buffers, the rest of this one is
+				 * queued when it is released.
+				 */
+				rx_held = &evt->data.rx.buf[evt->data.rx.offset];
+			}
+
+			return;
+		}
 
 		if (disable_req) {
 			return;
 		}
 
-		if ((evt->data.rx.buf[buf->len - 1] == '\n') ||
-		    (evt->data.rx.buf[buf->len - 1] == '\r')) {
+		if ((rx->data[rx->len - 1] == '\n') ||
+		    (rx->data[rx->len - 1] == '\r')) {
 			disable_req = true;
 			uart_rx_disable(uart);
 		}
@@ -147,26 +522,26 @@ static void uart_cb(const struct device *dev, struct uart_event *evt, void *user
 		LOG_DBG("UART_RX_DISABLED");
 		disable_req = false;
 
-		buf = k_malloc(sizeof(*buf));
-		if (buf) {
-			buf->len = 0;
-		} else {
-			LOG_WRN("Not able to allocate UART receive buffer");
-			k_work_reschedule(&uart_work, UART_WAIT_FOR_BUF_DELAY);
+		if (atomic_get(&uart_rx_held)) {
 			return;
 		}
 
-		uart_rx_enable(uart, buf->data, sizeof(buf->data),
+		rx = uart_rx_buf_alloc(K_NO_WAIT);
+		if (!rx) {
+			uart_rx_pause();
+			return;
+		}
+
+		uart_rx_enable(uart, rx->data, net_buf_tailroom(rx),
 			       UART_WAIT_FOR_RX);
 
 		break;
 
 	case UART_RX_BUF_REQUEST:
 		LOG_DBG("UART_RX_BUF_REQUEST");
-		buf = k_malloc(sizeof(*buf));
-		if (buf) {
-			buf->len = 0;
-			uart_rx_buf_rsp(uart, buf->data, sizeof(buf->data));
+		rx = uart_rx_buf_alloc(K_NO_WAIT);
+		if (rx) {
+			uart_rx_buf_rsp(uart, rx->data, net_buf_tailroom(rx));
 		} else {
 			LOG_WRN("Not able to allocate UART receive buffer");
 		}
@@ -175,17 +550,32 @@ static void uart_cb(const struct device *dev, struct uart_event *evt, void *user
 
 	case UART_RX_BUF_RELEASED:
 		LOG_DBG("UART_RX_BUF_RELEASED");
-		buf = CONTAINER_OF(evt->data.rx_buf.buf, struct uart_data_t,
-				   data);
+		rx = uart_rx_buf_get(evt->data.rx_buf.buf);
+
+		if (IS_ENABLED(CONFIG_BT_NUS_UART_BINARY)) {
+			if (rx_held && (rx_held >= rx->data) &&
+			    (rx_held < net_buf_tail(rx))) {
+				net_buf_pull(rx, rx_held - rx->data);
+				rx_held = NULL;
+			} else {
+				rx->len = 0;
+			}
+		}
 
-		if (buf->len > 0) {
-			k_fifo_put(&fifo_uart_rx_data, buf);
+		if (rx->len > 0) {
+			uart_rx_queue(rx);
 		} else {
-			k_free(buf);
+			net_buf_unref(rx);
 		}
 
 		break;
 
+	case UART_RX_STOPPED:
+		LOG_WRN("UART RX stopped (reason %d)", evt->data.rx_stop.reason);
+		nus_stats_add(NUS_STATS_UART_RX_ERRORS, 1);
+
+		break;
+
 	case UART_TX_ABORTED:
 		LOG_DBG("UART_TX_ABORTED");
 		if (!aborted_buf) {
@@ -208,18 +598,25 @@ static void uart_cb(const struct device *dev, struct uart_event *evt, void *user
 
 static void uart_work_handler(struct k_work *item)
 {
-	struct uart_data_t *buf;
+	struct net_buf *buf;
 
-	buf = k_malloc(sizeof(*buf));
-	if (buf) {
-		buf->len = 0;
-	} else {
-		LOG_WRN("Not able to allocate UART receive buffer");
-		k_work_reschedule(&uart_work, UART_WAIT_FOR_BUF_DELAY);
+	atomic_set(&uart_rx_paused, 0);
+
+	if (atomic_get(&uart_rx_held)) {
 		return;
 	}
 
-	uart_rx_enable(uart, buf->data, sizeof(buf->data), UART_WAIT_FOR_RX);
+	buf = uart_rx_buf_alloc(K_NO_WAIT);
+	if (!buf) {
+		uart_rx_pause();
+		return;
+	}
+
+	if (uart_rx_enable(uart, buf->data, net_buf_tailroom(buf),
+			   UART_WAIT_FOR_RX)) {
+		/* RX is enabled already */
+		net_buf_unref(buf);
+	}
 }
 
 static bool uart_test_async_api(const struct device *dev)
@@ -234,7 +631,7 @@ static int uart_init(void)
 {
 	int err;
 	int pos;
-	struct uart_data_t *rx;
+	struct net_buf *rx;
 	struct uart_data_t *tx;
 
 	if (!device_is_ready(uart)) {
@@ -249,10 +646,8 @@ static int uart_init(void)
 		}
 	}
 
-	rx = k_malloc(sizeof(*rx));
-	if (rx) {
-		rx->len = 0;
-	} else {
+	rx = uart_rx_buf_alloc(K_NO_WAIT);
+	if (!rx) {
 		return -ENOMEM;
 	}
 
@@ -294,14 +689,14 @@ static int uart_init(void)
 		}
 	}
 
-	tx = k_malloc(sizeof(*tx));
+	tx = uart_buf_alloc();
 
 	if (tx) {
 		pos = snprintf(tx->data, sizeof(tx->data),
 			       "Starting Nordic UART service example\r\n");
 
 		if ((pos < 0) || (pos >= sizeof(tx->data))) {
-			k_free(tx);
+			uart_buf_free(tx);
 			LOG_ERR("snprintf returned %d", pos);
 			return -ENOMEM;
 		}
@@ -317,7 +712,43 @@ static int uart_init(void)
 		return err;
 	}
 
-	return uart_rx_enable(uart, rx->data, sizeof(rx->data), 50);
+	return uart_rx_enable(uart, rx->data, net_buf_tailroom(rx), 50);
+}
+
+static struct nus_conn *nus_conn_find(const struct bt_conn *conn)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(nus_conns); i++) {
+		if (nus_conns[i].conn == conn) {
+			return &nus_conns[i];
+		}
+	}
+
+	return NULL;
+}
+
+/* Any connection has data to send */
+static bool nus_conn_pending(void)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(nus_conns); i++) {
+		if (nus_conns[i].frags) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static size_t nus_conn_count(void)
+{
+	size_t count = 0;
+
+	for (size_t i = 0; i < ARRAY_SIZE(nus_conns); i++) {
+		if (nus_conns[i].conn) {
+			count++;
+		}
+	}
+
+	return count;
 }
 
 static void connected(struct bt_conn *conn, uint8_t err)
@@ -330,9 +761,21 @@ static void connected(struct bt_conn *conn, uint8_t err)
 	}
 
 	bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
-	LOG_INF("Connected %s", addr);
 
-	current_conn = bt_conn_ref(conn);
+	k_mutex_lock(&nus_conns_lock, K_FOREVER);
+
+	for (size_t i = 0; i < ARRAY_SIZE(nus_conns); i++) {
+		struct nus_conn *nc = &nus_conns[i];
+
+		if (!nc->conn) {
+			nc->conn = bt_conn_ref(conn);
+			atomic_set(&nc->credits, CONFIG_BT_NUS_TX_CREDITS);
+			LOG_INF("Connected %s as %zu", addr, i);
+			break;
+		}
+	}
+
+	k_mutex_unlock(&nus_conns_lock);
 
 	dk_set_led_on(CON_STATUS_LED);
 }
@@ -345,16 +788,29 @@ static void disconnected(struct bt_conn *conn, uint8_t reason)
 
 	LOG_INF("Disconnected: %s (reason %u)", addr, reason);
 
-	if (auth_conn) {
+	/* A pairing of another connection may be waiting for a button */
+	if (auth_conn == conn) {
 		bt_conn_unref(auth_conn);
 		auth_conn = NULL;
 	}
 
-	if (current_conn) {
-		bt_conn_unref(current_conn);
-		current_conn = NULL;
+	/* The data still queued is dropped by ble_write_thread() */
+	k_mutex_lock(&nus_conns_lock, K_FOREVER);
+
+	struct nus_conn *nc = nus_conn_find(conn);
+
+	if (nc) {
+		bt_conn_unref(nc->conn);
+		nc->conn = NULL;
+	}
+
+	if (nus_conn_count() == 0) {
 		dk_set_led_off(CON_STATUS_LED);
 	}
+
+	k_mutex_unlock(&nus_conns_lock);
+
+	k_sem_give(&nus_tx_wake);
 }
 
 #ifdef CONFIG_BT_NUS_SECURITY_ENABLED
@@ -454,13 +910,24 @@ static void bt_receive_cb(struct bt_conn *conn, const uint8_t *const data,
 {
 	int err;
 	char addr[BT_ADDR_LE_STR_LEN] = {0};
+	struct nus_conn *nc = nus_conn_find(conn);
 
 	bt_addr_le_to_str(bt_conn_get_dst(conn), addr, ARRAY_SIZE(addr));
 
 	LOG_INF("Received data from: %s", addr);
 
+	if (!nc) {
+		return;
+	}
+
+	nus_stats_written(nc - nus_conns, len);
+
+	if (IS_ENABLED(CONFIG_BT_NUS_CONN_PROFILE)) {
+		conn_profile_traffic(len);
+	}
+
 	for (uint16_t pos = 0; pos != len;) {
-		struct uart_data_t *tx = k_malloc(sizeof(*tx));
+		struct uart_data_t *tx = uart_buf_alloc();
 
 		if (!tx) {
 			LOG_WRN("Not able to allocate UART send data buffer");
@@ -468,35 +935,58 @@ static void bt_receive_cb(struct bt_conn *conn, const uint8_t *const data,
 		}
 
 		/* Keep the last byte of TX buffer for potential LF char. */
-		size_t tx_data_size = sizeof(tx->data) - 1;
-
-		if ((len - pos) > tx_data_size) {
-			tx->len = tx_data_size;
-		} else {
-			tx->len = (len - pos);
+		size_t tx_data_size = sizeof(tx->data) -
+				      (IS_ENABLED(CONFIG_BT_NUS_UART_BINARY) ? 0 : 1);
+
+		/* Frame the data with the index of the connection */
+		if (IS_ENABLED(CONFIG_BT_NUS_UART_ADDRESSING) && (pos == 0)) {
+			tx->data[0] = nc - nus_conns;
+			tx->data[1] = len;
+			tx->len = NUS_UART_HEADER_LEN;
+			tx_data_size -= NUS_UART_HEADER_LEN;
 		}
 
-		memcpy(tx->data, &data[pos], tx->len);
+		size_t chunk = MIN(len - pos, tx_data_size);
 
-		pos += tx->len;
+		memcpy(&tx->data[tx->len], &data[pos], chunk);
+
+		tx->len += chunk;
+		pos += chunk;
 
 		/* Append the LF character when the CR character triggered
 		 * transmission from the peer.
 		 */
-		if ((pos == len) && (data[len - 1] == '\r')) {
+		if (!IS_ENABLED(CONFIG_BT_NUS_UART_BINARY) &&
+		    (pos == len) && (data[len - 1] == '\r')) {
 			tx->data[tx->len] = '\n';
 			tx->len++;
 		}
 
 		err = uart_tx(uart, tx->data, tx->len, SYS_FOREVER_MS);
 		if (err) {
+			nus_stats_queue_put(NUS_STATS_QUEUE_UART_TX);
 			k_fifo_put(&fifo_uart_tx_data, tx);
 		}
 	}
 }
 
+static void bt_sent_cb(struct bt_conn *conn)
+{
+	struct nus_conn *nc = nus_conn_find(conn);
+
+	/* Credits are reset when a connection is made, a completion of
+	 * an earlier connection is ignored.
+	 */
+	if (nc && (atomic_get(&nc->credits) < CONFIG_BT_NUS_TX_CREDITS)) {
+		atomic_inc(&nc->credits);
+	}
+
+	k_sem_give(&nus_tx_wake);
+}
+
 static struct bt_nus_cb nus_cb = {
 	.received = bt_receive_cb,
+	.sent = bt_sent_cb,
 };
 
 void error(void)
@@ -611,27 +1101,549 @@ void main(void)
 
 	for (;;) {
 		dk_set_led(RUN_STATUS_LED, (++blink_status) % 2);
+#if defined(CONFIG_BT_NUS_STATS)
+		nus_stats_report();
+#endif
+		if (IS_ENABLED(CONFIG_BT_NUS_UART_ASYNC_ADAPTER_STATS)) {
+			uart_adapter_stats_report();
+		}
 		k_sleep(K_MSEC(RUN_LED_BLINK_INTERVAL));
 	}
 }
 
+/* Payload size of a notification on the connection */
+static uint16_t nus_conn_mtu(struct bt_conn *conn)
+{
+	return MIN(bt_nus_get_mtu(conn), NUS_TX_LEN_MAX);
+}
+
+/* Add a slice to the fragments of the connection. It is merged with the
+ * last fragment when it follows it in the same RX buffer.
+ */
+static void nus_conn_append(struct nus_conn *nc, struct net_buf *slice)
+{
+	struct net_buf *last;
+
+	if (!nc->frags) {
+		nc->frags = slice;
+		return;
+	}
+
+	last = net_buf_frag_last(nc->frags);
+	if ((last->__buf == slice->__buf) &&
+	    (net_buf_tail(last) == slice->data)) {
+		net_buf_add(last, slice->len);
+		net_buf_unref(slice);
+		return;
+	}
+
+	net_buf_frag_add(nc->frags, slice);
+}
+
+/* Queue the first len bytes of an RX buffer for the connection at index
+ * addr, or for all of them. Returns false when no buffer is free,
+ * nothing is queued then.
+ */
+static bool nus_conn_enqueue(uint8_t addr, struct net_buf *buf, uint16_t len)
+{
+	struct net_buf *slices[NUS_CONN_COUNT];
+	size_t count = 0;
+
+	for (size_t i = 0; i < ARRAY_SIZE(nus_conns); i++) {
+		if (!nus_conns[i].conn ||
+		    ((addr != NUS_UART_ADDR_ALL) && (addr != i))) {
+			slices[i] = NULL;
+			continue;
+		}
+
+		slices[i] = uart_rx_buf_slice(buf, 0, len);
+		if (!slices[i]) {
+			while (i--) {
+				if (slices[i]) {
+					net_buf_unref(slices[i]);
+				}
+			}
+			return false;
+		}
+
+		count++;
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(nus_conns); i++) {
+		if (slices[i]) {
+			nus_conn_append(&nus_conns[i], slices[i]);
+		}
+	}
+
+	/* No connection to send to */
+	if (!count) {
+		nus_stats_add(NUS_STATS_LOST_BYTES, len);
+	}
+
+	return true;
+}
+
+/* Move the UART data to the connections. The position is kept when no
+ * buffer is free, and resumed on the next call.
+ */
+static void nus_demux(void)
+{
+	static struct net_buf *buf;
+	static uint8_t header;
+	static uint8_t frame_addr;
+	static uint8_t frame_len;
+
+	for (;;) {
+		if (!buf) {
+			buf = net_buf_get(&fifo_uart_rx_data, K_NO_WAIT);
+			if (!buf) {
+				return;
+			}
+
+			nus_stats_queue_get(NUS_STATS_QUEUE_UART_RX);
+		}
+
+		while (buf->len) {
+			uint8_t addr = NUS_UART_ADDR_ALL;
+			uint16_t len = buf->len;
+
+			if (IS_ENABLED(CONFIG_BT_NUS_UART_ADDRESSING)) {
+				if (header == 0) {
+					frame_addr = net_buf_pull_u8(buf);
+					header++;
+					continue;
+				}
+
+				if (header == 1) {
+					frame_len = net_buf_pull_u8(buf);
+					header = frame_len ? 2 : 0;
+					continue;
+				}
+
+				addr = frame_addr;
+				len = MIN(len, frame_len);
+			}
+
+			if (!nus_conn_enqueue(addr, buf, len)) {
+				return;
+			}
+
+			net_buf_pull(buf, len);
+
+			if (IS_ENABLED(CONFIG_BT_NUS_UART_ADDRESSING)) {
+				frame_len -= len;
+				header = frame_len ? 2 : 0;
+			}
+		}
+
+		net_buf_unref(buf);
+		buf = NULL;
+		atomic_dec(&uart_rx_queued);
+	}
+}
+
+/* Length of the next notification of the connection: the MTU, or less
+ * when its first byte waited the flush time. Returns 0 while it waits
+ * for more data, and sets the time left until the flush in wait.
+ * Without CONFIG_BT_NUS_TX_AGGREGATE, each fragment is sent on its own.
+ */
+static uint16_t nus_conn_ready(struct nus_conn *nc, uint16_t mtu,
+			       int32_t *wait)
+{
+	size_t len;
+	uint32_t age;
+
+	if (!nc->frags) {
+		return 0;
+	}
+
+	if (!IS_ENABLED(CONFIG_BT_NUS_TX_AGGREGATE)) {
+		return MIN(nc->frags->len, mtu);
+	}
+
+	len = net_buf_frags_len(nc->frags);
+	if (len >= mtu) {
+		return mtu;
+	}
+
+	age = k_uptime_get_32() - *uart_rx_buf_time(nc->frags);
+	if (age >= CONFIG_BT_NUS_TX_FLUSH_TIME) {
+		nus_stats_add(NUS_STATS_BLE_TX_FLUSH_TIMEOUTS, 1);
+		return len;
+	}
+
+	if ((*wait == SYS_FOREVER_MS) ||
+	    ((CONFIG_BT_NUS_TX_FLUSH_TIME - age) < *wait)) {
+		*wait = CONFIG_BT_NUS_TX_FLUSH_TIME - age;
+	}
+
+	return 0;
+}
+
+/* Remove len bytes from the front of the fragments of the connection. */
+static void nus_conn_pull(struct nus_conn *nc, size_t len)
+{
+	while (len) {
+		size_t chunk = MIN(len, nc->frags->len);
+
+		net_buf_pull(nc->frags, chunk);
+		len -= chunk;
+
+		if (!nc->frags->len) {
+			nc->frags = net_buf_frag_del(NULL, nc->frags);
+		}
+	}
+}
+
+/* True if the error of bt_nus_send() means that the data can never be
+ * sent on this connection.
+ */
+static bool nus_conn_send_fatal(struct bt_conn *conn, int err)
+{
+	static const struct bt_gatt_attr *tx_attr;
+
+	if (err == -ENOTCONN) {
+		return true;
+	}
+
+	if (err != -EINVAL) {
+		return false;
+	}
+
+	if (!tx_attr) {
+		tx_attr = bt_gatt_find_by_uuid(NULL, 0, BT_UUID_NUS_TX);
+	}
+
+	return !tx_attr ||
+	       !bt_gatt_is_subscribed(conn, tx_attr, BT_GATT_CCC_NOTIFY);
+}
+
+/* Send len bytes of the fragments. The notification is sent from the
+ * RX buffer when the first fragment holds it, it is only copied when it
+ * spans several fragments. The data is kept for a retry when the stack
+ * is out of buffers, and dropped when the peer cannot receive it.
+ * Returns false if the data was kept.
+ */
+static bool nus_conn_send(struct nus_conn *nc, struct bt_conn *conn,
+			  uint16_t mtu, uint16_t len)
+{
+	uint32_t rx_time = *uart_rx_buf_time(nc->frags);
+	const uint8_t *data = nc->frags->data;
+	int err;
+
+	if (nc->frags->len < len) {
+		net_buf_linearize(nc->data, sizeof(nc->data), nc->frags, 0, len);
+		data = nc->data;
+		nus_stats_add(NUS_STATS_BLE_TX_COPIES, 1);
+		nus_stats_add(NUS_STATS_BLE_TX_COPIED_BYTES, len);
+	}
+
+	/* Taken before sending, the completion may come first */
+	atomic_dec(&nc->credits);
+
+	err = bt_nus_send(conn, data, len);
+	if (err) {
+		atomic_inc(&nc->credits);
+		nus_stats_add(NUS_STATS_BLE_TX_ERRORS, 1);
+
+		if (!nus_conn_send_fatal(conn, err)) {
+			LOG_DBG("Notification deferred (err %d)", err);
+			return false;
+		}
+
+		nus_conn_pull(nc, len);
+		nus_stats_add(NUS_STATS_LOST_BYTES, len);
+		LOG_WRN("Failed to send data over BLE connection (err %d)", err);
+		return true;
+	}
+
+	nus_conn_pull(nc, len);
+
+	if (IS_ENABLED(CONFIG_BT_NUS_STATS)) {
+		nus_stats_notified(nc - nus_conns, len, mtu,
+				   k_uptime_get_32() - rx_time);
+	}
+
+	return true;
+}
+
+/* Drop the data of a closed connection, returns true if there was any. */
+static bool nus_conn_drop(struct nus_conn *nc)
+{
+	size_t lost;
+
+	if (!nc->frags) {
+		return false;
+	}
+
+	lost = net_buf_frags_len(nc->frags);
+	net_buf_unref(nc->frags);
+	nc->frags = NULL;
+
+	nus_stats_add(NUS_STATS_LOST_BYTES, lost);
+
+	return true;
+}
+
+/* Send one notification per connection in turn, starting one connection
+ * later each round, while any is sent. Returns the time in milliseconds
+ * until a partial notification is flushed or a deferred one is retried,
+ * or SYS_FOREVER_MS.
+ */
+static int32_t nus_schedule(void)
+{
+	static size_t next;
+	int32_t wait;
+	bool progress;
+
+	do {
+		progress = false;
+		wait = SYS_FOREVER_MS;
+
+		for (size_t n = 0; n < ARRAY_SIZE(nus_conns); n++) {
+			struct nus_conn *nc =
+				&nus_conns[(next + n) % ARRAY_SIZE(nus_conns)];
+			struct bt_conn *conn = NULL;
+			uint16_t mtu;
+			uint16_t len;
+
+			k_mutex_lock(&nus_conns_lock, K_FOREVER);
+			if (nc->conn) {
+				conn = bt_conn_ref(nc->conn);
+			}
+			k_mutex_unlock(&nus_conns_lock);
+
+			if (!conn) {
+				progress |= nus_conn_drop(nc);
+				continue;
+			}
+
+			/* Without credit, the completion wakes the thread */
+			mtu = nus_conn_mtu(conn);
+			if (atomic_get(&nc->credits) > 0) {
+				len = nus_conn_ready(nc, mtu, &wait);
+				if (len && nus_conn_send(nc, conn, mtu, len)) {
+					progress = true;
+				} else if (len && ((wait == SYS_FOREVER_MS) ||
+						   (wait > NUS_TX_RETRY_DELAY))) {
+					wait = NUS_TX_RETRY_DELAY;
+				}
+			}
+
+			bt_conn_unref(conn);
+		}
+
+		next = (next + 1) % ARRAY_SIZE(nus_conns);
+
+		/* Freed buffers may let more UART data in */
+		nus_demux();
+	} while (progress);
+
+	return wait;
+}
+
 void ble_write_thread(void)
 {
+	int32_t wait = SYS_FOREVER_MS;
+
 	/* Don't go any further until BLE is initialized */
 	k_sem_take(&ble_init_ok, K_FOREVER);
 
 	for (;;) {
-		/* Wait indefinitely for data to be sent over bluetooth */
-		struct uart_data_t *buf = k_fifo_get(&fifo_uart_rx_data,
-						     K_FOREVER);
+		/* Wait for UART data, a completed notification or the flush
+		 * time of a partial notification.
+		 */
+		k_sem_take(&nus_tx_wake, (wait == SYS_FOREVER_MS) ?
+			   K_FOREVER : K_MSEC(wait));
 
-		if (bt_nus_send(NULL, buf->data, buf->len)) {
-			LOG_WRN("Failed to send data over BLE connection");
+		nus_demux();
+		wait = nus_schedule();
+	}
+}
+
+#if defined(CONFIG_BT_NUS_SHELL)
+/* Send data through the bridge as if it was received on UART, and time
+ * it until the last buffer is handed to the stack. UART RX is disabled
+ * meanwhile, so only the test data is sent. With
+ * CONFIG_BT_NUS_UART_ADDRESSING, the data is framed for all connections.
+ */
+static int cmd_throughput(const struct shell *sh, size_t argc, char **argv)
+{
+	const size_t header = IS_ENABLED(CONFIG_BT_NUS_UART_ADDRESSING) ?
+			      NUS_UART_HEADER_LEN : 0;
+	uint32_t size = strtoul(argv[1], NULL, 0);
+	uint32_t queued = 0;
+	uint32_t elapsed;
+	int64_t start;
+
+	if (!nus_conn_count()) {
+		shell_error(sh, "Not connected");
+		return -ENOTCONN;
+	}
+
+	/* Fails when RX is paused or being disabled, it stays off then */
+	atomic_set(&uart_rx_held, 1);
+	(void)uart_rx_disable(uart);
+
+	start = k_uptime_get();
+
+	while (queued < size) {
+		/* Wait for the bridge like UART RX does with HWFC */
+		struct net_buf *buf = uart_rx_buf_alloc(K_FOREVER);
+
+		while ((net_buf_tailroom(buf) > header) && (queued < size)) {
+			uint16_t len = MIN(net_buf_tailroom(buf) - header,
+					   size - queued);
+			uint8_t *data;
+
+			if (IS_ENABLED(CONFIG_BT_NUS_UART_ADDRESSING)) {
+				len = MIN(len, UINT8_MAX);
+				net_buf_add_u8(buf, NUS_UART_ADDR_ALL);
+				net_buf_add_u8(buf, len);
+			}
+
+			data = net_buf_add(buf, len);
+			for (uint16_t i = 0; i < len; i++) {
+				data[i] = queued + i;
+			}
+
+			queued += len;
+		}
+
+		uart_rx_queue(buf);
+	}
+
+	/* A buffer is only released by nus_demux() once its data is queued
+	 * for the connections.
+	 */
+	while (atomic_get(&uart_rx_queued) || nus_conn_pending()) {
+		k_sleep(K_MSEC(1));
+	}
+
+	elapsed = MAX(k_uptime_get() - start, 1);
+
+	atomic_set(&uart_rx_held, 0);
+	k_work_reschedule(&uart_work, K_NO_WAIT);
+
+	shell_print(sh, "%u bytes in %u ms, %u kbit/s", size, elapsed,
+		    (uint32_t)((uint64_t)size * 8 / elapsed));
+
+	return 0;
+}
+
+#if defined(CONFIG_BT_NUS_CONN_PROFILE)
+static int cmd_profile(const struct shell *sh, size_t argc, char **argv)
+{
+	if (argc > 1) {
+		if (!strcmp(argv[1], "throughput")) {
+			conn_profile_set(CONN_PROFILE_THROUGHPUT, false);
+		} else if (!strcmp(argv[1], "low_power")) {
+			conn_profile_set(CONN_PROFILE_LOW_POWER, false);
+		} else if (!strcmp(argv[1], "auto")) {
+			conn_profile_set(conn_profile_get(), true);
+		} else {
+			shell_error(sh, "Unknown profile %s", argv[1]);
+			return -EINVAL;
 		}
+	}
+
+	shell_print(sh, "Profile %s", conn_profile_name(conn_profile_get()));
+
+	return 0;
+}
+#endif
+
+#if defined(CONFIG_BT_NUS_STATS)
+static int cmd_stats(const struct shell *sh, size_t argc, char **argv)
+{
+	static const char *const counter_names[] = {
+		[NUS_STATS_UART_RX_BYTES] = "UART RX bytes",
+		[NUS_STATS_UART_TX_BYTES] = "UART TX bytes",
+		[NUS_STATS_BLE_TX_BYTES] = "BLE TX bytes",
+		[NUS_STATS_BLE_RX_BYTES] = "BLE RX bytes",
+		[NUS_STATS_UART_RX_ALLOC_FAILURES] = "UART RX allocation failures",
+		[NUS_STATS_UART_TX_ALLOC_FAILURES] = "UART TX allocation failures",
+		[NUS_STATS_BLE_TX_ERRORS] = "BLE TX errors",
+		[NUS_STATS_UART_RX_ERRORS] = "UART RX errors",
+		[NUS_STATS_BLE_TX_NOTIFICATIONS] = "BLE TX notifications",
+		[NUS_STATS_BLE_TX_CAPACITY] = "BLE TX capacity",
+		[NUS_STATS_BLE_TX_FLUSH_TIMEOUTS] = "BLE TX flush timeouts",
+		[NUS_STATS_BLE_TX_COPIES] = "BLE TX copies",
+		[NUS_STATS_BLE_TX_COPIED_BYTES] = "BLE TX copied bytes",
+		[NUS_STATS_LOST_BYTES] = "Lost bytes",
+		[NUS_STATS_UART_RX_PAUSES] = "UART RX pauses",
+	};
+	struct nus_stats stats;
+
+	if ((argc > 1) && !strcmp(argv[1], "reset")) {
+		nus_stats_reset();
+		return 0;
+	}
+
+	nus_stats_get(&stats);
+
+	for (size_t i = 0; i < ARRAY_SIZE(counter_names); i++) {
+		shell_print(sh, "%-28s %u", counter_names[i],
+			    sys_le32_to_cpu(stats.counters[i]));
+	}
 
-		k_free(buf);
+	shell_print(sh, "%-28s %u", "UART RX queue high-water",
+		    sys_le16_to_cpu(stats.queue_max[NUS_STATS_QUEUE_UART_RX]));
+	shell_print(sh, "%-28s %u", "UART TX queue high-water",
+		    sys_le16_to_cpu(stats.queue_max[NUS_STATS_QUEUE_UART_TX]));
+	shell_print(sh, "%-28s %u", "UART RX buffers high-water",
+		    sys_le16_to_cpu(stats.pool_max[NUS_STATS_POOL_UART_RX]));
+	shell_print(sh, "%-28s %u", "UART TX buffers high-water",
+		    sys_le16_to_cpu(stats.pool_max[NUS_STATS_POOL_UART_TX]));
+
+	shell_print(sh, "UART to BLE latency:");
+	for (size_t i = 0; i < ARRAY_SIZE(stats.latency); i++) {
+		uint32_t count = sys_le32_to_cpu(stats.latency[i]);
+
+		if (i == 0) {
+			shell_print(sh, "  %8s ms %u", "< 1", count);
+		} else if (i == (ARRAY_SIZE(stats.latency) - 1)) {
+			shell_print(sh, "  %5u... ms %u", (uint32_t)BIT(i - 1),
+				    count);
+		} else {
+			shell_print(sh, "  %3u-%4u ms %u", (uint32_t)BIT(i - 1),
+				    (uint32_t)BIT(i) - 1, count);
+		}
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(stats.conns); i++) {
+		struct nus_stats_conn *nc = &stats.conns[i];
+		uint32_t count = sys_le32_to_cpu(nc->notifications);
+
+		shell_print(sh, "Conn %zu: TX %u bytes, RX %u bytes, %u notifications, "
+			    "latency %u ms average, %u ms max", i,
+			    sys_le32_to_cpu(nc->tx_bytes),
+			    sys_le32_to_cpu(nc->rx_bytes), count,
+			    count ? (sys_le32_to_cpu(nc->latency_sum) / count) : 0,
+			    sys_le32_to_cpu(nc->latency_max));
 	}
+
+	return 0;
 }
+#endif
+
+SHELL_STATIC_SUBCMD_SET_CREATE(nus_cmds,
+	SHELL_CMD_ARG(throughput, NULL, "Send <bytes> through the bridge",
+		      cmd_throughput, 2, 0),
+#if defined(CONFIG_BT_NUS_CONN_PROFILE)
+	SHELL_CMD_ARG(profile, NULL,
+		      "Show or set the profile: throughput, low_power, auto",
+		      cmd_profile, 1, 1),
+#endif
+#if defined(CONFIG_BT_NUS_STATS)
+	SHELL_CMD_ARG(stats, NULL, "Show the statistics, or reset them",
+		      cmd_stats, 1, 1),
+#endif
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(nus, &nus_cmds, "UART bridge commands", NULL);
+#endif /* CONFIG_BT_NUS_SHELL */
 
 K_THREAD_DEFINE(ble_write_thread_id, STACKSIZE, ble_write_thread, NULL, NULL,
 		NULL, PRIORITY, 0, 0);
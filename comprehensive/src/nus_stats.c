@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/** @file
+ *  @brief UART bridge statistics implementation
+ */
+#include "nus_stats.h"
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/bluetooth/uuid.h>
+#include <zephyr/bluetooth/gatt.h>
+
+/* Counters of a connection, the totals of the connections are summed
+ * when read.
+ */
+struct conn_counters {
+	atomic_t tx_bytes;
+	atomic_t rx_bytes;
+	atomic_t notifications;
+	atomic_t latency_sum;
+	atomic_t latency_max;
+};
+
+static atomic_t counters[NUS_STATS_COUNTER_COUNT];
+static atomic_t queue_depth[NUS_STATS_QUEUE_COUNT];
+static atomic_t queue_max[NUS_STATS_QUEUE_COUNT];
+static atomic_t pool_used[NUS_STATS_POOL_COUNT];
+static atomic_t pool_max[NUS_STATS_POOL_COUNT];
+static atomic_t latency[NUS_STATS_LATENCY_BUCKETS];
+static struct conn_counters conns[NUS_STATS_CONN_COUNT];
+
+static void max_update(atomic_t *max, atomic_val_t value)
+{
+	if (value > atomic_get(max)) {
+		atomic_set(max, value);
+	}
+}
+
+void nus_stats_add(enum nus_stats_counter counter, uint32_t value)
+{
+	atomic_add(&counters[counter], value);
+}
+
+void nus_stats_queue_put(enum nus_stats_queue queue)
+{
+	max_update(&queue_max[queue], atomic_inc(&queue_depth[queue]) + 1);
+}
+
+void nus_stats_queue_get(enum nus_stats_queue queue)
+{
+	atomic_dec(&queue_depth[queue]);
+}
+
+void nus_stats_pool_alloc(enum nus_stats_pool pool)
+{
+	max_update(&pool_max[pool], atomic_inc(&pool_used[pool]) + 1);
+}
+
+void nus_stats_pool_free(enum nus_stats_pool pool)
+{
+	atomic_dec(&pool_used[pool]);
+}
+
+void nus_stats_notified(uint8_t conn, uint16_t len, uint16_t mtu,
+			uint32_t ms)
+{
+	struct conn_counters *cc = &conns[conn];
+	/* Bucket of the highest bit set */
+	size_t bucket = ms ? (32 - __builtin_clz(ms)) : 0;
+
+	atomic_inc(&latency[MIN(bucket, NUS_STATS_LATENCY_BUCKETS - 1)]);
+	atomic_add(&counters[NUS_STATS_BLE_TX_CAPACITY], mtu);
+
+	atomic_inc(&cc->notifications);
+	atomic_add(&cc->tx_bytes, len);
+	atomic_add(&cc->latency_sum, ms);
+	max_update(&cc->latency_max, ms);
+}
+
+void nus_stats_written(uint8_t conn, uint16_t len)
+{
+	atomic_add(&conns[conn].rx_bytes, len);
+}
+
+void nus_stats_get(struct nus_stats *stats)
+{
+	uint32_t tx_bytes = 0;
+	uint32_t rx_bytes = 0;
+	uint32_t notifications = 0;
+
+	for (size_t i = 0; i < ARRAY_SIZE(conns); i++) {
+		struct nus_stats_conn *conn = &stats->conns[i];
+		uint32_t tx = atomic_get(&conns[i].tx_bytes);
+		uint32_t rx = atomic_get(&conns[i].rx_bytes);
+		uint32_t count = atomic_get(&conns[i].notifications);
+
+		conn->tx_bytes = sys_cpu_to_le32(tx);
+		conn->rx_bytes = sys_cpu_to_le32(rx);
+		conn->notifications = sys_cpu_to_le32(count);
+		conn->latency_sum =
+			sys_cpu_to_le32(atomic_get(&conns[i].latency_sum));
+		conn->latency_max =
+			sys_cpu_to_le32(atomic_get(&conns[i].latency_max));
+
+		tx_bytes += tx;
+		rx_bytes += rx;
+		notifications += count;
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(counters); i++) {
+		stats->counters[i] = sys_cpu_to_le32(atomic_get(&counters[i]));
+	}
+
+	stats->counters[NUS_STATS_BLE_TX_BYTES] = sys_cpu_to_le32(tx_bytes);
+	stats->counters[NUS_STATS_BLE_RX_BYTES] = sys_cpu_to_le32(rx_bytes);
+	stats->counters[NUS_STATS_BLE_TX_NOTIFICATIONS] =
+		sys_cpu_to_le32(notifications);
+
+	for (size_t i = 0; i < ARRAY_SIZE(queue_max); i++) {
+		stats->queue_max[i] = sys_cpu_to_le16(atomic_get(&queue_max[i]));
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(pool_max); i++) {
+		stats->pool_max[i] = sys_cpu_to_le16(atomic_get(&pool_max[i]));
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(latency); i++) {
+		stats->latency[i] = sys_cpu_to_le32(atomic_get(&latency[i]));
+	}
+}
+
+void nus_stats_reset(void)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(counters); i++) {
+		atomic_clear(&counters[i]);
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(queue_max); i++) {
+		atomic_set(&queue_max[i], atomic_get(&queue_depth[i]));
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(pool_max); i++) {
+		atomic_set(&pool_max[i], atomic_get(&pool_used[i]));
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(latency); i++) {
+		atomic_clear(&latency[i]);
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(conns); i++) {
+		atomic_clear(&conns[i].tx_bytes);
+		atomic_clear(&conns[i].rx_bytes);
+		atomic_clear(&conns[i].notifications);
+		atomic_clear(&conns[i].latency_sum);
+		atomic_clear(&conns[i].latency_max);
+	}
+}
+
+static ssize_t read_stats(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+			  void *buf, uint16_t len, uint16_t offset)
+{
+	struct nus_stats stats;
+
+	nus_stats_get(&stats);
+
+	return bt_gatt_attr_read(conn, attr, buf, len, offset, &stats,
+				 sizeof(stats));
+}
+
+/* Any write clears the statistics, only on an encrypted link */
+static ssize_t write_stats(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+			   const void *buf, uint16_t len, uint16_t offset,
+			   uint8_t flags)
+{
+	nus_stats_reset();
+
+	return len;
+}
+
+BT_GATT_SERVICE_DEFINE(nus_stats_svc,
+	BT_GATT_PRIMARY_SERVICE(BT_UUID_DECLARE_128(BT_UUID_NUS_STATS_SRV_VAL)),
+	BT_GATT_CHARACTERISTIC(BT_UUID_DECLARE_128(BT_UUID_NUS_STATS_VAL),
+			       BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE,
+			       BT_GATT_PERM_READ | BT_GATT_PERM_WRITE_ENCRYPT,
+			       read_stats, write_stats, NULL),
+);
@@ -0,0 +1,218 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/** @file
+ *  @brief UART bridge statistics
+ */
+
+/**
+ * @brief Runtime statistics of the UART bridge
+ * @defgroup nus_stats UART bridge statistics
+ * @{
+ *
+ * Counters of the data in each direction, of the failures and of lost
+ * data, the high-water marks of the UART queues and buffers, a histogram
+ * of the latency from UART reception to notification and the data of
+ * each connection. They are read with the nus stats shell command and
+ * from the statistics GATT characteristic, and logged every second.
+ *
+ * Without CONFIG_BT_NUS_STATS, the functions are empty.
+ */
+
+#include <stdint.h>
+#include <zephyr/toolchain.h>
+
+/** @brief UUID of the statistics service */
+#define BT_UUID_NUS_STATS_SRV_VAL \
+	BT_UUID_128_ENCODE(0x6e400010, 0xb5a3, 0xf393, 0xe0a9, 0xe50e24dcca9e)
+
+/** @brief UUID of the statistics characteristic */
+#define BT_UUID_NUS_STATS_VAL \
+	BT_UUID_128_ENCODE(0x6e400011, 0xb5a3, 0xf393, 0xe0a9, 0xe50e24dcca9e)
+
+/** @brief Counters */
+enum nus_stats_counter {
+	/** Bytes received on UART */
+	NUS_STATS_UART_RX_BYTES,
+	/** Bytes sent on UART */
+	NUS_STATS_UART_TX_BYTES,
+	/** Bytes notified to the connections, sum of the connections */
+	NUS_STATS_BLE_TX_BYTES,
+	/** Bytes written by the connections, sum of the connections */
+	NUS_STATS_BLE_RX_BYTES,
+	/** UART RX buffers which could not be allocated */
+	NUS_STATS_UART_RX_ALLOC_FAILURES,
+	/** UART TX buffers which could not be allocated */
+	NUS_STATS_UART_TX_ALLOC_FAILURES,
+	/** Notifications which bt_nus_send() failed to send */
+	NUS_STATS_BLE_TX_ERRORS,
+	/** UART RX stopped on an error */
+	NUS_STATS_UART_RX_ERRORS,
+	/** Notifications sent, sum of the connections */
+	NUS_STATS_BLE_TX_NOTIFICATIONS,
+	/** ATT payload size of the sent notifications */
+	NUS_STATS_BLE_TX_CAPACITY,
+	/** Partial notifications sent when the flush time expired */
+	NUS_STATS_BLE_TX_FLUSH_TIMEOUTS,
+	/** Notifications copied from several UART RX buffers */
+	NUS_STATS_BLE_TX_COPIES,
+	/** Bytes of the copied notifications */
+	NUS_STATS_BLE_TX_COPIED_BYTES,
+	/** Bytes received on UART which were not notified */
+	NUS_STATS_LOST_BYTES,
+	/** UART RX disabled until a buffer is free */
+	NUS_STATS_UART_RX_PAUSES,
+
+	NUS_STATS_COUNTER_COUNT
+};
+
+/** @brief Queues of UART buffers */
+enum nus_stats_queue {
+	/** Data received on UART, to notify */
+	NUS_STATS_QUEUE_UART_RX,
+	/** Data received from the connections, to send on UART */
+	NUS_STATS_QUEUE_UART_TX,
+
+	NUS_STATS_QUEUE_COUNT
+};
+
+/** @brief Pools of UART buffers */
+enum nus_stats_pool {
+	/** Buffers receiving on UART, and their slices */
+	NUS_STATS_POOL_UART_RX,
+	/** Buffers sending on UART */
+	NUS_STATS_POOL_UART_TX,
+
+	NUS_STATS_POOL_COUNT
+};
+
+/** @brief Connections with statistics */
+#define NUS_STATS_CONN_COUNT CONFIG_BT_MAX_CONN
+
+/** @brief Statistics of a connection, by its index in the bridge */
+struct nus_stats_conn {
+	/** Bytes notified */
+	uint32_t tx_bytes;
+	/** Bytes written */
+	uint32_t rx_bytes;
+	/** Notifications sent */
+	uint32_t notifications;
+	/** Sum of the latency of the notifications in ms */
+	uint32_t latency_sum;
+	/** Highest latency of a notification in ms */
+	uint32_t latency_max;
+} __packed;
+
+/** @brief Latency histogram buckets, bucket n from 2^(n-1) to 2^n ms */
+#define NUS_STATS_LATENCY_BUCKETS 8
+
+/**
+ * @brief Statistics since the last reset
+ *
+ * This is also the value of the statistics characteristic, in little
+ * endian.
+ */
+struct nus_stats {
+	/** Counters, indexed by @ref nus_stats_counter */
+	uint32_t counters[NUS_STATS_COUNTER_COUNT];
+	/** High-water marks, indexed by @ref nus_stats_queue */
+	uint16_t queue_max[NUS_STATS_QUEUE_COUNT];
+	/** Most buffers used, indexed by @ref nus_stats_pool */
+	uint16_t pool_max[NUS_STATS_POOL_COUNT];
+	/** Notifications by latency: below 1 ms, 1 ms, 2 to 3 ms, 4 to 7 ms,
+	 *  up to 64 ms and more.
+	 */
+	uint32_t latency[NUS_STATS_LATENCY_BUCKETS];
+	/** Connections */
+	struct nus_stats_conn conns[NUS_STATS_CONN_COUNT];
+} __packed;
+
+#if defined(CONFIG_BT_NUS_STATS)
+
+/**
+ * @brief Add to a counter
+ *
+ * @param counter Counter
+ * @param value   Value to add
+ */
+void nus_stats_add(enum nus_stats_counter counter, uint32_t value);
+
+/**
+ * @brief Account a buffer put to a queue
+ *
+ * @param queue Queue
+ */
+void nus_stats_queue_put(enum nus_stats_queue queue);
+
+/**
+ * @brief Account a buffer taken from a queue
+ *
+ * @param queue Queue
+ */
+void nus_stats_queue_get(enum nus_stats_queue queue);
+
+/**
+ * @brief Account a buffer allocated from a pool
+ *
+ * @param pool Pool
+ */
+void nus_stats_pool_alloc(enum nus_stats_pool pool);
+
+/**
+ * @brief Account a buffer freed to a pool
+ *
+ * @param pool Pool
+ */
+void nus_stats_pool_free(enum nus_stats_pool pool);
+
+/**
+ * @brief Account a notification sent to a connection
+ *
+ * @param conn Index of the connection
+ * @param len  Bytes notified
+ * @param mtu  ATT payload size of the connection
+ * @param ms   Time from UART reception to the notification
+ */
+void nus_stats_notified(uint8_t conn, uint16_t len, uint16_t mtu,
+			uint32_t ms);
+
+/**
+ * @brief Account data written by a connection
+ *
+ * @param conn Index of the connection
+ * @param len  Bytes written
+ */
+void nus_stats_written(uint8_t conn, uint16_t len);
+
+/**
+ * @brief Get the statistics
+ *
+ * @param stats Statistics since the last reset
+ */
+void nus_stats_get(struct nus_stats *stats);
+
+/**
+ * @brief Clear the statistics
+ *
+ * The high-water marks restart from the current queue depths and
+ * buffers used.
+ */
+void nus_stats_reset(void);
+
+#else
+
+static inline void nus_stats_add(enum nus_stats_counter counter, uint32_t value) {}
+static inline void nus_stats_queue_put(enum nus_stats_queue queue) {}
+static inline void nus_stats_queue_get(enum nus_stats_queue queue) {}
+static inline void nus_stats_pool_alloc(enum nus_stats_pool pool) {}
+static inline void nus_stats_pool_free(enum nus_stats_pool pool) {}
+static inline void nus_stats_notified(uint8_t conn, uint16_t len, uint16_t mtu,
+				      uint32_t ms) {}
+static inline void nus_stats_written(uint8_t conn, uint16_t len) {}
+
+#endif /* CONFIG_BT_NUS_STATS */
+
+/** @} */
@@ -10,6 +10,7 @@
 #include "uart_async_adapter.h"
 #include <zephyr/drivers/uart.h>
 #include <zephyr/sys/__assert.h>
+#include <string.h>
 
 #include <zephyr/logging/log.h>
 LOG_MODULE_REGISTER(uart_async_adapter);
@@ -23,6 +24,9 @@ LOG_MODULE_REGISTER(uart_async_adapter);
 #error "The adapter requires UART INTERRUPT API to be enabled"
 #endif
 
+/* Bytes read at once from the RX FIFO when there is no buffer */
+#define RX_DROP_CHUNK 16
+
 
 /**
  * @brief Access the data inside device
@@ -377,8 +381,31 @@ static int drv_cmd(const struct device *dev, uint32_t cmd, uint32_t p)
 
 #endif /* CONFIG_UART_DRV_CMD */
 
+/**
+ * @brief Account the cycles and bytes of an interrupt to the statistics
+ *
+ * @param cycles Cycles counter to update
+ * @param bytes  Bytes counter to update
+ * @param start  Cycle count at the start of the interrupt
+ * @param len    Number of bytes transferred
+ */
+static inline void stats_add(uint32_t *cycles, uint32_t *bytes, uint32_t start, size_t len)
+{
+	if (IS_ENABLED(CONFIG_BT_NUS_UART_ASYNC_ADAPTER_STATS)) {
+		*cycles += k_cycle_get_32() - start;
+		*bytes += len;
+	}
+}
+
+static inline uint32_t stats_start(void)
+{
+	return IS_ENABLED(CONFIG_BT_NUS_UART_ASYNC_ADAPTER_STATS) ? k_cycle_get_32() : 0;
+}
+
 static inline void on_tx_ready(const struct device *dev, struct uart_async_adapter_data *data)
 {
+	uint32_t start = stats_start();
+	size_t sent = 0;
 	k_spinlock_key_t key = k_spin_lock(&(data->lock));
 
 	LOG_DBG("%s: Enter(%s) (left: %u)", __func__, dev->name, data->tx.size_left);
@@ -386,16 +413,24 @@ static inline void on_tx_ready(const struct device *dev, struct uart_async_adapt
 		__ASSERT_NO_MSG(data->tx.curr_buf);
 		int ret;
 
-		ret = uart_fifo_fill(data->target, data->tx.curr_buf, data->tx.size_left);
-		LOG_DBG("Pushed %d characters", ret);
-		if (ret <= 0) {
+		/* Fill the FIFO until it is full or the buffer is sent */
+		do {
+			ret = uart_fifo_fill(data->target, data->tx.curr_buf, data->tx.size_left);
+			if (ret > 0) {
+				data->tx.curr_buf += ret;
+				data->tx.size_left -= ret;
+				sent += ret;
+			}
+		} while ((ret > 0) && data->tx.size_left);
+
+		LOG_DBG("Pushed %d characters", sent);
+		if (!sent) {
 			LOG_ERR("Unexpected fifo fill err: %d", ret);
-		} else {
-			data->tx.curr_buf += ret;
-			data->tx.size_left -= ret;
 		}
 	}
 
+	stats_add(&data->stats.tx_cycles, &data->stats.tx_bytes, start, sent);
+
 	k_spin_unlock(&(data->lock), key);
 
 	LOG_DBG("%s: Exit", __func__);
@@ -437,15 +472,33 @@ static inline void on_tx_complete(const struct device *dev, struct uart_async_ad
 	LOG_DBG("%s: Exit", __func__);
 }
 
+/**
+ * @brief Arm the RX timeout at the end of a burst
+ *
+ * The timer is started once per idle gap. When it expires, it is restarted
+ * for the rest of the timeout if data was received meanwhile.
+ *
+ * @param data Adapter data, locked by the caller
+ */
+static inline void rx_timeout_arm(struct uart_async_adapter_data *data)
+{
+	data->rx.last_rx = k_uptime_ticks();
+
+	if (!data->rx.timer_running) {
+		data->rx.timer_running = true;
+		k_timer_start(&data->rx.timeout_timer, SYS_TIMEOUT_MS(data->rx.timeout),
+			      K_NO_WAIT);
+	}
+}
+
 static inline void on_rx_ready(const struct device *dev, struct uart_async_adapter_data *data)
 {
 	int ret;
 	bool notify_now = false;
+	size_t received = 0;
+	uint32_t start = stats_start();
 
 	LOG_DBG("%s: Enter (%s)", __func__, dev->name);
-	if (data->rx.timeout != SYS_FOREVER_MS) {
-		k_timer_start(&data->rx.timeout_timer, SYS_TIMEOUT_MS(data->rx.timeout), K_NO_WAIT);
-	}
 	do {
 		k_spinlock_key_t key = k_spin_lock(&(data->lock));
 
@@ -461,11 +514,11 @@ static inline void on_rx_ready(const struct device *dev, struct uart_async_adapt
 		}
 		if (!data->rx.size_left) {
 			/* Data received without buffer - dropping */
-			uint8_t dummy;
+			uint8_t dummy[RX_DROP_CHUNK];
 			size_t cnt = 0;
 
 			do {
-				ret = uart_fifo_read(data->target, &dummy, 1);
+				ret = uart_fifo_read(data->target, dummy, sizeof(dummy));
 				if (ret < 0) {
 					LOG_ERR("Unexpected error on FIFO dropping: %d", ret);
 					ret = 0;
@@ -474,6 +527,7 @@ static inline void on_rx_ready(const struct device *dev, struct uart_async_adapt
 			} while (ret);
 			LOG_ERR("Data received without buffer prepared, dropped %d bytes", cnt);
 		} else {
+			/* Drain the FIFO into the buffer in one burst */
 			ret = uart_fifo_read(data->target, data->rx.curr_buf, data->rx.size_left);
 			LOG_DBG("Received %d characters", ret);
 			if (ret < 0) {
@@ -483,6 +537,7 @@ static inline void on_rx_ready(const struct device *dev, struct uart_async_adapt
 			__ASSERT_NO_MSG(data->rx.size_left >= ret);
 			data->rx.curr_buf += ret;
 			data->rx.size_left -= ret;
+			received += ret;
 			if (data->rx.timeout == 0) {
 				notify_now = true;
 			}
@@ -491,6 +546,16 @@ static inline void on_rx_ready(const struct device *dev, struct uart_async_adapt
 		k_spin_unlock(&(data->lock), key);
 
 	} while (ret);
+
+	k_spinlock_key_t key = k_spin_lock(&(data->lock));
+
+	if (received && (data->rx.timeout != SYS_FOREVER_MS)) {
+		rx_timeout_arm(data);
+	}
+	stats_add(&data->stats.rx_cycles, &data->stats.rx_bytes, start, received);
+
+	k_spin_unlock(&(data->lock), key);
+
 	if (notify_now) {
 		notify_rx_buffer(dev);
 	}
@@ -581,8 +646,26 @@ static void tx_timeout(struct k_timer *timer)
 static void rx_timeout(struct k_timer *timer)
 {
 	const struct device *dev = k_timer_user_data_get(timer);
+	struct uart_async_adapter_data *data = access_dev_data(dev);
+
+	k_spinlock_key_t key = k_spin_lock(&(data->lock));
+
+	k_ticks_t idle = k_uptime_ticks() - data->rx.last_rx;
+	k_ticks_t timeout = k_ms_to_ticks_ceil64(data->rx.timeout);
+	bool expired = (idle >= timeout);
+
+	if (expired) {
+		data->rx.timer_running = false;
+	} else {
+		/* Data was received since the timer was started */
+		k_timer_start(&data->rx.timeout_timer, K_TICKS(timeout - idle), K_NO_WAIT);
+	}
 
-	notify_rx_buffer(dev);
+	k_spin_unlock(&(data->lock), key);
+
+	if (expired) {
+		notify_rx_buffer(dev);
+	}
 }
 
 void uart_async_adapter_init(const struct device *dev, const struct device *target)
@@ -604,3 +687,15 @@ void uart_async_adapter_init(const struct device *dev, const struct device *targ
 
 	dev->state->initialized = true;
 }
+
+void uart_async_adapter_stats_get(const struct device *dev, struct uart_async_adapter_stats *stats)
+{
+	struct uart_async_adapter_data *data = access_dev_data(dev);
+
+	k_spinlock_key_t key = k_spin_lock(&(data->lock));
+
+	*stats = data->stats;
+	memset(&data->stats, 0, sizeof(data->stats));
+
+	k_spin_unlock(&(data->lock), key);
+}
@@ -0,0 +1,104 @@
+/* Serial DFU of nrf91 on a PC: the DFU file is loaded into the stub bank
+ * and sent to a bootloader on a tty, e.g. the pty of dfu_bl_sim.py.
+ *
+ * Usage: dfu_host_sim <tty> <dfu file> [attempts] [crc us per KB]
+ *
+ * A failed DFU is started again like a user would, up to the attempts,
+ * the transfer resumes from the progress of the bootloader. It stops when
+ * the bootloader doesn't respond any more, dfu_bl_sim.py exits after the
+ * number of --sessions. crc32 may be slowed down to the speed of the
+ * target, so the time to resume is close to it.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <zephyr.h>
+#include <device.h>
+#include <logging/log.h>
+
+#include "crc32.h"
+#include "dfu_host.h"
+#include "serial_dfu.h"
+#include "stub_flash.h"
+
+#define ATTEMPTS_DEFAULT		5
+#define BL_WAIT_TIMEOUT			3000		// in milliseconds, > --reset-time of dfu_bl_sim.py
+
+static u32_t m_crc_us_per_kb;
+static u64_t m_crc_bytes;
+
+uint32_t __real_crc32_compute(uint8_t const * p_data, uint32_t size, uint32_t const * p_crc);
+
+/**@brief crc32_compute() which counts the bytes, and takes as long as on target */
+uint32_t __wrap_crc32_compute(uint8_t const * p_data, uint32_t size, uint32_t const * p_crc)
+{
+	static u64_t delay_us;
+
+	m_crc_bytes += size;
+
+	delay_us += (u64_t)size * m_crc_us_per_kb / 1024;
+	if (delay_us >= 1000) {
+		k_sleep(delay_us / 1000);
+		delay_us %= 1000;
+	}
+
+	return __real_crc32_compute(p_data, size, p_crc);
+}
+
+int main(int argc, char* argv[])
+{
+	int rc;
+	int attempts = ATTEMPTS_DEFAULT;
+	u32_t start_time;
+	struct device uart;
+
+	if (argc < 3) {
+		printf("Usage: %s <tty> <dfu file> [attempts] [crc us per KB]\n", argv[0]);
+		return 2;
+	}
+	if (argc > 3) {
+		attempts = atoi(argv[3]);
+	}
+	if (argc > 4) {
+		m_crc_us_per_kb = atoi(argv[4]);
+	}
+
+	rc = stub_flash_init();
+	if (rc) {
+		printf("Flash bank can't be mapped: %d\n", rc);
+		return 1;
+	}
+
+	rc = stub_flash_load(argv[2]);
+	if (rc <= 0) {
+		printf("DFU file can't be loaded: %s\n", argv[2]);
+		return 1;
+	}
+	printf("DFU file: %s, %d bytes\n", argv[2], rc);
+
+	uart.name = argv[1];
+	rc = serial_dfu_init(&uart);
+	if (rc) {
+		printf("Serial DFU init error: %d\n", rc);
+		return 1;
+	}
+
+	for (int i = 1; i <= attempts; i++) {
+		if (!dfu_host_bl_mode_wait(BL_WAIT_TIMEOUT)) {
+			printf("No bootloader, stop\n");
+			break;
+		}
+
+		m_crc_bytes = 0;
+		start_time = k_uptime_get_32();
+
+		printf("---- Attempt %d at %u ms ----\n", i, start_time);
+		serial_dfu_start();
+
+		printf("Attempt %d: %u ms, crc32 of %llu bytes\n", i,
+			k_uptime_get_32() - start_time, (unsigned long long)m_crc_bytes);
+	}
+
+	serial_dfu_uninit();
+
+	return 0;
+}
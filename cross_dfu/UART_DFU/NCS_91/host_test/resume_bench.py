@@ -0,0 +1,73 @@
+"""
+Description: Measure the time the nrf91 DFU host takes to resume a transfer
+
+dfu_bl_sim.py is reset when the firmware offset reaches 90% of an image, and
+keeps its progress (NRF_DFU_SAVE_PROGRESS_IN_FLASH). The host starts the DFU
+again and resumes from the offset reported by the bootloader. It's measured
+with the CRC checkpoints (dfu_host_sim) and without them (dfu_host_sim_no_cache).
+crc32_compute() is slowed down to --crc-us per KB, the rest of the host runs at
+PC speed.
+
+Usage: python resume_bench.py --build build --sim ../../SDK_52/scripts/dfu_bl_sim.py
+"""
+import argparse
+import os
+import re
+import sys
+
+import sim_test
+
+
+def resume_time(host_out):
+    """ Offset and time from the start of the resumed attempt to the first new data """
+    start = None
+    for line in host_out.splitlines():
+        match = re.match(r'---- Attempt (\d+) at (\d+) ms ----', line)
+        if match:
+            start = int(match.group(2))
+            continue
+        match = re.match(r'\[(\d+)\] <inf> dfu_req: Resume at (\d+), took (\d+) ms', line)
+        if match and start is not None:
+            return int(match.group(2)), int(match.group(1)) - start
+
+    return None
+
+
+def run(args):
+    rows = []
+    for fw_size in args.fw_size:
+        reset_at = fw_size * 9 // 10
+        for name, host in (('yes', 'dfu_host_sim'), ('no', 'dfu_host_sim_no_cache')):
+            test_args = argparse.Namespace(host=os.path.join(args.build, host), sim=args.sim, file=None,
+                                           fw_size=fw_size, seed=0, attempts=3, crc_us=args.crc_us,
+                                           expect_resume=True, timeout=600.0)
+            sim_args = ['--save-progress', '--reset-at', str(reset_at), '--reset-time', '0.5']
+            result, host_out = sim_test.run(test_args, sim_args, verbose=False)
+            measure = resume_time(host_out)
+            if result or measure is None:
+                print(host_out)
+                print('FAIL: {} bytes, {}'.format(fw_size, name))
+                return 1
+            rows.append((fw_size, name) + measure)
+
+    print()
+    print('| Image size | CRC checkpoints | Resumed at | Time to resume |')
+    print('| ---------- | --------------- | ---------- | -------------- |')
+    for fw_size, name, offset, time_ms in rows:
+        print('| {:<10} | {:<15} | {:<10} | {:<14} |'.format(fw_size, name, offset, '{} ms'.format(time_ms)))
+
+    return 0
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Measure the time to resume serial DFU')
+    parser.add_argument('--build', required=True, help='build directory of the host build')
+    parser.add_argument('--sim', required=True, help='dfu_bl_sim.py')
+    parser.add_argument('--fw-size', type=int, action='append',
+                        help='application size, can be repeated, default: 100000 and 400000')
+    parser.add_argument('--crc-us', type=int, default=640,
+                        help='crc32_compute() time of 1 KB, the default is the estimate of dfu_bl_sim.py')
+
+    args = parser.parse_args()
+    args.fw_size = args.fw_size or [100000, 400000]
+    sys.exit(run(args))
@@ -0,0 +1,198 @@
+"""
+Description: Run the nrf91 DFU host of the host build against dfu_bl_sim.py
+
+The simulator opens a pty and the host sends a DFU file to it. The images
+received by the simulator must match the firmware of the DFU file. A DFU file
+with an application of random data can be made, the data has many SLIP
+special characters.
+
+Usage: python sim_test.py --host build/dfu_host_sim --sim dfu_bl_sim.py --fw-size 100000 -- --reset-at 0x8000
+"""
+import argparse
+import hashlib
+import os
+import random
+import re
+import subprocess
+import sys
+import tempfile
+import threading
+import zlib
+
+
+MAGIC_NUMBER_MCUBOOT = 0x96F3B83D
+MAGIC_NUMBER_SDK_DFU = 0x49535951
+FILE_HEADER_SIZE = 128
+INIT_PACKET_SIZE_MAX = 512
+DFU_IMAGE_APPLICATION = 0
+
+
+def get_le32(number: int):
+    return number.to_bytes(4, 'little')
+
+
+def pb_varint(value):
+    out = bytearray()
+    while True:
+        b = value & 0x7F
+        value >>= 7
+        if value:
+            out.append(b | 0x80)
+        else:
+            out.append(b)
+            return bytes(out)
+
+
+def pb_field(field, value):
+    """ Varint for int, length-delimited for bytes """
+    if isinstance(value, int):
+        return pb_varint(field << 3) + pb_varint(value)
+    return pb_varint(field << 3 | 2) + pb_varint(len(value)) + value
+
+
+def make_init_packet(fw):
+    """ Unsigned init packet of an application, see dfu-cc.proto """
+    fw_hash = pb_field(1, 3) + pb_field(2, hashlib.sha256(fw).digest()[::-1])
+    init = pb_field(3, 0) + pb_field(4, 0) + pb_field(5, 0) + pb_field(6, 0) + pb_field(7, len(fw))
+    init += pb_field(8, fw_hash)
+    command = pb_field(1, 1) + pb_field(2, init)
+    return pb_field(1, command)
+
+
+def make_dfu_file(fw, path):
+    """ Same layout as dfu_zip_to_bin.py with one application image """
+    ip = make_init_packet(fw)
+    ip_addr = FILE_HEADER_SIZE
+    fw_addr = ip_addr + INIT_PACKET_SIZE_MAX
+    padding = (4 - len(fw) % 4) % 4
+    file_size = fw_addr + len(fw) + padding + 4
+
+    data = bytearray()
+    data += get_le32(MAGIC_NUMBER_MCUBOOT) + get_le32(MAGIC_NUMBER_SDK_DFU)
+    data += get_le32(file_size) + get_le32(1)
+    data += get_le32(DFU_IMAGE_APPLICATION) + get_le32(ip_addr) + get_le32(len(ip))
+    data += get_le32(fw_addr) + get_le32(len(fw)) + get_le32(zlib.crc32(fw))
+    data += b'\xFF' * (FILE_HEADER_SIZE - len(data))
+    data += ip + b'\xFF' * (INIT_PACKET_SIZE_MAX - len(ip))
+    data += fw + b'\xFF' * padding
+    data += get_le32(zlib.crc32(data))
+
+    with open(path, 'wb') as f:
+        f.write(data)
+
+
+def read_images(path):
+    """ Firmware of each image in the DFU file, in the order of sending """
+    with open(path, 'rb') as f:
+        data = f.read()
+    count = int.from_bytes(data[12:16], 'little')
+    images = []
+    for i in range(count):
+        entry = data[16 + i * 24:40 + i * 24]
+        fw_addr = int.from_bytes(entry[12:16], 'little')
+        fw_size = int.from_bytes(entry[16:20], 'little')
+        images.append(data[fw_addr:fw_addr + fw_size])
+    return images
+
+
+def collect(stream, lines):
+    for line in stream:
+        lines.append(line)
+
+
+def run(args, sim_args, verbose=True):
+    """ Return the result and the output of the host """
+    work_dir = tempfile.mkdtemp(prefix='dfu_sim_')
+    dfu_file = args.file
+
+    if dfu_file is None:
+        rand = random.Random(args.seed)
+        fw = bytes(rand.choice((0xC0, 0xDB, rand.randrange(256))) for _ in range(args.fw_size))
+        dfu_file = os.path.join(work_dir, 'dfu_file.bin')
+        make_dfu_file(fw, dfu_file)
+
+    images = read_images(dfu_file)
+
+    sim_cmd = [sys.executable, '-u', args.sim, 'pty', '--sessions', str(len(images)), '--out-dir', work_dir,
+               '--erase-ms', '1', '--write-us', '0', '--hash-us', '0', '--activate-time', '0.2'] + sim_args
+    sim = subprocess.Popen(sim_cmd, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, universal_newlines=True)
+
+    sim_lines = []
+    tty = None
+    for line in sim.stdout:
+        sim_lines.append(line)
+        match = re.match(r'Connect the DFU host to (\S+)', line)
+        if match:
+            tty = match.group(1)
+            break
+    if tty is None:
+        print(''.join(sim_lines))
+        print('FAIL: no pty from the simulator')
+        return 1, ''
+
+    sim_reader = threading.Thread(target=collect, args=(sim.stdout, sim_lines))
+    sim_reader.start()
+
+    host_cmd = [args.host, tty, dfu_file, str(args.attempts), str(args.crc_us)]
+    try:
+        host = subprocess.run(host_cmd, stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+                              universal_newlines=True, timeout=args.timeout)
+        host_out = host.stdout
+    except subprocess.TimeoutExpired as e:
+        host_out = (e.stdout or b'').decode(errors='replace') + '\nHost timeout\n'
+
+    try:
+        sim.wait(timeout=5)
+    except subprocess.TimeoutExpired:
+        sim.kill()
+        sim.wait()
+    sim_reader.join()
+
+    if verbose:
+        print('==== Host ====')
+        print(host_out)
+        print('==== Simulator ====')
+        print(''.join(sim_lines))
+
+    result = 0
+    for i, fw in enumerate(images, 1):
+        path = os.path.join(work_dir, 'image_{}.bin'.format(i))
+        if not os.path.exists(path):
+            print('FAIL: image {} is not received'.format(i))
+            result = 1
+            continue
+        with open(path, 'rb') as f:
+            if f.read() != fw:
+                print('FAIL: image {} is different'.format(i))
+                result = 1
+
+    if args.expect_resume and 'Resume at' not in host_out:
+        print('FAIL: the transfer is not resumed')
+        result = 1
+
+    if result == 0:
+        print('PASS: {} image(s), {}'.format(len(images), dfu_file))
+
+    return result, host_out
+
+
+if __name__ == '__main__':
+    argv = sys.argv[1:]
+    sim_args = []
+    if '--' in argv:
+        sim_args = argv[argv.index('--') + 1:]
+        argv = argv[:argv.index('--')]
+
+    parser = argparse.ArgumentParser(description='Run the DFU host against dfu_bl_sim.py, '
+                                                 'arguments after -- go to the simulator')
+    parser.add_argument('--host', required=True, help='dfu_host_sim of the host build')
+    parser.add_argument('--sim', required=True, help='dfu_bl_sim.py')
+    parser.add_argument('--file', help='DFU file to send')
+    parser.add_argument('--fw-size', type=int, default=20000, help='application size of a generated DFU file')
+    parser.add_argument('--seed', type=int, default=0, help='seed of the generated application')
+    parser.add_argument('--attempts', type=int, default=5, help='DFU is started again after a failure')
+    parser.add_argument('--crc-us', type=int, default=0, help='crc32_compute() time of 1 KB on the host, 0: host speed')
+    parser.add_argument('--expect-resume', action='store_true', help='fail unless the host resumes a transfer')
+    parser.add_argument('--timeout', type=float, default=120.0)
+
+    exit(run(parser.parse_args(argv), sim_args)[0])
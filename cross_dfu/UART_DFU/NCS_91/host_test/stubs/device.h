@@ -0,0 +1,9 @@
+#ifndef DEVICE_STUB_H__
+#define DEVICE_STUB_H__
+
+struct device
+{
+	const char* name;
+};
+
+#endif /* DEVICE_STUB_H__ */
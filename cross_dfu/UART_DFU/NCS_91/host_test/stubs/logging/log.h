@@ -0,0 +1,37 @@
+#ifndef LOGGING_LOG_STUB_H__
+#define LOGGING_LOG_STUB_H__
+
+#include <zephyr.h>
+
+#define LOG_LEVEL_ERR	1
+#define LOG_LEVEL_WRN	2
+#define LOG_LEVEL_INF	3
+#define LOG_LEVEL_DBG	4
+
+/* Messages above the level of the module or of the host are dropped */
+extern int log_stub_level;
+
+void log_stub_printf(const char* module, int level, const char* fmt, ...)
+	__attribute__((format(printf, 3, 4)));
+void log_stub_hexdump(const char* module, const void* data, size_t length,
+	const char* str);
+
+#define LOG_MODULE_REGISTER(name, level) \
+	static const char log_module_name[] = #name; \
+	static const int log_module_level = level
+
+#define LOG_STUB(level, ...) do { \
+	if (level <= log_module_level) { \
+		log_stub_printf(log_module_name, level, __VA_ARGS__); \
+	} \
+} while (0)
+
+#define LOG_ERR(...)	LOG_STUB(LOG_LEVEL_ERR, __VA_ARGS__)
+#define LOG_WRN(...)	LOG_STUB(LOG_LEVEL_WRN, __VA_ARGS__)
+#define LOG_INF(...)	LOG_STUB(LOG_LEVEL_INF, __VA_ARGS__)
+#define LOG_DBG(...)	LOG_STUB(LOG_LEVEL_DBG, __VA_ARGS__)
+
+#define LOG_HEXDUMP_INF(data, length, str) \
+	log_stub_hexdump(log_module_name, data, length, str)
+
+#endif /* LOGGING_LOG_STUB_H__ */
@@ -0,0 +1,23 @@
+#ifndef STORAGE_FLASH_MAP_STUB_H__
+#define STORAGE_FLASH_MAP_STUB_H__
+
+#include <sys/types.h>
+#include <zephyr.h>
+
+/* Only the DFU bank exists, fa_off is its address in the host memory */
+#define FLASH_AREA_ID(label)	FLASH_AREA_ID_##label
+#define FLASH_AREA_ID_image_1	3
+
+struct flash_area
+{
+	u8_t  fa_id;
+	u8_t  fa_device_id;
+	off_t fa_off;
+	size_t fa_size;
+};
+
+int flash_area_open(u8_t id, const struct flash_area** fa);
+void flash_area_close(const struct flash_area* fa);
+int flash_area_read(const struct flash_area* fa, off_t off, void* dst, size_t len);
+
+#endif /* STORAGE_FLASH_MAP_STUB_H__ */
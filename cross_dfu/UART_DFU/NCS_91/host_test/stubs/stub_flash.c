@@ -0,0 +1,137 @@
+/* DFU bank of the host build, it behaves like NOR flash: erased bytes are
+ * 0xFF and a write can only clear bits.
+ */
+#include <stdio.h>
+#include <sys/mman.h>
+#include <zephyr.h>
+#include <storage/flash_map.h>
+
+#include "app_flash.h"
+#include "stub_flash.h"
+
+static u8_t* m_bank;
+static u32_t m_erase_count;
+static u32_t m_write_count;
+
+static const struct flash_area m_bank_area = {
+	.fa_id = APP_FLASH_BANK_ID,
+	.fa_off = STUB_FLASH_ADDR,
+	.fa_size = STUB_FLASH_BANK_SIZE,
+};
+
+int stub_flash_init(void)
+{
+	if (!m_bank) {
+		m_bank = mmap((void*)STUB_FLASH_ADDR, STUB_FLASH_BANK_SIZE,
+			PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+		if (m_bank == MAP_FAILED || m_bank != (u8_t*)STUB_FLASH_ADDR) {
+			m_bank = NULL;
+			return -ENOMEM;
+		}
+	}
+
+	memset(m_bank, 0xFF, STUB_FLASH_BANK_SIZE);
+	m_erase_count = 0;
+	m_write_count = 0;
+
+	return 0;
+}
+
+u8_t* stub_flash_bank(void)
+{
+	return m_bank;
+}
+
+int stub_flash_load(const char* path)
+{
+	FILE* fp;
+	size_t size;
+
+	fp = fopen(path, "rb");
+	if (!fp) {
+		return -ENOENT;
+	}
+
+	size = fread(m_bank, 1, STUB_FLASH_BANK_SIZE, fp);
+	fclose(fp);
+
+	return (int)size;
+}
+
+u32_t stub_flash_erase_count(void)
+{
+	return m_erase_count;
+}
+
+u32_t stub_flash_write_count(void)
+{
+	return m_write_count;
+}
+
+int flash_area_open(u8_t id, const struct flash_area** fa)
+{
+	if (id != APP_FLASH_BANK_ID || !m_bank) {
+		return -ENOENT;
+	}
+
+	*fa = &m_bank_area;
+
+	return 0;
+}
+
+void flash_area_close(const struct flash_area* fa)
+{
+}
+
+int flash_area_read(const struct flash_area* fa, off_t off, void* dst, size_t len)
+{
+	if (off < 0 || off + len > fa->fa_size) {
+		return -EINVAL;
+	}
+
+	memcpy(dst, m_bank + off, len);
+
+	return 0;
+}
+
+int app_flash_info(u8_t* p_data)
+{
+	return 0;
+}
+
+int app_flash_read(u32_t offset, u8_t* p_data, u32_t length)
+{
+	return flash_area_read(&m_bank_area, offset, p_data, length);
+}
+
+int app_flash_write(u32_t offset, u8_t* p_data, u32_t length)
+{
+	if ((offset & 3) || !m_bank || offset + length > STUB_FLASH_BANK_SIZE) {
+		return -EINVAL;
+	}
+
+	for (u32_t i = 0; i < length; i++) {
+		m_bank[offset + i] &= p_data[i];
+	}
+	m_write_count += length;
+
+	return 0;
+}
+
+int app_flash_erase_page(u32_t offset, u32_t count)
+{
+	if ((offset % STUB_FLASH_PAGE_SIZE) || !m_bank ||
+		offset + count * STUB_FLASH_PAGE_SIZE > STUB_FLASH_BANK_SIZE) {
+		return -EINVAL;
+	}
+
+	memset(m_bank + offset, 0xFF, count * STUB_FLASH_PAGE_SIZE);
+	m_erase_count += count;
+
+	return 0;
+}
+
+int app_flash_erase_from_end(u32_t count)
+{
+	return app_flash_erase_page(STUB_FLASH_BANK_SIZE - count * STUB_FLASH_PAGE_SIZE, count);
+}
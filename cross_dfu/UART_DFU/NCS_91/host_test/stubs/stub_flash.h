@@ -0,0 +1,36 @@
+#ifndef STUB_FLASH_H__
+#define STUB_FLASH_H__
+
+#include <zephyr.h>
+
+/* The modules take the bank as memory-mapped flash and keep its address in
+ * u32_t, so it is mapped below 4 GB like on nrf91.
+ */
+#define STUB_FLASH_ADDR			0x20000000UL
+#define STUB_FLASH_BANK_SIZE	0x80000
+#define STUB_FLASH_PAGE_SIZE	0x1000
+
+/**@brief Map the bank, all pages are erased
+ *
+ * @return 0: success
+ * @return neg: error
+ */
+int stub_flash_init(void);
+
+/**@brief Get the bank in the host memory */
+u8_t* stub_flash_bank(void);
+
+/**@brief Load a DFU file to the start of the bank
+ *
+ * @param[in] path: path of the file
+ *
+ * @return file size
+ * @return neg: error
+ */
+int stub_flash_load(const char* path);
+
+/**@brief Count of pages erased and bytes written since init */
+u32_t stub_flash_erase_count(void);
+u32_t stub_flash_write_count(void);
+
+#endif /* STUB_FLASH_H__ */
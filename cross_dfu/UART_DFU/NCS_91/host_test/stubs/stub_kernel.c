@@ -0,0 +1,75 @@
+/* Kernel and logging services of the host build */
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <zephyr.h>
+#include <logging/log.h>
+
+static const char* level_str[] = { "", "err", "wrn", "inf", "dbg" };
+
+int log_stub_level = LOG_LEVEL_INF;
+
+void log_stub_printf(const char* module, int level, const char* fmt, ...)
+{
+	va_list args;
+
+	if (level > log_stub_level) {
+		return;
+	}
+
+	printf("[%08u] <%s> %s: ", k_uptime_get_32(), level_str[level], module);
+	va_start(args, fmt);
+	vprintf(fmt, args);
+	va_end(args);
+	printf("\n");
+	fflush(stdout);
+}
+
+void log_stub_hexdump(const char* module, const void* data, size_t length,
+	const char* str)
+{
+	const u8_t* p_data = data;
+
+	printf("[%08u] <inf> %s: %s", k_uptime_get_32(), module, str);
+	for (size_t i = 0; i < length; i++) {
+		printf(" %02x", p_data[i]);
+	}
+	printf("\n");
+}
+
+void k_work_init(struct k_work* work, k_work_handler_t handler)
+{
+	work->handler = handler;
+}
+
+void k_work_submit(struct k_work* work)
+{
+	work->handler(work);
+}
+
+void* k_malloc(size_t size)
+{
+	return malloc(size);
+}
+
+void k_free(void* ptr)
+{
+	free(ptr);
+}
+
+u32_t k_uptime_get_32(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (u32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+void k_sleep(s32_t ms)
+{
+	struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+
+	nanosleep(&ts, NULL);
+}
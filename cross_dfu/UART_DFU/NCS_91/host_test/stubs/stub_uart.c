@@ -0,0 +1,149 @@
+/* app_uart of the host build, the UART is a tty, e.g. the pty of dfu_bl_sim.py */
+#include <fcntl.h>
+#include <pthread.h>
+#include <termios.h>
+#include <unistd.h>
+#include <zephyr.h>
+#include <device.h>
+
+#include "app_uart.h"
+
+static uart_buff_t m_rx_buff;
+static uart_rx_cb  m_rx_cb;
+static uart_tx_cb  m_tx_cb;
+
+static int m_fd = -1;
+static pthread_t m_rx_thread;
+static pthread_mutex_t m_rx_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**@brief Feed bytes one by one, like the nrfx UART interrupt */
+static void* rx_thread(void* arg)
+{
+	u8_t byte;
+	ssize_t read_len;
+
+	while (true) {
+		read_len = read(m_fd, &byte, 1);
+		if (read_len < 0 && errno == EINTR) {
+			continue;
+		}
+		if (read_len <= 0) {
+			// The other side is closed, requests time out from now on
+			break;
+		}
+
+		pthread_mutex_lock(&m_rx_lock);
+		if (m_rx_buff.length < m_rx_buff.max_len) {
+			m_rx_buff.p_data[m_rx_buff.length++] = byte;
+
+			if (m_rx_cb) {
+				m_rx_cb(m_rx_buff.p_data, m_rx_buff.length);
+			}
+		}
+		pthread_mutex_unlock(&m_rx_lock);
+	}
+
+	return NULL;
+}
+
+int app_uart_init(struct device* p_device, u8_t* p_rx_buff,
+		u16_t rx_max_len)
+{
+	struct termios tio;
+
+	if (p_device == NULL || p_device->name == NULL) {
+		return -ENXIO;
+	}
+
+	m_fd = open(p_device->name, O_RDWR | O_NOCTTY);
+	if (m_fd < 0) {
+		return -ENXIO;
+	}
+
+	if (tcgetattr(m_fd, &tio) == 0) {
+		cfmakeraw(&tio);
+		cfsetspeed(&tio, B115200);
+		tcsetattr(m_fd, TCSANOW, &tio);
+	}
+	tcflush(m_fd, TCIOFLUSH);
+
+	m_rx_buff.p_data = p_rx_buff;
+	m_rx_buff.max_len = rx_max_len;
+	m_rx_buff.length = 0;
+
+	m_rx_cb = NULL;
+	m_tx_cb = NULL;
+
+	if (pthread_create(&m_rx_thread, NULL, rx_thread, NULL)) {
+		close(m_fd);
+		m_fd = -1;
+		return -ENXIO;
+	}
+
+	return 0;
+}
+
+void app_uart_uninit(void)
+{
+	if (m_fd >= 0) {
+		pthread_cancel(m_rx_thread);
+		pthread_join(m_rx_thread, NULL);
+		close(m_fd);
+		m_fd = -1;
+	}
+}
+
+int app_uart_send(const u8_t* p_data, u16_t length)
+{
+	ssize_t sent;
+
+	if (m_fd < 0) {
+		return -1;
+	}
+
+	while (length > 0) {
+		sent = write(m_fd, p_data, length);
+		if (sent < 0 && errno == EINTR) {
+			continue;
+		}
+		if (sent <= 0) {
+			return -1;
+		}
+
+		p_data += sent;
+		length -= sent;
+	}
+
+	if (m_tx_cb) {
+		m_tx_cb(0);
+	}
+
+	return 0;
+}
+
+int uart_send_sync(struct device* p_device, const u8_t* p_data, u16_t length)
+{
+	return app_uart_send(p_data, length);
+}
+
+void uart_buffer_reset(uart_buff_t* p_buff)
+{
+	p_buff->length = 0;
+}
+
+void app_uart_rx_reset(void)
+{
+	pthread_mutex_lock(&m_rx_lock);
+	uart_buffer_reset(&m_rx_buff);
+	pthread_mutex_unlock(&m_rx_lock);
+}
+
+void app_uart_rx_cb_set(uart_rx_cb cb)
+{
+	m_rx_cb = cb;
+}
+
+void app_uart_tx_cb_set(uart_tx_cb cb)
+{
+	m_tx_cb = cb;
+}
@@ -0,0 +1,8 @@
+#ifndef SYS_PRINTK_STUB_H__
+#define SYS_PRINTK_STUB_H__
+
+#include <stdio.h>
+
+#define printk printf
+
+#endif /* SYS_PRINTK_STUB_H__ */
@@ -0,0 +1,17 @@
+#ifndef SYS_UTIL_STUB_H__
+#define SYS_UTIL_STUB_H__
+
+#define MIN(a,b) (((a) < (b)) ? (a) : (b))
+#define MAX(a,b) (((a) > (b)) ? (a) : (b))
+
+#define ARRAY_SIZE(array)		(sizeof(array) / sizeof((array)[0]))
+#define BIT(n)					(1UL << (n))
+
+#define ceiling_fraction(numerator, divider) \
+	(((numerator) + ((divider) - 1)) / (divider))
+#define ROUND_UP(x, align) \
+	(ceiling_fraction((unsigned long)(x), (unsigned long)(align)) * (unsigned long)(align))
+#define ROUND_DOWN(x, align) \
+	(((unsigned long)(x) / (unsigned long)(align)) * (unsigned long)(align))
+
+#endif /* SYS_UTIL_STUB_H__ */
@@ -0,0 +1,38 @@
+/* Host build of the serial DFU modules, only what they use of Zephyr */
+#ifndef ZEPHYR_STUB_H__
+#define ZEPHYR_STUB_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/util.h>
+
+typedef uint8_t  u8_t;
+typedef uint16_t u16_t;
+typedef uint32_t u32_t;
+typedef uint64_t u64_t;
+typedef int8_t   s8_t;
+typedef int16_t  s16_t;
+typedef int32_t  s32_t;
+typedef int64_t  s64_t;
+
+struct k_work;
+typedef void (*k_work_handler_t)(struct k_work* work);
+
+struct k_work
+{
+	k_work_handler_t handler;
+};
+
+void k_work_init(struct k_work* work, k_work_handler_t handler);
+void k_work_submit(struct k_work* work);
+
+void* k_malloc(size_t size);
+void k_free(void* ptr);
+
+u32_t k_uptime_get_32(void);
+void k_sleep(s32_t ms);
+
+#endif /* ZEPHYR_STUB_H__ */
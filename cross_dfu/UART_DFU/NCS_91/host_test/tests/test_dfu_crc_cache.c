@@ -0,0 +1,172 @@
+/* Slots and checkpoints of the CRC cache */
+#include <zephyr.h>
+#include <sys/byteorder.h>
+
+#include "dfu_crc_cache.h"
+#include "dfu_delta.h"
+#include "dfu_file.h"
+#include "stub_flash.h"
+#include "test_util.h"
+
+#define FILE_SIZE       0x2004
+#define CACHE_PAGE      0x3000
+#define FW_SIZE         (DFU_CRC_CACHE_INTERVAL * 6 + 100)
+#define FW_CRC          0x5A5A1234
+
+/* A DFU file is identified by its size and the CRC at its end */
+static void file_set(u32_t file_size, u32_t file_crc)
+{
+    u8_t* p_bank = stub_flash_bank();
+
+    memset(p_bank, 0xFF, FILE_SIZE);
+    sys_put_le32(file_size, &p_bank[8]);
+    sys_put_le32(file_crc, &p_bank[file_size - 4]);
+}
+
+static void find_check(u32_t offset, u32_t pos_expected, u32_t crc_expected)
+{
+    u32_t pos, crc;
+
+    dfu_crc_cache_find(offset, &pos, &crc);
+    CHECK_EQ(pos, pos_expected);
+    CHECK_EQ(crc, crc_expected);
+}
+
+static void test_find_put(void)
+{
+    stub_flash_init();
+    file_set(FILE_SIZE, 0x11111111);
+
+    CHECK_EQ(dfu_crc_cache_open(0, FW_SIZE, FW_CRC), 0);
+    find_check(FW_SIZE, 0, 0);
+
+    dfu_crc_cache_put(DFU_CRC_CACHE_INTERVAL, 0xA1);
+    dfu_crc_cache_put(DFU_CRC_CACHE_INTERVAL * 2, 0xA2);
+    find_check(0, 0, 0);
+    find_check(DFU_CRC_CACHE_INTERVAL - 1, 0, 0);
+    find_check(DFU_CRC_CACHE_INTERVAL, DFU_CRC_CACHE_INTERVAL, 0xA1);
+    find_check(DFU_CRC_CACHE_INTERVAL * 2 - 1, DFU_CRC_CACHE_INTERVAL, 0xA1);
+    find_check(DFU_CRC_CACHE_INTERVAL * 2 + 1, DFU_CRC_CACHE_INTERVAL * 2, 0xA2);
+
+    // Holes are skipped down to the nearest checkpoint
+    dfu_crc_cache_put(DFU_CRC_CACHE_INTERVAL * 4, 0xA4);
+    find_check(DFU_CRC_CACHE_INTERVAL * 4, DFU_CRC_CACHE_INTERVAL * 4, 0xA4);
+    find_check(DFU_CRC_CACHE_INTERVAL * 4 - 1, DFU_CRC_CACHE_INTERVAL * 2, 0xA2);
+    find_check(0xFFFFFFFF, DFU_CRC_CACHE_INTERVAL * 4, 0xA4);
+
+    // Not a checkpoint, or beyond the firmware
+    dfu_crc_cache_put(0, 0xB0);
+    dfu_crc_cache_put(DFU_CRC_CACHE_INTERVAL * 3 + 4, 0xB3);
+    dfu_crc_cache_put(DFU_CRC_CACHE_INTERVAL * 7, 0xB7);
+    find_check(DFU_CRC_CACHE_INTERVAL * 4 - 1, DFU_CRC_CACHE_INTERVAL * 2, 0xA2);
+    find_check(FW_SIZE, DFU_CRC_CACHE_INTERVAL * 4, 0xA4);
+
+    // A checkpoint is written once
+    dfu_crc_cache_put(DFU_CRC_CACHE_INTERVAL, 0xC1);
+    find_check(DFU_CRC_CACHE_INTERVAL, DFU_CRC_CACHE_INTERVAL, 0xA1);
+
+    dfu_crc_cache_close();
+    find_check(FW_SIZE, 0, 0);
+    dfu_crc_cache_put(DFU_CRC_CACHE_INTERVAL * 3, 0xA3);
+}
+
+static void test_slot_reload(void)
+{
+    u32_t erase_count;
+
+    stub_flash_init();
+    file_set(FILE_SIZE, 0x22222222);
+
+    CHECK_EQ(dfu_crc_cache_open(1, FW_SIZE, FW_CRC), 0);
+    dfu_crc_cache_put(DFU_CRC_CACHE_INTERVAL, 0xA1);
+    dfu_crc_cache_put(DFU_CRC_CACHE_INTERVAL * 5, 0xA5);
+    dfu_crc_cache_close();
+
+    // Checkpoints are kept in flash after the DFU file
+    CHECK_EQ(sys_get_le32(&stub_flash_bank()[CACHE_PAGE + 1024]), 0x43524343);
+
+    erase_count = stub_flash_erase_count();
+    CHECK_EQ(dfu_crc_cache_open(1, FW_SIZE, FW_CRC), 0);
+    find_check(FW_SIZE, DFU_CRC_CACHE_INTERVAL * 5, 0xA5);
+    find_check(DFU_CRC_CACHE_INTERVAL * 5 - 1, DFU_CRC_CACHE_INTERVAL, 0xA1);
+    dfu_crc_cache_close();
+
+    // Another image of the same file takes its own slot
+    CHECK_EQ(dfu_crc_cache_open(0, 0x1000, 0x3333), 0);
+    find_check(0x1000, 0, 0);
+    dfu_crc_cache_put(0x1000, 0xB1);
+    dfu_crc_cache_close();
+    CHECK_EQ(stub_flash_erase_count(), erase_count);
+
+    CHECK_EQ(dfu_crc_cache_open(1, FW_SIZE, FW_CRC), 0);
+    find_check(FW_SIZE, DFU_CRC_CACHE_INTERVAL * 5, 0xA5);
+    dfu_crc_cache_close();
+
+    // The slot doesn't match the image, checkpoints are in RAM only
+    CHECK_EQ(dfu_crc_cache_open(1, FW_SIZE, FW_CRC + 1), -EEXIST);
+    find_check(FW_SIZE, 0, 0);
+    dfu_crc_cache_put(DFU_CRC_CACHE_INTERVAL, 0xC1);
+    find_check(FW_SIZE, DFU_CRC_CACHE_INTERVAL, 0xC1);
+    dfu_crc_cache_close();
+
+    CHECK_EQ(dfu_crc_cache_open(1, FW_SIZE, FW_CRC), 0);
+    find_check(FW_SIZE, DFU_CRC_CACHE_INTERVAL * 5, 0xA5);
+    dfu_crc_cache_close();
+
+    // A new DFU file drops the checkpoints of the previous one
+    file_set(FILE_SIZE, 0x44444444);
+    CHECK_EQ(dfu_crc_cache_open(1, FW_SIZE, FW_CRC), 0);
+    find_check(FW_SIZE, 0, 0);
+    CHECK_EQ(stub_flash_erase_count(), erase_count + 1);
+    dfu_crc_cache_close();
+
+    CHECK_EQ(dfu_crc_cache_open(0, 0x1000, 0x3333), 0);
+    find_check(0x1000, 0, 0);
+    dfu_crc_cache_close();
+}
+
+static void test_no_space(void)
+{
+    stub_flash_init();
+
+    CHECK_EQ(dfu_crc_cache_open(DFU_IMAGE_COUNT_MAX, FW_SIZE, FW_CRC), -EINVAL);
+
+    // Erased file size
+    CHECK_EQ(dfu_crc_cache_open(0, FW_SIZE, FW_CRC), -EINVAL);
+
+    // The page would overlap the base of delta
+    file_set(DELTA_BASE_OFFSET - 0xFFF, 0x55555555);
+    CHECK_EQ(dfu_crc_cache_open(0, FW_SIZE, FW_CRC), -ENOMEM);
+
+    // Checkpoints still work in RAM
+    dfu_crc_cache_put(DFU_CRC_CACHE_INTERVAL * 2, 0xA2);
+    find_check(FW_SIZE, DFU_CRC_CACHE_INTERVAL * 2, 0xA2);
+    dfu_crc_cache_close();
+
+    // A file larger than the base area may use the page before the mcuboot flag
+    file_set(STUB_FLASH_BANK_SIZE - 0x2FFF, 0x66666666);
+    CHECK_EQ(dfu_crc_cache_open(0, FW_SIZE, FW_CRC), 0);
+    dfu_crc_cache_close();
+
+    file_set(STUB_FLASH_BANK_SIZE - 0x1FFF, 0x66666666);
+    CHECK_EQ(dfu_crc_cache_open(0, FW_SIZE, FW_CRC), -ENOMEM);
+    dfu_crc_cache_close();
+
+    file_set(STUB_FLASH_BANK_SIZE - 0xFFF, 0x66666666);
+    CHECK_EQ(dfu_crc_cache_open(0, FW_SIZE, FW_CRC), -EINVAL);
+    dfu_crc_cache_close();
+}
+
+int main(void)
+{
+    if (stub_flash_init()) {
+        printf("Flash bank can't be mapped\n");
+        return 1;
+    }
+
+    TEST_RUN(test_find_put);
+    TEST_RUN(test_slot_reload);
+    TEST_RUN(test_no_space);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,204 @@
+/* Patch ops and firmware reconstruction of delta files */
+#include "dfu_delta.c"
+
+#include "stub_flash.h"
+#include "test_util.h"
+
+#define BASE_SIZE       0x3000
+
+static u8_t m_base[BASE_SIZE];
+static u8_t m_patch[256];
+static u32_t m_patch_len;
+
+static void patch_reset(u32_t base_size)
+{
+    memset(&m_ctx, 0, sizeof(m_ctx));
+    m_ctx.p_patch = m_patch;
+    m_ctx.base_size = base_size;
+    m_patch_len = 0;
+}
+
+static void patch_copy(u32_t src, u32_t len)
+{
+    m_patch[m_patch_len] = DELTA_OP_COPY;
+    sys_put_le32(src, &m_patch[m_patch_len + 1]);
+    sys_put_le32(len, &m_patch[m_patch_len + 5]);
+    m_patch_len += OP_COPY_LEN;
+    m_ctx.patch_size = m_patch_len;
+}
+
+static void patch_add(const u8_t* p_data, u32_t len)
+{
+    m_patch[m_patch_len] = DELTA_OP_ADD;
+    sys_put_le32(len, &m_patch[m_patch_len + 1]);
+    memcpy(&m_patch[m_patch_len + OP_ADD_LEN], p_data, len);
+    m_patch_len += OP_ADD_LEN + len;
+    m_ctx.patch_size = m_patch_len;
+}
+
+static void test_op_copy_bounds(void)
+{
+    patch_reset(BASE_SIZE);
+    patch_copy(0, BASE_SIZE);
+    CHECK_EQ(patch_op_next(), 0);
+    CHECK_EQ(m_ctx.op, DELTA_OP_COPY);
+    CHECK_EQ(m_ctx.op_src, 0);
+    CHECK_EQ(m_ctx.op_remain, BASE_SIZE);
+    CHECK_EQ(m_ctx.patch_pos, OP_COPY_LEN);
+
+    // The last byte of base
+    patch_reset(BASE_SIZE);
+    patch_copy(BASE_SIZE - 1, 1);
+    CHECK_EQ(patch_op_next(), 0);
+
+    patch_reset(BASE_SIZE);
+    patch_copy(BASE_SIZE - 1, 2);
+    CHECK_EQ(patch_op_next(), -EINVAL);
+
+    patch_reset(BASE_SIZE);
+    patch_copy(BASE_SIZE + 1, 0);
+    CHECK_EQ(patch_op_next(), -EINVAL);
+
+    // src + len wraps around 32 bits
+    patch_reset(BASE_SIZE);
+    patch_copy(0x10, 0xFFFFFFF8);
+    CHECK_EQ(patch_op_next(), -EINVAL);
+
+    patch_reset(BASE_SIZE);
+    patch_copy(0xFFFFFFF0, 0x20);
+    CHECK_EQ(patch_op_next(), -EINVAL);
+
+    // The op is cut by the end of patch
+    patch_reset(BASE_SIZE);
+    patch_copy(0, 1);
+    m_ctx.patch_size = OP_COPY_LEN - 1;
+    CHECK_EQ(patch_op_next(), -EINVAL);
+}
+
+static void test_op_add_bounds(void)
+{
+    static const u8_t data[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+
+    patch_reset(BASE_SIZE);
+    patch_add(data, sizeof(data));
+    CHECK_EQ(patch_op_next(), 0);
+    CHECK_EQ(m_ctx.op, DELTA_OP_ADD);
+    CHECK_EQ(m_ctx.op_src, OP_ADD_LEN);
+    CHECK_EQ(m_ctx.op_remain, sizeof(data));
+    CHECK_EQ(m_ctx.patch_pos, m_ctx.patch_size);
+
+    // Data runs past the end of patch
+    patch_reset(BASE_SIZE);
+    patch_add(data, sizeof(data));
+    m_ctx.patch_size--;
+    CHECK_EQ(patch_op_next(), -EINVAL);
+
+    patch_reset(BASE_SIZE);
+    patch_add(data, 0);
+    sys_put_le32(0xFFFFFFFF, &m_patch[1]);
+    CHECK_EQ(patch_op_next(), -EINVAL);
+
+    patch_reset(BASE_SIZE);
+    patch_add(data, 0);
+    m_ctx.patch_size = OP_ADD_LEN - 1;
+    CHECK_EQ(patch_op_next(), -EINVAL);
+
+    patch_reset(BASE_SIZE);
+    patch_add(data, 0);
+    CHECK_EQ(patch_op_next(), 0);
+    CHECK_EQ(m_ctx.op_remain, 0);
+}
+
+static void test_op_sequence(void)
+{
+    static const u8_t data[3] = { 0xC0, 0xDB, 0x00 };
+
+    patch_reset(BASE_SIZE);
+    CHECK_EQ(patch_op_next(), -ENODATA);
+
+    patch_reset(BASE_SIZE);
+    patch_copy(0x100, 0x20);
+    patch_add(data, sizeof(data));
+    m_patch[m_patch_len++] = 0x03;
+    m_ctx.patch_size = m_patch_len;
+
+    CHECK_EQ(patch_op_next(), 0);
+    CHECK_EQ(m_ctx.op_src, 0x100);
+    CHECK_EQ(patch_op_next(), 0);
+    CHECK_EQ(m_ctx.op_src, OP_COPY_LEN + OP_ADD_LEN);
+    CHECK_EQ(m_ctx.op_remain, sizeof(data));
+    CHECK_EQ(patch_op_next(), -EINVAL);
+}
+
+static void test_reconstruct(void)
+{
+    static const u8_t data[5] = { 0xC0, 0xDB, 0xDC, 0xDD, 0x00 };
+    u8_t target[0x1105];
+    u8_t read[0x1105];
+    u32_t base_crc;
+    u32_t pos, stp;
+
+    for (u32_t i = 0; i < BASE_SIZE; i++) {
+        m_base[i] = (u8_t)(i * 7 + (i >> 8));
+    }
+    base_crc = crc32_compute(m_base, BASE_SIZE, NULL);
+
+    memcpy(target, &m_base[0x2000], 0x1000);
+    memcpy(&target[0x1000], data, sizeof(data));
+    memcpy(&target[0x1005], &m_base[0x10], 0x100);
+
+    patch_reset(BASE_SIZE);
+    patch_copy(0x2000, 0x1000);
+    patch_add(data, sizeof(data));
+    patch_copy(0x10, 0x100);
+
+    stub_flash_init();
+    CHECK_EQ(dfu_delta_init(m_patch, m_patch_len, BASE_SIZE, base_crc), -ENOENT);
+
+    CHECK_EQ(dfu_delta_base_save(m_base, BASE_SIZE), 0);
+    CHECK_EQ(dfu_delta_init(m_patch, m_patch_len, BASE_SIZE, base_crc + 1), -ENOENT);
+    CHECK_EQ(dfu_delta_init(m_patch, m_patch_len, BASE_SIZE, base_crc), 0);
+
+    // Forward in odd steps, then backward
+    for (pos = 0; pos < sizeof(read); pos += stp) {
+        stp = MIN(sizeof(read) - pos, 333);
+        CHECK_EQ(dfu_delta_read(pos, &read[pos], stp), 0);
+    }
+    CHECK(memcmp(read, target, sizeof(target)) == 0);
+
+    memset(read, 0, sizeof(read));
+    CHECK_EQ(dfu_delta_read(0xFFE, read, 0x10), 0);
+    CHECK(memcmp(read, &target[0xFFE], 0x10) == 0);
+    CHECK_EQ(dfu_delta_read(0x10, read, 0x10), 0);
+    CHECK(memcmp(read, &target[0x10], 0x10) == 0);
+
+    // Reading beyond the patch fails
+    CHECK_EQ(dfu_delta_read(sizeof(target), read, 1), -ENODATA);
+
+    CHECK_EQ(dfu_delta_verify(sizeof(target), crc32_compute(target, sizeof(target), NULL)), 0);
+    CHECK_EQ(dfu_delta_verify(sizeof(target), 0), -EIO);
+    CHECK_EQ(dfu_delta_verify(sizeof(target) - 1, crc32_compute(target, sizeof(target) - 1, NULL)), -EINVAL);
+
+    // Base is modified in flash
+    stub_flash_bank()[DELTA_BASE_DATA_OFFSET + 0x123] ^= 0x01;
+    CHECK_EQ(dfu_delta_init(m_patch, m_patch_len, BASE_SIZE, base_crc), -EIO);
+
+    CHECK_EQ(dfu_delta_base_save(m_base, BASE_SIZE), 0);
+    CHECK_EQ(dfu_delta_base_invalidate(), 0);
+    CHECK_EQ(dfu_delta_init(m_patch, m_patch_len, BASE_SIZE, base_crc), -ENOENT);
+}
+
+int main(void)
+{
+    if (stub_flash_init()) {
+        printf("Flash bank can't be mapped\n");
+        return 1;
+    }
+
+    TEST_RUN(test_op_copy_bounds);
+    TEST_RUN(test_op_add_bounds);
+    TEST_RUN(test_op_sequence);
+    TEST_RUN(test_reconstruct);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,158 @@
+/* Image table of SDK DFU files */
+#include <zephyr.h>
+#include <sys/byteorder.h>
+
+#include "dfu_file.h"
+#include "stub_flash.h"
+#include "test_util.h"
+
+static u8_t* m_file;
+
+static void file_header_set(u32_t magic, u32_t size, u32_t count)
+{
+	stub_flash_init();
+	m_file = stub_flash_bank();
+
+	sys_put_le32(MAGIC_NUMBER_MCUBOOT, &m_file[0]);
+	sys_put_le32(magic, &m_file[4]);
+	sys_put_le32(size, &m_file[8]);
+	sys_put_le32(count, &m_file[12]);
+}
+
+static void image_entry_set(u32_t index, u32_t type, u32_t ip_addr, u32_t ip_size,
+	u32_t fw_addr, u32_t fw_size, u32_t fw_crc)
+{
+	u8_t* p_entry = &m_file[16 + index * 24];
+
+	sys_put_le32(type, &p_entry[0]);
+	sys_put_le32(ip_addr, &p_entry[4]);
+	sys_put_le32(ip_size, &p_entry[8]);
+	sys_put_le32(fw_addr, &p_entry[12]);
+	sys_put_le32(fw_size, &p_entry[16]);
+	sys_put_le32(fw_crc, &p_entry[20]);
+}
+
+static void test_file_type(void)
+{
+	file_header_set(MAGIC_NUMBER_SDK_DFU, 0x1000, 1);
+	CHECK_EQ(dfu_file_type(), IMAGE_TYPE_NRF52);
+
+	file_header_set(MAGIC_NUMBER_SDK_DELTA, 0x1000, 0);
+	CHECK_EQ(dfu_file_type(), IMAGE_TYPE_NRF52_DELTA);
+
+	file_header_set(0x12345678, 0x1000, 0);
+	CHECK_EQ(dfu_file_type(), IMAGE_TYPE_NRF91);
+
+	file_header_set(MAGIC_NUMBER_SDK_DFU, 0x1000, 1);
+	sys_put_le32(0, &m_file[0]);
+	sys_put_le32(MAGIC_NUMBER_MODEM, &m_file[4]);
+	CHECK_EQ(dfu_file_type(), IMAGE_TYPE_MODEM);
+
+	// Erased bank
+	stub_flash_init();
+	CHECK_EQ(dfu_file_type(), IMAGE_TYPE_ERROR);
+}
+
+static void test_image_count(void)
+{
+	file_header_set(MAGIC_NUMBER_SDK_DFU, 0x1000, 0);
+	CHECK_EQ(dfu_file_image_count(), 0);
+
+	file_header_set(MAGIC_NUMBER_SDK_DFU, 0x1000, 1);
+	CHECK_EQ(dfu_file_image_count(), 1);
+
+	file_header_set(MAGIC_NUMBER_SDK_DFU, 0x1000, DFU_IMAGE_COUNT_MAX);
+	CHECK_EQ(dfu_file_image_count(), DFU_IMAGE_COUNT_MAX);
+
+	file_header_set(MAGIC_NUMBER_SDK_DFU, 0x1000, DFU_IMAGE_COUNT_MAX + 1);
+	CHECK_EQ(dfu_file_image_count(), 0);
+
+	// Erased count of a broken file
+	file_header_set(MAGIC_NUMBER_SDK_DFU, 0x1000, 0xFFFFFFFF);
+	CHECK_EQ(dfu_file_image_count(), 0);
+}
+
+static void test_image_get(void)
+{
+	dfu_image_t image;
+
+	file_header_set(MAGIC_NUMBER_SDK_DFU, 0x30000, 2);
+	image_entry_set(0, DFU_IMAGE_SOFTDEVICE_BOOTLOADER, 128, 141, 640, 0x20000, 0x11223344);
+	image_entry_set(1, DFU_IMAGE_APPLICATION, 0x20280, 135, 0x20480, 0x5001, DFU_IMAGE_NO_CRC);
+
+	CHECK_EQ(dfu_file_size(), 0x30000);
+
+	CHECK_EQ(dfu_file_image_get(0, &image), 0);
+	CHECK_EQ(image.type, DFU_IMAGE_SOFTDEVICE_BOOTLOADER);
+	CHECK_EQ(image.ip_addr, STUB_FLASH_ADDR + 128);
+	CHECK_EQ(image.ip_size, 141);
+	CHECK_EQ(image.fw_addr, STUB_FLASH_ADDR + 640);
+	CHECK_EQ(image.fw_size, 0x20000);
+	CHECK_EQ(image.fw_crc, 0x11223344);
+
+	CHECK_EQ(dfu_file_image_get(1, &image), 0);
+	CHECK_EQ(image.type, DFU_IMAGE_APPLICATION);
+	CHECK_EQ(image.ip_addr, STUB_FLASH_ADDR + 0x20280);
+	CHECK_EQ(image.ip_size, 135);
+	CHECK_EQ(image.fw_addr, STUB_FLASH_ADDR + 0x20480);
+	CHECK_EQ(image.fw_size, 0x5001);
+	CHECK_EQ(image.fw_crc, DFU_IMAGE_NO_CRC);
+
+	// Entries beyond the count are not read, even if they look valid
+	image_entry_set(2, DFU_IMAGE_APPLICATION, 128, 141, 640, 0x100, 0);
+	CHECK_EQ(dfu_file_image_get(2, &image), -EINVAL);
+	CHECK_EQ(dfu_file_image_get(DFU_IMAGE_COUNT_MAX, &image), -EINVAL);
+	CHECK_EQ(dfu_file_image_get(0xFFFFFFFF, &image), -EINVAL);
+
+	file_header_set(MAGIC_NUMBER_SDK_DFU, 0x30000, DFU_IMAGE_COUNT_MAX + 1);
+	CHECK_EQ(dfu_file_image_get(0, &image), -EINVAL);
+}
+
+static void test_file_info(void)
+{
+	u32_t ip_addr, ip_size, fw_addr, fw_size;
+	u32_t patch_addr, patch_size, base_size, base_crc, fw_crc;
+
+	// The old file header of single image
+	file_header_set(MAGIC_NUMBER_SDK_DFU, 0x1000, 1);
+	image_entry_set(0, DFU_IMAGE_APPLICATION, 128, 141, 640, 0x800, DFU_IMAGE_NO_CRC);
+
+	dfu_file_info(&ip_addr, &ip_size, &fw_addr, &fw_size);
+	CHECK_EQ(ip_addr, STUB_FLASH_ADDR + 128);
+	CHECK_EQ(ip_size, 141);
+	CHECK_EQ(fw_addr, STUB_FLASH_ADDR + 640);
+	CHECK_EQ(fw_size, 0x800);
+
+	file_header_set(MAGIC_NUMBER_SDK_DELTA, 0x1000, 0);
+	sys_put_le32(128, &m_file[20]);
+	sys_put_le32(140, &m_file[24]);
+	sys_put_le32(640, &m_file[28]);
+	sys_put_le32(0x200, &m_file[32]);
+	sys_put_le32(0x9000, &m_file[36]);
+	sys_put_le32(0xAABBCCDD, &m_file[40]);
+	sys_put_le32(0x9100, &m_file[44]);
+	sys_put_le32(0x01020304, &m_file[48]);
+
+	dfu_file_delta_info(&patch_addr, &patch_size, &base_size, &base_crc, &fw_size, &fw_crc);
+	CHECK_EQ(patch_addr, STUB_FLASH_ADDR + 640);
+	CHECK_EQ(patch_size, 0x200);
+	CHECK_EQ(base_size, 0x9000);
+	CHECK_EQ(base_crc, 0xAABBCCDD);
+	CHECK_EQ(fw_size, 0x9100);
+	CHECK_EQ(fw_crc, 0x01020304);
+}
+
+int main(void)
+{
+	if (stub_flash_init()) {
+		printf("Flash bank can't be mapped\n");
+		return 1;
+	}
+
+	TEST_RUN(test_file_type);
+	TEST_RUN(test_image_count);
+	TEST_RUN(test_image_get);
+	TEST_RUN(test_file_info);
+
+	return TEST_RESULT();
+}
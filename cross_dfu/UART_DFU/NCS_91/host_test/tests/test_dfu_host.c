@@ -0,0 +1,140 @@
+/* Packing of data into SLIP packets of the MTU */
+#include <stdlib.h>
+
+#include "dfu_host.c"
+
+#include "test_util.h"
+
+#define PACKET_MAX      2048
+
+static u8_t m_packets[PACKET_MAX][REQ_DATA_SIZE_MAX];
+static u16_t m_packet_len[PACKET_MAX];
+static u32_t m_packet_count;
+
+int dfu_drv_tx(const u8_t* p_data, u16_t length)
+{
+	if (m_packet_count == PACKET_MAX || length > REQ_DATA_SIZE_MAX) {
+		return -3;
+	}
+
+	memcpy(m_packets[m_packet_count], p_data, length);
+	m_packet_len[m_packet_count++] = length;
+
+	return 0;
+}
+
+int dfu_drv_rx(u8_t* p_data, u32_t max_len, u32_t* p_real_len)
+{
+	return -1;
+}
+
+static u32_t slip_size(const u8_t* p_data, u32_t length)
+{
+	u32_t size = 0;
+
+	for (u32_t i = 0; i < length; i++) {
+		size += SLIP_BYTE_LEN(p_data[i]);
+	}
+
+	return size;
+}
+
+/* Packets hold all data within the MTU, and are full unless they are the
+ * last one. All but the last one end at a word boundary of the object.
+ */
+static void stream_check(const u8_t* p_data, u32_t data_size, u32_t offset, u16_t mtu_test)
+{
+	u32_t pos = 0;
+	u32_t wire_bytes = 0;
+	u32_t stp, next, slip_len;
+
+	mtu = mtu_test;
+	m_packet_count = 0;
+	stat_wire_bytes = 0;
+
+	CHECK_EQ(stream_data(p_data, data_size, offset), 0);
+
+	for (u32_t i = 0; i < m_packet_count; i++) {
+		stp = m_packet_len[i] - 1;
+		slip_len = slip_size(&m_packets[i][1], stp);
+		wire_bytes += slip_len + 2;
+
+		CHECK_EQ(m_packets[i][0], NRF_DFU_OP_OBJECT_WRITE);
+		CHECK(slip_len + 2 <= mtu_test);
+		CHECK(stp > 0);
+		CHECK(memcmp(&m_packets[i][1], &p_data[pos], stp) == 0);
+
+		pos += stp;
+
+		if (i + 1 < m_packet_count) {
+			CHECK_EQ((offset + pos) & 3, 0);
+
+			// The next word would not fit
+			next = MIN(4, data_size - pos);
+			CHECK(slip_len + slip_size(&p_data[pos], next) + 2 > mtu_test ||
+				stp + next > REQ_DATA_SIZE_MAX - 1);
+		}
+	}
+
+	CHECK_EQ(pos, data_size);
+	CHECK_EQ(stat_wire_bytes, wire_bytes);
+}
+
+static void test_stream_packing(void)
+{
+	static const u16_t mtu_list[] = { 16, 17, 131, 515, 2051 };
+	static const u32_t offset_list[] = { 0, 4096, 2, 3 };
+	static const u32_t size_list[] = { 1, 7, 13, 1024, 4095, 4096 };
+	static u8_t data[4][OBJ_DATA_SIZE_MAX];
+
+	srand(1);
+	for (u32_t i = 0; i < OBJ_DATA_SIZE_MAX; i++) {
+		data[0][i] = (u8_t)i;
+		data[1][i] = SLIP_END;
+		data[2][i] = (rand() & 1) ? SLIP_ESC : (u8_t)rand();
+		data[3][i] = (i % 97 == 0) ? SLIP_END : 0xFF;
+	}
+
+	for (u32_t m = 0; m < ARRAY_SIZE(mtu_list); m++) {
+		for (u32_t d = 0; d < ARRAY_SIZE(data); d++) {
+			for (u32_t o = 0; o < ARRAY_SIZE(offset_list); o++) {
+				for (u32_t s = 0; s < ARRAY_SIZE(size_list); s++) {
+					stream_check(data[d], size_list[s], offset_list[o], mtu_list[m]);
+				}
+			}
+		}
+	}
+}
+
+static void test_stream_count(void)
+{
+	static u8_t data[OBJ_DATA_SIZE_MAX];
+
+	// No escape, the whole MTU carries data
+	memset(data, 0x55, sizeof(data));
+	mtu = 515;
+	m_packet_count = 0;
+	CHECK_EQ(stream_data(data, sizeof(data), 0), 0);
+	CHECK_EQ(m_packet_len[0] - 1, 512);
+	CHECK_EQ(m_packet_count, 8);
+
+	// Limited by the local buffer
+	mtu = 2051;
+	m_packet_count = 0;
+	CHECK_EQ(stream_data(data, sizeof(data), 0), 0);
+	CHECK_EQ(m_packet_len[0] - 1, 1024);
+	CHECK_EQ(m_packet_count, 4);
+
+	mtu = 15;
+	m_packet_count = 0;
+	CHECK_EQ(stream_data(data, sizeof(data), 0), 1);
+	CHECK_EQ(m_packet_count, 0);
+}
+
+int main(void)
+{
+	TEST_RUN(test_stream_packing);
+	TEST_RUN(test_stream_count);
+
+	return TEST_RESULT();
+}
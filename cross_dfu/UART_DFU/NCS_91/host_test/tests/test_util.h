@@ -0,0 +1,32 @@
+#ifndef TEST_UTIL_H__
+#define TEST_UTIL_H__
+
+#include <stdio.h>
+
+static int test_failures;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+		test_failures++; \
+	} \
+} while (0)
+
+#define CHECK_EQ(actual, expected) do { \
+	long long _a = (long long)(actual); \
+	long long _e = (long long)(expected); \
+	if (_a != _e) { \
+		printf("%s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__, #actual, _a, _e); \
+		test_failures++; \
+	} \
+} while (0)
+
+#define TEST_RUN(test) do { \
+	int _failures = test_failures; \
+	test(); \
+	printf("%s %s\n", (test_failures == _failures) ? "PASS" : "FAIL", #test); \
+} while (0)
+
+#define TEST_RESULT()	(test_failures ? 1 : 0)
+
+#endif /* TEST_UTIL_H__ */
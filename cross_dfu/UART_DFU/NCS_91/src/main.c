@@ -145,7 +145,8 @@ void dfu_target_cb_dummy(enum dfu_target_evt_id evt_id) {;}
 /**@brief k_work handler for updating mcuboot flag */
 static void wk_update_mcuboot_flag_handler(struct k_work* unused)
 {
-	if (m_image_file_type == IMAGE_TYPE_NRF52) {
+	if (m_image_file_type == IMAGE_TYPE_NRF52 ||
+		m_image_file_type == IMAGE_TYPE_NRF52_DELTA) {
 		app_flash_erase_from_end(1);
 	}
 	else if (m_image_file_type == IMAGE_TYPE_NRF91) {
@@ -177,7 +178,7 @@ static void perform_dfu(void)
 
 	img_type = dfu_file_type();
 
-	if (img_type == IMAGE_TYPE_NRF52) {
+	if (img_type == IMAGE_TYPE_NRF52 || img_type == IMAGE_TYPE_NRF52_DELTA) {
 		// Check nRF52 in application mode or not
 		app_cmd_request(CMD_OP_PING_APP, NULL, 0);
 	}
@@ -278,11 +279,11 @@ static void dfu_file_ready(void)
 	 * mcuboot flag manually to make it a valid mcuboot image.
 	 */
 	if (m_image_channel == IMAGE_FROM_HTTP) {
-		if (img_type == IMAGE_TYPE_NRF52) {
+		if (img_type == IMAGE_TYPE_NRF52 || img_type == IMAGE_TYPE_NRF52_DELTA) {
 			// Remove the last page of secondary bank
 			LOG_INF("Remove MCUboot flag for 52 image");
 
-			m_image_file_type = IMAGE_TYPE_NRF52;
+			m_image_file_type = img_type;
 
 			k_work_submit(&wk_update_mcuboot_flag);
 		}
@@ -0,0 +1,256 @@
+#include <string.h>
+#include <zephyr.h>
+#include <sys/util.h>
+#include <sys/byteorder.h>
+#include <storage/flash_map.h>
+#include <logging/log.h>
+LOG_MODULE_REGISTER(dfu_crc_cache, 3);
+
+#include "dfu_crc_cache.h"
+#include "dfu_delta.h"
+#include "dfu_file.h"
+#include "app_flash.h"
+
+#define FLASH_PAGE_SIZE             0x1000
+#define CACHE_MAGIC                 0x43524343
+
+// The cache page holds a slot for each image of the DFU file
+#define CACHE_SLOT_LEN              (FLASH_PAGE_SIZE / DFU_IMAGE_COUNT_MAX)
+#define CACHE_ENTRY_MAX             ((CACHE_SLOT_LEN - sizeof(slot_header_t)) / sizeof(u32_t))
+#define CACHE_ENTRY_EMPTY           0xFFFFFFFF
+
+/**@typedef slot header, followed by the checkpoints */
+typedef struct
+{
+    u32_t magic;
+    u32_t file_crc;             /* CRC of the DFU file the slot belongs to */
+    u32_t fw_size;
+    u32_t fw_crc;
+} slot_header_t;
+
+/**@typedef cache context */
+typedef struct
+{
+    bool  opened;
+    bool  persistent;           /* Checkpoints are written to flash */
+    u32_t slot_offset;          /* Offset of the slot from the bank start */
+    u32_t fw_size;
+    u32_t crc[CACHE_ENTRY_MAX]; /* crc[n] is the checkpoint at (n + 1) * DFU_CRC_CACHE_INTERVAL */
+} cache_ctx_t;
+
+static cache_ctx_t m_cache;
+
+/**@brief Get the flash page to keep checkpoints
+ *
+ * @details It's the page following the DFU file, it must not overlap the
+ * base firmware of delta, nor the mcuboot flag in the last page.
+ *
+ * @param[out] p_bank_addr: start address of the bank
+ * @param[out] p_offset: offset of the page from the bank start
+ *
+ * @return 0: success
+ * @return neg: error
+ */
+static int cache_page_get(u32_t* p_bank_addr, u32_t* p_offset)
+{
+    int rc;
+    const struct flash_area* fa;
+    u32_t file_size;
+    u32_t limit;
+
+    rc = flash_area_open(APP_FLASH_BANK_ID, &fa);
+    if (rc) {
+        LOG_ERR("Flash area open error");
+        return rc;
+    }
+
+    *p_bank_addr = fa->fa_off;
+    limit = fa->fa_size - FLASH_PAGE_SIZE;
+
+    flash_area_close(fa);
+
+    file_size = dfu_file_size();
+    if (file_size < sizeof(u32_t) || file_size > limit) {
+        return -EINVAL;
+    }
+
+    if (file_size <= DELTA_BASE_OFFSET) {
+        limit = DELTA_BASE_OFFSET;
+    }
+
+    *p_offset = ROUND_UP(file_size, FLASH_PAGE_SIZE);
+
+    if (*p_offset + FLASH_PAGE_SIZE > limit) {
+        return -ENOMEM;
+    }
+
+    return 0;
+}
+
+/**@brief Load the slot, or take it for the image
+ *
+ * @param[in] bank_addr: start address of the bank
+ * @param[in] page_offset: offset of the cache page from the bank start
+ * @param[in] p_header: expected slot header
+ * @param[in] slot: index of the slot
+ *
+ * @return 0: success
+ * @return neg: error
+ */
+static int cache_slot_load(u32_t bank_addr, u32_t page_offset,
+        const slot_header_t* p_header, u32_t slot)
+{
+    int rc = 0;
+    u32_t i;
+    bool page_valid = true;
+    bool slot_empty;
+    const slot_header_t* p_slot;
+
+    // The page may be left by a previous DFU file
+    for (i = 0; i < DFU_IMAGE_COUNT_MAX; i++) {
+        p_slot = (slot_header_t*)(bank_addr + page_offset + i * CACHE_SLOT_LEN);
+
+        if (p_slot->magic != CACHE_ENTRY_EMPTY &&
+            (p_slot->magic != CACHE_MAGIC || p_slot->file_crc != p_header->file_crc)) {
+            page_valid = false;
+        }
+    }
+
+    p_slot = (slot_header_t*)(bank_addr + m_cache.slot_offset);
+    slot_empty = (p_slot->magic == CACHE_ENTRY_EMPTY);
+
+    if (page_valid && !slot_empty) {
+        if (memcmp(p_slot, p_header, sizeof(slot_header_t)) != 0) {
+            LOG_WRN("Checkpoints of another image in slot %d", slot);
+            return -EEXIST;
+        }
+
+        memcpy(m_cache.crc, (u8_t*)p_slot + sizeof(slot_header_t), sizeof(m_cache.crc));
+
+        return 0;
+    }
+
+    if (!page_valid) {
+        rc = app_flash_erase_page(page_offset, 1);
+    }
+
+    if (!rc) {
+        rc = app_flash_write(m_cache.slot_offset, (u8_t*)p_header, sizeof(slot_header_t));
+    }
+
+    return rc;
+}
+
+/**@brief Open the CRC checkpoints of an image
+ *
+ * @param[in] slot: image index in the DFU file
+ * @param[in] fw_size: size of the firmware
+ * @param[in] fw_crc: crc32 of the firmware
+ *
+ * @return 0: success
+ * @return neg: error, checkpoints are kept in RAM only
+ */
+int dfu_crc_cache_open(u32_t slot, u32_t fw_size, u32_t fw_crc)
+{
+    int rc;
+    u32_t bank_addr;
+    u32_t page_offset;
+    u32_t file_size;
+    slot_header_t header;
+
+    memset(&m_cache, 0xFF, sizeof(m_cache));
+    m_cache.opened = true;
+    m_cache.persistent = false;
+    m_cache.fw_size = fw_size;
+
+    if (slot >= DFU_IMAGE_COUNT_MAX) {
+        return -EINVAL;
+    }
+
+    rc = cache_page_get(&bank_addr, &page_offset);
+    if (rc) {
+        LOG_WRN("No space to keep CRC checkpoints");
+        return rc;
+    }
+
+    // The DFU file is identified by the CRC at its end
+    file_size = dfu_file_size();
+
+    header.magic = CACHE_MAGIC;
+    header.file_crc = sys_get_le32((u8_t*)(bank_addr + file_size - sizeof(u32_t)));
+    header.fw_size = fw_size;
+    header.fw_crc = fw_crc;
+
+    m_cache.slot_offset = page_offset + slot * CACHE_SLOT_LEN;
+
+    rc = cache_slot_load(bank_addr, page_offset, &header, slot);
+    if (rc) {
+        LOG_WRN("CRC checkpoints are not saved: %d", rc);
+        return rc;
+    }
+
+    m_cache.persistent = true;
+
+    return 0;
+}
+
+/**@brief Close the CRC checkpoints */
+void dfu_crc_cache_close(void)
+{
+    m_cache.opened = false;
+}
+
+/**@brief Find the nearest CRC checkpoint
+ *
+ * @param[in] offset: firmware offset
+ * @param[out] p_pos: offset of the checkpoint, not larger than offset, 0 if none
+ * @param[out] p_crc: crc32 of the firmware before the checkpoint
+ */
+void dfu_crc_cache_find(u32_t offset, u32_t* p_pos, u32_t* p_crc)
+{
+    u32_t index = 0;
+
+    if (m_cache.opened) {
+        index = MIN(offset, m_cache.fw_size) / DFU_CRC_CACHE_INTERVAL;
+        index = MIN(index, CACHE_ENTRY_MAX);
+
+        // An erased entry is taken as no checkpoint, even if it is the real CRC
+        while (index > 0 && m_cache.crc[index - 1] == CACHE_ENTRY_EMPTY) {
+            index--;
+        }
+    }
+
+    *p_pos = index * DFU_CRC_CACHE_INTERVAL;
+    *p_crc = (index > 0) ? m_cache.crc[index - 1] : 0;
+}
+
+/**@brief Save a CRC checkpoint
+ *
+ * @param[in] offset: firmware offset, multiple of DFU_CRC_CACHE_INTERVAL
+ * @param[in] crc: crc32 of the firmware before the offset
+ */
+void dfu_crc_cache_put(u32_t offset, u32_t crc)
+{
+    int rc;
+    u32_t index = offset / DFU_CRC_CACHE_INTERVAL;
+
+    if (!m_cache.opened || offset == 0 || offset % DFU_CRC_CACHE_INTERVAL != 0 ||
+        offset > m_cache.fw_size || index > CACHE_ENTRY_MAX) {
+        return;
+    }
+
+    if (m_cache.crc[index - 1] != CACHE_ENTRY_EMPTY) {
+        return;
+    }
+
+    m_cache.crc[index - 1] = crc;
+
+    if (m_cache.persistent) {
+        rc = app_flash_write(m_cache.slot_offset + sizeof(slot_header_t) + (index - 1) * sizeof(u32_t),
+            (u8_t*)&crc, sizeof(crc));
+        if (rc) {
+            LOG_WRN("Checkpoint write error: %d", rc);
+            m_cache.persistent = false;
+        }
+    }
+}
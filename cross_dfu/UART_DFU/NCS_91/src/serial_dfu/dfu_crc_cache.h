@@ -0,0 +1,53 @@
+#ifndef DFU_CRC_CACHE_H__
+#define DFU_CRC_CACHE_H__
+
+#include <zephyr.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A checkpoint is the crc32 of the firmware before a multiple of the
+ * interval, it's the data object size of the bootloader, so each object
+ * ends at a checkpoint.
+ */
+#define DFU_CRC_CACHE_INTERVAL      4096
+
+/**@brief Open the CRC checkpoints of an image
+ *
+ * @details Checkpoints are kept in the flash page following the DFU file,
+ * the ones saved for the same file are loaded, they are computed only
+ * once per image, even after a reset.
+ *
+ * @param[in] slot: image index in the DFU file
+ * @param[in] fw_size: size of the firmware
+ * @param[in] fw_crc: crc32 of the firmware
+ *
+ * @return 0: success
+ * @return neg: error, checkpoints are kept in RAM only
+ */
+int dfu_crc_cache_open(u32_t slot, u32_t fw_size, u32_t fw_crc);
+
+/**@brief Close the CRC checkpoints */
+void dfu_crc_cache_close(void);
+
+/**@brief Find the nearest CRC checkpoint
+ *
+ * @param[in] offset: firmware offset
+ * @param[out] p_pos: offset of the checkpoint, not larger than offset, 0 if none
+ * @param[out] p_crc: crc32 of the firmware before the checkpoint
+ */
+void dfu_crc_cache_find(u32_t offset, u32_t* p_pos, u32_t* p_crc);
+
+/**@brief Save a CRC checkpoint
+ *
+ * @param[in] offset: firmware offset, multiple of DFU_CRC_CACHE_INTERVAL
+ * @param[in] crc: crc32 of the firmware before the offset
+ */
+void dfu_crc_cache_put(u32_t offset, u32_t crc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DFU_CRC_CACHE_H__ */
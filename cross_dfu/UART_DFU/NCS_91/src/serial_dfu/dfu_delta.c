@@ -0,0 +1,440 @@
+#include <string.h>
+#include <zephyr.h>
+#include <sys/util.h>
+#include <sys/byteorder.h>
+#include <storage/flash_map.h>
+#include <logging/log.h>
+LOG_MODULE_REGISTER(dfu_delta, 3);
+
+#include "crc32.h"
+#include "dfu_delta.h"
+#include "dfu_crc_cache.h"
+#include "app_flash.h"
+
+#define FLASH_PAGE_SIZE             0x1000
+#define COPY_UNIT_LEN               1024
+
+#define OP_COPY_LEN                 9
+#define OP_ADD_LEN                  5
+
+/**@typedef base header, stored at the first page of base area */
+typedef struct
+{
+    u32_t magic;
+    u32_t size;
+    u32_t crc;
+} base_header_t;
+
+/**@typedef patcher context */
+typedef struct
+{
+    const u8_t* p_patch;        /* Pointer of the patch */
+    u32_t patch_size;           /* Size of the patch */
+    const u8_t* p_base;         /* Pointer of the base firmware */
+    u32_t base_size;            /* Size of the base firmware */
+    u32_t patch_pos;            /* Position of the next op in the patch */
+    u32_t fw_pos;               /* Firmware offset generated so far */
+    u8_t  op;                   /* Current op code */
+    u32_t op_src;               /* Source offset of the current op */
+    u32_t op_remain;            /* Remaining length of the current op */
+} delta_ctx_t;
+
+static delta_ctx_t m_ctx;
+static u8_t m_copy_buff[COPY_UNIT_LEN];
+
+/**@brief Get the start address of the DFU bank
+ *
+ * @param[out] p_addr: start address of the bank
+ * @param[out] p_size: size of the bank
+ *
+ * @return 0: success
+ * @return neg: error
+ */
+static int bank_get(u32_t* p_addr, u32_t* p_size)
+{
+    int rc;
+    const struct flash_area* fa;
+
+    rc = flash_area_open(APP_FLASH_BANK_ID, &fa);
+    if (rc) {
+        LOG_ERR("Flash area open error");
+        return rc;
+    }
+
+    *p_addr = fa->fa_off;
+    *p_size = fa->fa_size;
+
+    flash_area_close(fa);
+
+    return 0;
+}
+
+/**@brief Restart from the first op of the patch */
+static void patch_rewind(void)
+{
+    m_ctx.patch_pos = 0;
+    m_ctx.fw_pos = 0;
+    m_ctx.op = 0;
+    m_ctx.op_src = 0;
+    m_ctx.op_remain = 0;
+}
+
+/**@brief Fetch the next op of the patch
+ *
+ * @return 0: success
+ * @return neg: error
+ */
+static int patch_op_next(void)
+{
+    const u8_t* p_op = m_ctx.p_patch + m_ctx.patch_pos;
+    u32_t left = m_ctx.patch_size - m_ctx.patch_pos;
+
+    if (left == 0) {
+        LOG_ERR("Patch is too short");
+        return -ENODATA;
+    }
+
+    m_ctx.op = p_op[0];
+
+    if (m_ctx.op == DELTA_OP_COPY && left >= OP_COPY_LEN) {
+        m_ctx.op_src = sys_get_le32(&p_op[1]);
+        m_ctx.op_remain = sys_get_le32(&p_op[5]);
+        m_ctx.patch_pos += OP_COPY_LEN;
+
+        if (m_ctx.op_src > m_ctx.base_size ||
+            m_ctx.op_remain > m_ctx.base_size - m_ctx.op_src) {
+            LOG_ERR("Copy is out of base: %x, %x", m_ctx.op_src, m_ctx.op_remain);
+            return -EINVAL;
+        }
+    }
+    else if (m_ctx.op == DELTA_OP_ADD && left >= OP_ADD_LEN) {
+        m_ctx.op_remain = sys_get_le32(&p_op[1]);
+        m_ctx.patch_pos += OP_ADD_LEN;
+        m_ctx.op_src = m_ctx.patch_pos;
+
+        if (m_ctx.op_remain > m_ctx.patch_size - m_ctx.patch_pos) {
+            LOG_ERR("Add is out of patch: %x, %x", m_ctx.op_src, m_ctx.op_remain);
+            return -EINVAL;
+        }
+
+        m_ctx.patch_pos += m_ctx.op_remain;
+    }
+    else {
+        LOG_ERR("Invalid patch op: %02x", m_ctx.op);
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+/**@brief Run the patch forward
+ *
+ * @param[out] p_data: pointer of data, NULL to skip data
+ * @param[in] length: length of data to be generated
+ *
+ * @return 0: success
+ * @return neg: error
+ */
+static int patch_run(u8_t* p_data, u32_t length)
+{
+    int rc;
+    u32_t stp;
+    const u8_t* p_src;
+
+    while (length > 0) {
+        if (m_ctx.op_remain == 0) {
+            rc = patch_op_next();
+            if (rc) {
+                return rc;
+            }
+
+            continue;
+        }
+
+        stp = MIN(length, m_ctx.op_remain);
+
+        if (p_data != NULL) {
+            p_src = (m_ctx.op == DELTA_OP_COPY) ? m_ctx.p_base : m_ctx.p_patch;
+            memcpy(p_data, p_src + m_ctx.op_src, stp);
+            p_data += stp;
+        }
+
+        m_ctx.op_src += stp;
+        m_ctx.op_remain -= stp;
+        m_ctx.fw_pos += stp;
+        length -= stp;
+    }
+
+    return 0;
+}
+
+/**@brief Initialize the delta patcher
+ *
+ * @param[in] p_patch: pointer of the patch
+ * @param[in] patch_size: size of the patch
+ * @param[in] base_size: expected size of the base firmware
+ * @param[in] base_crc: expected crc32 of the base firmware
+ *
+ * @return 0: success
+ * @return neg: error
+ */
+int dfu_delta_init(const u8_t* p_patch, u32_t patch_size,
+        u32_t base_size, u32_t base_crc)
+{
+    int rc;
+    u32_t bank_addr;
+    u32_t bank_size;
+    u32_t crc_32;
+    base_header_t header;
+
+    rc = bank_get(&bank_addr, &bank_size);
+    if (rc) {
+        return rc;
+    }
+
+    memcpy(&header, (u8_t*)(bank_addr + DELTA_BASE_OFFSET), sizeof(header));
+
+    if (header.magic != DELTA_BASE_MAGIC ||
+        header.size != base_size ||
+        header.crc != base_crc) {
+        LOG_ERR("No matching base firmware, full image is required");
+        return -ENOENT;
+    }
+
+    m_ctx.p_base = (u8_t*)(bank_addr + DELTA_BASE_DATA_OFFSET);
+    m_ctx.base_size = base_size;
+
+    // Base may be corrupted by other images which are larger than expected
+    crc_32 = crc32_compute(m_ctx.p_base, base_size, NULL);
+    if (crc_32 != base_crc) {
+        LOG_ERR("Base firmware is corrupted");
+        return -EIO;
+    }
+
+    m_ctx.p_patch = p_patch;
+    m_ctx.patch_size = patch_size;
+
+    patch_rewind();
+
+    return 0;
+}
+
+/**@brief Read reconstructed firmware data
+ *
+ * @param[in] offset: offset from the start of the firmware
+ * @param[out] p_data: pointer of data
+ * @param[in] length: length of data to be read
+ *
+ * @return 0: success
+ * @return neg: error
+ */
+int dfu_delta_read(u32_t offset, u8_t* p_data, u32_t length)
+{
+    int rc;
+
+    if (offset < m_ctx.fw_pos) {
+        patch_rewind();
+    }
+
+    rc = patch_run(NULL, offset - m_ctx.fw_pos);
+    if (rc) {
+        return rc;
+    }
+
+    return patch_run(p_data, length);
+}
+
+/**@brief Verify reconstructed firmware against the target
+ *
+ * @param[in] fw_size: size of the target firmware
+ * @param[in] fw_crc: crc32 of the target firmware
+ *
+ * @return 0: success
+ * @return neg: error
+ */
+int dfu_delta_verify(u32_t fw_size, u32_t fw_crc)
+{
+    int rc = 0;
+    u32_t pos, stp;
+    u32_t crc_32 = 0;
+
+    for (pos = 0; !rc && pos < fw_size; pos += stp) {
+        stp = MIN((fw_size - pos), sizeof(m_copy_buff));
+
+        rc = dfu_delta_read(pos, m_copy_buff, stp);
+        if (!rc) {
+            crc_32 = crc32_compute(m_copy_buff, stp, &crc_32);
+            dfu_crc_cache_put(pos + stp, crc_32);
+        }
+    }
+
+    if (rc) {
+        return rc;
+    }
+
+    // All ops must be consumed by the target firmware
+    if (m_ctx.op_remain != 0 || m_ctx.patch_pos != m_ctx.patch_size) {
+        LOG_ERR("Patch size doesn't match firmware size");
+        return -EINVAL;
+    }
+
+    if (crc_32 != fw_crc) {
+        LOG_ERR("Invalid firmware CRC (0x%08X -> 0x%08X)", fw_crc, crc_32);
+        return -EIO;
+    }
+
+    return 0;
+}
+
+/**@brief Write data to the bank through RAM
+ *
+ * @param[in] offset: offset from the bank start
+ * @param[in] read: data reader
+ * @param[in] length: length of data
+ *
+ * @return 0: success
+ * @return neg: error
+ */
+static int bank_write(u32_t offset, int (*read)(u32_t, u8_t*, u32_t),
+        u32_t length)
+{
+    int rc = 0;
+    u32_t pos, stp;
+
+    rc = app_flash_erase_page(offset, ceiling_fraction(length, FLASH_PAGE_SIZE));
+    if (rc) {
+        LOG_ERR("Erase error: %d", rc);
+        return rc;
+    }
+
+    for (pos = 0; !rc && pos < length; pos += stp) {
+        stp = MIN((length - pos), sizeof(m_copy_buff));
+
+        rc = read(pos, m_copy_buff, stp);
+        if (!rc) {
+            rc = app_flash_write(offset + pos, m_copy_buff, stp);
+        }
+    }
+
+    return rc;
+}
+
+static const u8_t* m_flat_data;
+
+/**@brief Read a firmware which is stored as flat bin */
+static int flat_read(u32_t offset, u8_t* p_data, u32_t length)
+{
+    memcpy(p_data, m_flat_data + offset, length);
+
+    return 0;
+}
+
+/**@brief Save a firmware as the base of next delta
+ *
+ * @param[in] p_fw: pointer of the firmware
+ * @param[in] fw_size: size of the firmware
+ *
+ * @return 0: success
+ * @return neg: error
+ */
+int dfu_delta_base_save(const u8_t* p_fw, u32_t fw_size)
+{
+    int rc;
+    u32_t bank_addr;
+    u32_t bank_size;
+    base_header_t header;
+
+    rc = bank_get(&bank_addr, &bank_size);
+    if (rc) {
+        return rc;
+    }
+
+    // The last page of the bank is used by mcuboot flag
+    if (DELTA_BASE_DATA_OFFSET + fw_size > bank_size - FLASH_PAGE_SIZE) {
+        LOG_WRN("Firmware is too big to be saved as base");
+        return -ENOMEM;
+    }
+
+    header.magic = DELTA_BASE_MAGIC;
+    header.size = fw_size;
+    header.crc = crc32_compute(p_fw, fw_size, NULL);
+
+    m_flat_data = p_fw;
+
+    // Header is invalidated first and written at last,
+    // so a broken base is never used
+    rc = app_flash_erase_page(DELTA_BASE_OFFSET, 1);
+    if (!rc) {
+        rc = bank_write(DELTA_BASE_DATA_OFFSET, flat_read, fw_size);
+    }
+
+    if (!rc) {
+        rc = app_flash_write(DELTA_BASE_OFFSET, (u8_t*)&header, sizeof(header));
+    }
+
+    if (rc) {
+        LOG_ERR("Base firmware save error: %d", rc);
+        return rc;
+    }
+
+    LOG_INF("Base firmware is saved, size: %d, crc: %08x", fw_size, header.crc);
+
+    return rc;
+}
+
+/**@brief Invalidate the base of next delta
+ *
+ * @details The header page is erased, so no delta file is applied to a
+ * base which doesn't match the firmware running on nrf52.
+ *
+ * @return 0: success
+ * @return neg: error
+ */
+int dfu_delta_base_invalidate(void)
+{
+    int rc;
+
+    rc = app_flash_erase_page(DELTA_BASE_OFFSET, 1);
+    if (rc) {
+        LOG_ERR("Base header erase error: %d", rc);
+        return rc;
+    }
+
+    LOG_INF("Base firmware is invalidated");
+
+    return 0;
+}
+
+/**@brief Save the reconstructed firmware as the base of next delta
+ *
+ * @param[in] scratch_offset: offset of the scratch area from the bank start
+ * @param[in] fw_size: size of the reconstructed firmware
+ *
+ * @return 0: success
+ * @return neg: error
+ */
+int dfu_delta_base_update(u32_t scratch_offset, u32_t fw_size)
+{
+    int rc;
+    u32_t bank_addr;
+    u32_t bank_size;
+
+    rc = bank_get(&bank_addr, &bank_size);
+    if (rc) {
+        return rc;
+    }
+
+    scratch_offset = ROUND_UP(scratch_offset, FLASH_PAGE_SIZE);
+
+    if (scratch_offset + fw_size > DELTA_BASE_OFFSET) {
+        LOG_WRN("No scratch space to save base");
+        return -ENOMEM;
+    }
+
+    rc = bank_write(scratch_offset, dfu_delta_read, fw_size);
+    if (rc) {
+        return rc;
+    }
+
+    return dfu_delta_base_save((u8_t*)(bank_addr + scratch_offset), fw_size);
+}
@@ -0,0 +1,92 @@
+#ifndef DFU_DELTA_H__
+#define DFU_DELTA_H__
+
+#include <zephyr.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Patch op codes, all fields use little endian */
+#define DELTA_OP_COPY               0x01        /* op[1], base offset[4], length[4] */
+#define DELTA_OP_ADD                0x02        /* op[1], length[4], data[length] */
+
+/* A copy of the firmware which is running on nrf52 is kept in the
+ * second half of the DFU bank, DFU files must fit below it.
+ */
+#define DELTA_BASE_MAGIC            0x45534142
+#define DELTA_BASE_OFFSET           0x40000
+#define DELTA_BASE_DATA_OFFSET      (DELTA_BASE_OFFSET + 0x1000)
+
+/**@brief Initialize the delta patcher
+ *
+ * @param[in] p_patch: pointer of the patch
+ * @param[in] patch_size: size of the patch
+ * @param[in] base_size: expected size of the base firmware
+ * @param[in] base_crc: expected crc32 of the base firmware
+ *
+ * @return 0: success
+ * @return neg: error
+ */
+int dfu_delta_init(const u8_t* p_patch, u32_t patch_size,
+    u32_t base_size, u32_t base_crc);
+
+/**@brief Read reconstructed firmware data
+ *
+ * @details Data is generated from the patch on the fly, reading
+ * forward is cheap, reading backward restarts the patch.
+ *
+ * @param[in] offset: offset from the start of the firmware
+ * @param[out] p_data: pointer of data
+ * @param[in] length: length of data to be read
+ *
+ * @return 0: success
+ * @return neg: error
+ */
+int dfu_delta_read(u32_t offset, u8_t* p_data, u32_t length);
+
+/**@brief Verify reconstructed firmware against the target
+ *
+ * @param[in] fw_size: size of the target firmware
+ * @param[in] fw_crc: crc32 of the target firmware
+ *
+ * @return 0: success
+ * @return neg: error
+ */
+int dfu_delta_verify(u32_t fw_size, u32_t fw_crc);
+
+/**@brief Save a firmware as the base of next delta
+ *
+ * @param[in] p_fw: pointer of the firmware
+ * @param[in] fw_size: size of the firmware
+ *
+ * @return 0: success
+ * @return neg: error
+ */
+int dfu_delta_base_save(const u8_t* p_fw, u32_t fw_size);
+
+/**@brief Invalidate the base of next delta
+ *
+ * @return 0: success
+ * @return neg: error
+ */
+int dfu_delta_base_invalidate(void);
+
+/**@brief Save the reconstructed firmware as the base of next delta
+ *
+ * @details The base can't be overwritten while the patch still reads
+ * from it, so the firmware is reconstructed into a scratch area first.
+ *
+ * @param[in] scratch_offset: offset of the scratch area from the bank start
+ * @param[in] fw_size: size of the reconstructed firmware
+ *
+ * @return 0: success
+ * @return neg: error
+ */
+int dfu_delta_base_update(u32_t scratch_offset, u32_t fw_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DFU_DELTA_H__ */
@@ -48,10 +48,12 @@ LOG_MODULE_REGISTER(dfu_drv, 3);
 #include "slip.h"
 #include "../app_uart.h"
 
-#define DFU_BUFF_SIZE				(UART_SLIP_SIZE_MAX * 2 + 1)
+#define DFU_TX_BUFF_SIZE			(UART_SLIP_SIZE_MAX * 2 + 1)
+#define DFU_BUFF_SIZE				(UART_SLIP_RSP_SIZE_MAX * 2 + 1)
 #define DFU_RX_MAX_DELAY			1000				// in milliseconds
 
 static uart_buff_t m_dfu_buff;
+static u8_t m_tx_buff[DFU_TX_BUFF_SIZE];		// Not shared with RX, a response may come while sending
 static bool slip_pkt_ready;
 
 /**@brief Check a slip packet
@@ -84,9 +86,9 @@ int dfu_drv_tx(const u8_t *p_data, u16_t length)
 		rc = -3;
 	}
 	else {
-		encode_slip(m_dfu_buff.p_data, &slip_pkt_len, p_data, length);
+		encode_slip(m_tx_buff, &slip_pkt_len, p_data, length);
 
-		rc = app_uart_send(m_dfu_buff.p_data, slip_pkt_len);
+		rc = app_uart_send(m_tx_buff, slip_pkt_len);
 	}
 
 	return rc;
@@ -50,7 +50,16 @@
 extern "C" {
 #endif  /* __cplusplus */
 
-#define UART_SLIP_SIZE_MAX		128
+/* Max size of a request before SLIP encoding. The MTU reported by the
+ * bootloader is used up to (UART_SLIP_SIZE_MAX * 2 + 1), it covers the
+ * largest NRF_DFU_SERIAL_UART_PAYLOAD_SIZE of the bootloader.
+ */
+#ifndef UART_SLIP_SIZE_MAX
+#define UART_SLIP_SIZE_MAX		1025
+#endif
+
+/* Max size of a response before SLIP encoding */
+#define UART_SLIP_RSP_SIZE_MAX	64
 
 
 /**@brief Initialize serial DFU driver
@@ -26,6 +26,21 @@ LOG_MODULE_REGISTER(dfu_serial_file, 3);
 #define FILE_OFFSET_IP_SIZE         24
 #define FILE_OFFSET_FW_ADDR         28
 #define FILE_OFFSET_FW_SIZE         32
+#define FILE_OFFSET_FILE_SIZE       8
+#define FILE_OFFSET_IMAGE_COUNT     12
+
+// Image table, each image: type[4], ip addr[4], ip size[4],
+// fw addr[4], fw size[4], fw crc[4]
+#define FILE_OFFSET_IMAGE_TABLE     16
+#define FILE_IMAGE_ENTRY_LEN        24
+
+// Offset of delta file header elements
+#define FILE_OFFSET_PATCH_ADDR      28
+#define FILE_OFFSET_PATCH_SIZE      32
+#define FILE_OFFSET_BASE_SIZE       36
+#define FILE_OFFSET_BASE_CRC        40
+#define FILE_OFFSET_TARGET_SIZE     44
+#define FILE_OFFSET_TARGET_CRC      48
 
 static u32_t fa_addr_base;
 
@@ -67,6 +82,7 @@ static int _flash_read(u32_t offset, u8_t* p_data,
  * @return IMAGE_TYPE_NRF91: Mcuboot file for nrf91
  * @return IMAGE_TYPE_NRF52: SDK DFU file for nrf52
  * @return IMAGE_TYPE_MODEM: SDK DFU file for nrf91 modem
+ * @return IMAGE_TYPE_NRF52_DELTA: SDK DFU delta file for nrf52
  * @return IMAGE_TYPE_ERROR: unknown file type
  */
 int dfu_file_type(void)
@@ -85,6 +101,9 @@ int dfu_file_type(void)
         if (magic_number_2 == MAGIC_NUMBER_SDK_DFU) {
             return IMAGE_TYPE_NRF52;
         }
+        else if (magic_number_2 == MAGIC_NUMBER_SDK_DELTA) {
+            return IMAGE_TYPE_NRF52_DELTA;
+        }
         else {
             return IMAGE_TYPE_NRF91;
         }        
@@ -133,3 +152,108 @@ void dfu_file_info(u32_t* ip_addr, u32_t* ip_size,
     LOG_DBG("fw size: %08x", *fw_size);
 }
 
+/**@brief Get image count of SDK DFU file
+ *
+ * @return image count, 0 if the image table is invalid
+ */
+u32_t dfu_file_image_count(void)
+{
+    u8_t p_data[4];
+    u32_t count;
+
+    _flash_read(FILE_OFFSET_IMAGE_COUNT, p_data, sizeof(p_data));
+
+    count = sys_get_le32(p_data);
+
+    if (count == 0 || count > DFU_IMAGE_COUNT_MAX) {
+        LOG_ERR("Invalid image count: %d", count);
+        return 0;
+    }
+
+    return count;
+}
+
+/**@brief Get image info of SDK DFU file
+ *
+ * @param[in] index: index of the image
+ * @param[out] p_image: pointer of image info
+ *
+ * @return 0: success
+ * @return neg: error
+ */
+int dfu_file_image_get(u32_t index, dfu_image_t* p_image)
+{
+    int rc;
+    u8_t p_entry[FILE_IMAGE_ENTRY_LEN];
+
+    if (index >= dfu_file_image_count()) {
+        return -EINVAL;
+    }
+
+    rc = _flash_read(FILE_OFFSET_IMAGE_TABLE + index * FILE_IMAGE_ENTRY_LEN,
+            p_entry, sizeof(p_entry));
+    if (rc) {
+        return rc;
+    }
+
+    p_image->type = sys_get_le32(&p_entry[0]);
+    p_image->ip_addr = fa_addr_base + sys_get_le32(&p_entry[4]);
+    p_image->ip_size = sys_get_le32(&p_entry[8]);
+    p_image->fw_addr = fa_addr_base + sys_get_le32(&p_entry[12]);
+    p_image->fw_size = sys_get_le32(&p_entry[16]);
+    p_image->fw_crc = sys_get_le32(&p_entry[20]);
+
+    LOG_DBG("image %d, type: %d, fw size: %08x, crc: %08x", index,
+            p_image->type, p_image->fw_size, p_image->fw_crc);
+
+    return 0;
+}
+
+/**@brief Get DFU delta file info
+ *
+ * @details patch address[4], patch size[4], base size[4], base crc[4],
+ * firmware size[4], firmware crc[4]
+ *
+ * @param[out] patch_addr: patch address
+ * @param[out] patch_size: patch size
+ * @param[out] base_size: size of the firmware which the patch is based on
+ * @param[out] base_crc: crc32 of the firmware which the patch is based on
+ * @param[out] fw_size: size of the firmware reconstructed by the patch
+ * @param[out] fw_crc: crc32 of the firmware reconstructed by the patch
+ *
+ * @return n/a
+ */
+void dfu_file_delta_info(u32_t* patch_addr, u32_t* patch_size,
+        u32_t* base_size, u32_t* base_crc, u32_t* fw_size, u32_t* fw_crc)
+{
+    u8_t p_file_header[FILE_HEADER_LEN];
+    memset(p_file_header, 0, FILE_HEADER_LEN);
+
+    _flash_read(FILE_HEADER_OFFSET, p_file_header, FILE_HEADER_LEN);
+
+    *patch_addr = fa_addr_base + sys_get_le32(&p_file_header[FILE_OFFSET_PATCH_ADDR]);
+    *patch_size = sys_get_le32(&p_file_header[FILE_OFFSET_PATCH_SIZE]);
+
+    *base_size = sys_get_le32(&p_file_header[FILE_OFFSET_BASE_SIZE]);
+    *base_crc = sys_get_le32(&p_file_header[FILE_OFFSET_BASE_CRC]);
+    *fw_size = sys_get_le32(&p_file_header[FILE_OFFSET_TARGET_SIZE]);
+    *fw_crc = sys_get_le32(&p_file_header[FILE_OFFSET_TARGET_CRC]);
+
+    LOG_DBG("patch addr: %08x", *patch_addr);
+    LOG_DBG("patch size: %08x", *patch_size);
+    LOG_DBG("base size: %08x, crc: %08x", *base_size, *base_crc);
+    LOG_DBG("fw size: %08x, crc: %08x", *fw_size, *fw_crc);
+}
+
+/**@brief Get DFU file size, including the file CRC
+ *
+ * @return file size
+ */
+u32_t dfu_file_size(void)
+{
+    u8_t p_data[4];
+
+    _flash_read(FILE_OFFSET_FILE_SIZE, p_data, sizeof(p_data));
+
+    return sys_get_le32(p_data);
+}
@@ -9,17 +9,40 @@ extern "C" {
 
 #define MAGIC_NUMBER_MCUBOOT	0x96f3b83d
 #define MAGIC_NUMBER_SDK_DFU    0x49535951
+#define MAGIC_NUMBER_SDK_DELTA  0x49535944
 #define MAGIC_NUMBER_MODEM      0x7544656d
 
 #define IMAGE_TYPE_NRF52		0           /* SDK DFU file for nrf52 firmware */
 #define IMAGE_TYPE_NRF91		1           /* Mcuboot file for nrf91 firmware */
 #define IMAGE_TYPE_MODEM		2           /* Mcuboot file for nrf91 modem */
+#define IMAGE_TYPE_NRF52_DELTA	3           /* SDK DFU delta file for nrf52 firmware */
 #define IMAGE_TYPE_ERROR		(-1)        /* Unknown file type */
 
+/* Image types in the image table of SDK DFU file */
+#define DFU_IMAGE_APPLICATION			0
+#define DFU_IMAGE_BOOTLOADER			1
+#define DFU_IMAGE_SOFTDEVICE			2
+#define DFU_IMAGE_SOFTDEVICE_BOOTLOADER	3
+
+#define DFU_IMAGE_COUNT_MAX		4
+#define DFU_IMAGE_NO_CRC		0xFFFFFFFF  /* Files made before image CRC is added */
+
+/**@typedef image info of SDK DFU file */
+typedef struct
+{
+    u32_t type;                 /* DFU_IMAGE_xxx */
+    u32_t ip_addr;              /* Address of init packet */
+    u32_t ip_size;              /* Size of init packet */
+    u32_t fw_addr;              /* Address of firmware bin */
+    u32_t fw_size;              /* Size of firmware bin */
+    u32_t fw_crc;               /* CRC32 of firmware bin */
+} dfu_image_t;
+
 /**@brief Get DFU file type
  *
  * @return IMAGE_TYPE_NRF91: Mcuboot file for nrf91
  * @return IMAGE_TYPE_NRF52: SDK DFU file for nrf52
+ * @return IMAGE_TYPE_NRF52_DELTA: SDK DFU delta file for nrf52
  * @return IMAGE_TYPE_ERROR: unknown file type
  */
 int dfu_file_type(void);
@@ -34,6 +57,39 @@ int dfu_file_type(void);
 void dfu_file_info(u32_t* ip_addr, u32_t* ip_size,
     u32_t* fw_addr, u32_t* fw_size);
 
+/**@brief Get image count of SDK DFU file
+ *
+ * @return image count, 0 if the image table is invalid
+ */
+u32_t dfu_file_image_count(void);
+
+/**@brief Get image info of SDK DFU file
+ *
+ * @details Images are stored in the order they must be sent,
+ * softdevice and bootloader go before application.
+ *
+ * @param[in] index: index of the image
+ * @param[out] p_image: pointer of image info
+ *
+ * @return 0: success
+ * @return neg: error
+ */
+int dfu_file_image_get(u32_t index, dfu_image_t* p_image);
+
+/**@brief Get DFU delta file info
+ *
+ * @details patch address[4], patch size[4], base size[4], base crc[4],
+ * firmware size[4], firmware crc[4]. Init packet info is the same as
+ * dfu_file_info().
+ *
+ * @return n/a
+ */
+void dfu_file_delta_info(u32_t* patch_addr, u32_t* patch_size,
+    u32_t* base_size, u32_t* base_crc, u32_t* fw_size, u32_t* fw_crc);
+
+/**@brief Get DFU file size, including the file CRC */
+u32_t dfu_file_size(void);
+
 #ifdef __cplusplus
 }
 #endif
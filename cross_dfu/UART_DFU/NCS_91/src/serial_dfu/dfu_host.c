@@ -47,9 +47,15 @@ LOG_MODULE_REGISTER(dfu_req, 3);
 #include "dfu_host.h"
 #include "crc32.h"
 #include "dfu_drv.h"
+#include "dfu_crc_cache.h"
+#include "slip.h"
 
 #define REQ_DATA_SIZE_MAX		UART_SLIP_SIZE_MAX
-#define RSP_DATA_SIZE_MAX		UART_SLIP_SIZE_MAX
+#define RSP_DATA_SIZE_MAX		UART_SLIP_RSP_SIZE_MAX
+#define REQ_MTU_MAX				(REQ_DATA_SIZE_MAX * 2 + 1)	// SLIP packet size of the largest request
+#define OBJ_DATA_SIZE_MAX		4096			// Data object size of the SDK bootloader
+
+#define SLIP_BYTE_LEN(data)		(((data) == SLIP_END || (data) == SLIP_ESC) ? 2 : 1)
 
 /**
 * @brief DFU protocol operation.
@@ -116,6 +122,13 @@ static u16_t mtu = 0;
 
 static u8_t send_data[REQ_DATA_SIZE_MAX];
 static u8_t receive_data[RSP_DATA_SIZE_MAX];
+static u8_t obj_data[OBJ_DATA_SIZE_MAX];
+
+static const u8_t* fw_data;
+
+static u32_t stat_payload_bytes;
+static u32_t stat_wire_bytes;
+static u32_t stat_packets;
 
 static u16_t get_u16_le(const u8_t* p_data)
 {
@@ -270,9 +283,10 @@ static int req_get_mtu(u16_t* p_mtu)
 			{
 				u16_t mtu = get_u16_le(receive_data + 3);
 
-				*p_mtu = mtu;
+				// Larger bootloader RX buffers are used as far as the local buffers allow
+				*p_mtu = MIN(mtu, REQ_MTU_MAX);
 
-				LOG_INF("MTU: %d", mtu);
+				LOG_INF("MTU: %d, used: %d", mtu, *p_mtu);
 			}
 			else
 			{
@@ -345,13 +359,16 @@ static int req_obj_create(u8_t obj_type, u32_t obj_size)
 	return rc;
 }
 
-static int stream_data(const u8_t* p_data, u32_t data_size)
+static int stream_data(const u8_t* p_data, u32_t data_size, u32_t offset)
 {
 	LOG_DBG("%s", __func__);	
 
 	int rc = 0;
 	u32_t pos, stp;
-	u32_t stp_max = 5;
+	u32_t stp_max = REQ_DATA_SIZE_MAX - 1;
+	u32_t slip_max = 0;
+	u32_t slip_len;
+	u8_t data;
 
 	if (p_data == NULL || !data_size)
 	{
@@ -360,9 +377,11 @@ static int stream_data(const u8_t* p_data, u32_t data_size)
 
 	if (!rc)
 	{
-		if (mtu >= 5)
+		// Op code and SLIP_END are never escaped, at least 7 bytes of data
+		// fit in a packet, so a word is left after the alignment below
+		if (mtu >= 16)
 		{
-			stp_max = (mtu - 1) / 2 - 1;
+			slip_max = mtu - 2;
 		}
 		else
 		{
@@ -377,9 +396,38 @@ static int stream_data(const u8_t* p_data, u32_t data_size)
 	for (pos = 0; !rc && pos < data_size; pos += stp)
 	{
 		send_data[0] = NRF_DFU_OP_OBJECT_WRITE;
-		stp = MIN((data_size - pos), stp_max);
+
+		// Fill the SLIP packet up to MTU, only escaped bytes take 2 bytes
+		slip_len = 0;
+		for (stp = 0; stp < stp_max && pos + stp < data_size; stp++)
+		{
+			data = p_data[pos + stp];
+
+			if (slip_len + SLIP_BYTE_LEN(data) > slip_max)
+			{
+				break;
+			}
+
+			slip_len += SLIP_BYTE_LEN(data);
+		}
+
+		// Only the last chunk may end in the middle of a word, so the
+		// flash writes of the bootloader stay aligned
+		if (pos + stp < data_size)
+		{
+			while ((offset + pos + stp) & 3)
+			{
+				stp--;
+				slip_len -= SLIP_BYTE_LEN(p_data[pos + stp]);
+			}
+		}
+
 		memcpy(send_data + 1, p_data + pos, stp);
 		rc = send_raw(send_data, stp + 1);
+
+		stat_payload_bytes += stp;
+		stat_wire_bytes += slip_len + 2;
+		stat_packets++;
 	}
 
 	return rc;
@@ -447,7 +495,7 @@ static int stream_data_crc(const u8_t* p_data, u32_t data_size, u32_t pos, u32_t
 
 	LOG_DBG("Streaming Data: len:%u offset:%u crc:0x%08X", data_size, pos, *p_crc);
 
-	rc = stream_data(p_data, data_size);
+	rc = stream_data(p_data, data_size, pos);
 
 	if (!rc)
 	{
@@ -529,7 +577,35 @@ static int try_recover_ip(const u8_t* p_data, u32_t data_size,
 	return rc;
 }
 
-static int try_recover_fw(const u8_t* p_data, u32_t data_size,
+static int read_crc(dfu_host_read_t read, u32_t length, u32_t* p_crc)
+{
+	LOG_DBG("%s", __func__);
+
+	int rc = 0;
+	u32_t pos, stp;
+	u32_t crc_32 = 0;
+
+	// Start from the nearest checkpoint, at most one object is hashed
+	dfu_crc_cache_find(length, &pos, &crc_32);
+
+	for (; !rc && pos < length; pos += stp)
+	{
+		stp = MIN((length - pos), DFU_CRC_CACHE_INTERVAL - pos % DFU_CRC_CACHE_INTERVAL);
+
+		rc = read(pos, obj_data, stp);
+		if (!rc)
+		{
+			crc_32 = crc32_compute(obj_data, stp, &crc_32);
+			dfu_crc_cache_put(pos + stp, crc_32);
+		}
+	}
+
+	*p_crc = crc_32;
+
+	return rc;
+}
+
+static int try_recover_fw(dfu_host_read_t read, u32_t data_size,
 						  nrf_dfu_response_select_t* p_rsp_recover,
 						  const nrf_dfu_response_select_t* p_rsp_select)
 {
@@ -554,9 +630,14 @@ static int try_recover_fw(const u8_t* p_data, u32_t data_size,
 	else if (pos_start > 0)
 	{
 		max_size = p_rsp_select->max_size;
-		crc_32 = crc32_compute(p_data, pos_start, NULL);
 		len_remain = pos_start % max_size;
 
+		rc = read_crc(read, pos_start, &crc_32);
+		if (rc)
+		{
+			return rc;
+		}
+
 		if (p_rsp_select->crc != crc_32)
 		{
 			pos_start -= ((len_remain > 0) ? len_remain : max_size);
@@ -567,9 +648,18 @@ static int try_recover_fw(const u8_t* p_data, u32_t data_size,
 
 		if (len_remain > 0)
 		{
-			stp_size = max_size - len_remain;
+			stp_size = MIN((max_size - len_remain), (data_size - pos_start));
+
+			// The whole image may be sent while the last object is not executed
+			if (stp_size > 0)
+			{
+				rc = read(pos_start, obj_data, stp_size);
+				if (!rc)
+				{
+					rc = stream_data_crc(obj_data, stp_size, pos_start, &crc_32);
+				}
+			}
 
-			rc = stream_data_crc(p_data + pos_start, stp_size, pos_start, &crc_32);
 			if (!rc)
 			{
 				pos_start += stp_size;
@@ -595,6 +685,27 @@ static int try_recover_fw(const u8_t* p_data, u32_t data_size,
 	return rc;
 }
 
+static void stream_report(void)
+{
+	if (stat_wire_bytes > 0)
+	{
+		LOG_INF("Payload: %u bytes, packets: %u, UART: %u bytes, efficiency: %u%%",
+				stat_payload_bytes, stat_packets, stat_wire_bytes,
+				(u32_t)((u64_t)stat_payload_bytes * 100 / stat_wire_bytes));
+	}
+
+	stat_payload_bytes = 0;
+	stat_wire_bytes = 0;
+	stat_packets = 0;
+}
+
+static int read_flat(u32_t offset, u8_t* p_data, u32_t length)
+{
+	memcpy(p_data, fw_data + offset, length);
+
+	return 0;
+}
+
 bool dfu_host_bl_mode_check(void)
 {
 	int rc;
@@ -610,6 +721,21 @@ bool dfu_host_bl_mode_check(void)
 	return rc == 0;
 }
 
+bool dfu_host_bl_mode_wait(u32_t timeout_ms)
+{
+	int rc = 1;
+	u32_t start_time;
+
+	start_time = k_uptime_get_32();
+
+	// Each ping waits for response up to 1 second
+	while (rc && k_uptime_get_32() - start_time < timeout_ms) {
+		rc = req_ping(ping_id++);
+	}
+
+	return rc == 0;
+}
+
 int dfu_host_setup(void)
 {
 	int rc;
@@ -689,6 +815,20 @@ int dfu_host_send_ip(const u8_t* p_data, u32_t data_size)
 }
 
 int dfu_host_send_fw(const u8_t* p_data, u32_t data_size)
+{
+	if (p_data == NULL)
+	{
+		LOG_ERR("Invalid firmware data!");
+
+		return 1;
+	}
+
+	fw_data = p_data;
+
+	return dfu_host_send_fw_stream(read_flat, data_size);
+}
+
+int dfu_host_send_fw_stream(dfu_host_read_t read, u32_t data_size)
 {
 	int rc = 0;
 	u32_t max_size, stp_size, pos;
@@ -696,10 +836,15 @@ int dfu_host_send_fw(const u8_t* p_data, u32_t data_size)
 	nrf_dfu_response_select_t rsp_select;
 	nrf_dfu_response_select_t rsp_recover;
 	u32_t pos_start;
+	u32_t start_time;
 
 	LOG_INF("Sending firmware file...");
 
-	if (p_data == NULL || !data_size)
+	stat_payload_bytes = 0;
+	stat_wire_bytes = 0;
+	stat_packets = 0;
+
+	if (read == NULL || !data_size)
 	{
 		LOG_ERR("Invalid firmware data!");
 
@@ -713,7 +858,19 @@ int dfu_host_send_fw(const u8_t* p_data, u32_t data_size)
 
 	if (!rc)
 	{
-		rc = try_recover_fw(p_data, data_size, &rsp_recover, &rsp_select);
+		if (rsp_select.max_size > sizeof(obj_data))
+		{
+			LOG_ERR("Object size too big (%u)!", rsp_select.max_size);
+
+			rc = 1;
+		}
+	}
+
+	if (!rc)
+	{
+		start_time = k_uptime_get_32();
+
+		rc = try_recover_fw(read, data_size, &rsp_recover, &rsp_select);
 	}
 
 	if (!rc)
@@ -721,28 +878,39 @@ int dfu_host_send_fw(const u8_t* p_data, u32_t data_size)
 		max_size = rsp_select.max_size;
 
 		pos_start = rsp_recover.offset;
-		crc_32 = crc32_compute(p_data, pos_start, &crc_32);
+		rc = read_crc(read, pos_start, &crc_32);
 
-		for (pos = pos_start; pos < data_size; pos += stp_size)
+		if (pos_start > 0)
+		{
+			LOG_INF("Resume at %u, took %u ms", pos_start, k_uptime_get_32() - start_time);
+		}
+
+		for (pos = pos_start; !rc && pos < data_size; pos += stp_size)
 		{
 			stp_size = MIN((data_size - pos), max_size);
 
-			rc = req_obj_create(0x02, stp_size);
+			rc = read(pos, obj_data, stp_size);
 
 			if (!rc)
 			{
-				rc = stream_data_crc(p_data + pos, stp_size, pos, &crc_32);
+				rc = req_obj_create(0x02, stp_size);
 			}
 
 			if (!rc)
 			{
-				rc = req_obj_execute();
+				rc = stream_data_crc(obj_data, stp_size, pos, &crc_32);
 			}
 
-			if (rc)
-				break;
+			if (!rc)
+			{
+				dfu_crc_cache_put(pos + stp_size, crc_32);
+
+				rc = req_obj_execute();
+			}
 		}
 	}
 
+	stream_report();
+
 	return rc;
 }
@@ -49,6 +49,20 @@
 extern "C" {
 #endif  /* __cplusplus */
 
+/**@brief Firmware data reader
+ *
+ * @details Used to stream a firmware image that is not stored as a flat
+ * bin in flash, e.g. one which is reconstructed from a delta patch.
+ *
+ * @param[in] offset: offset from the start of the firmware image
+ * @param[out] p_data: pointer of data
+ * @param[in] length: length of data to be read
+ *
+ * @return 0: success
+ * @return neg: error
+ */
+typedef int (*dfu_host_read_t)(u32_t offset, u8_t *p_data, u32_t length);
+
 /**@brief Set up a DFU procedure */
 int dfu_host_setup(void);
 
@@ -58,9 +72,15 @@ int dfu_host_send_ip(const u8_t *p_data, u32_t data_size);
 /**@brief Start to send firmware bin */
 int dfu_host_send_fw(const u8_t *p_data, u32_t data_size);
 
+/**@brief Start to send firmware bin through a data reader */
+int dfu_host_send_fw_stream(dfu_host_read_t read, u32_t data_size);
+
 /**@brief Check if it's in bootloader mode */
 bool dfu_host_bl_mode_check(void);
 
+/**@brief Wait until bootloader responds, e.g. after it's updated */
+bool dfu_host_bl_mode_wait(u32_t timeout_ms);
+
 #ifdef __cplusplus
 }   /* ... extern "C" */
 #endif  /* __cplusplus */
@@ -39,15 +39,25 @@
 */
 #include <zephyr.h>
 #include <device.h>
+#include <sys/util.h>
 #include <logging/log.h>
 LOG_MODULE_REGISTER(serial_dfu, 3);
 
 #include "dfu_drv.h"
 #include "dfu_host.h"
 #include "dfu_file.h"
+#include "dfu_delta.h"
+#include "dfu_crc_cache.h"
+#include "crc32.h"
+
+#define BL_REDETECT_TIMEOUT		30000		// in milliseconds, SD + BL activation takes seconds
 
 static struct k_work wk_start_dfu;
 
+static const char* image_type_str[] = {
+	"application", "bootloader", "softdevice", "softdevice_bootloader"
+};
+
 /**@brief Start to send DFU file
  *
  * @param[in] ip_addr: address of init packet
@@ -78,31 +88,220 @@ static int dfu_file_send(u32_t ip_addr, u32_t ip_size, u32_t fw_addr, u32_t fw_s
 	return err_code;
 }
 
+/**@brief Check the CRC of an image
+ *
+ * @details CRC checkpoints are saved on the way, so the image is hashed
+ * only once, the checkpoints are used again to resume the transfer.
+ *
+ * @param[in] p_image: pointer of the image
+ *
+ * @return 0: success
+ * @return neg: error
+ */
+static int image_crc_check(const dfu_image_t* p_image)
+{
+	u32_t pos, stp;
+	u32_t crc_32;
+
+	dfu_crc_cache_find(p_image->fw_size, &pos, &crc_32);
+
+	for (; pos < p_image->fw_size; pos += stp) {
+		stp = MIN(p_image->fw_size - pos, DFU_CRC_CACHE_INTERVAL);
+		crc_32 = crc32_compute((u8_t*)p_image->fw_addr + pos, stp, &crc_32);
+		dfu_crc_cache_put(pos + stp, crc_32);
+	}
+
+	if (crc_32 != p_image->fw_crc) {
+		LOG_ERR("Invalid image CRC (0x%08X -> 0x%08X)", p_image->fw_crc, crc_32);
+		return -EIO;
+	}
+
+	return 0;
+}
+
+/**@brief Start to send all images of DFU file
+ *
+ * @details Images are sent back-to-back, nrf52 resets after each image
+ * is activated, so bootloader is detected again before next image.
+ *
+ * @param[out] p_app: application image, type is set to DFU_IMAGE_COUNT_MAX
+ * if there is no application image
+ *
+ * @return 0: success
+ * @return neg: error
+ */
+static int dfu_images_send(dfu_image_t* p_app)
+{
+	int err_code = 0;
+	u32_t count;
+	dfu_image_t image;
+
+	p_app->type = DFU_IMAGE_COUNT_MAX;
+
+	count = dfu_file_image_count();
+	if (count == 0) {
+		return -EINVAL;
+	}
+
+	for (u32_t i = 0; !err_code && i < count; i++) {
+		err_code = dfu_file_image_get(i, &image);
+		if (err_code) {
+			break;
+		}
+
+		if (image.type > DFU_IMAGE_SOFTDEVICE_BOOTLOADER) {
+			LOG_ERR("Invalid image type: %d", image.type);
+			return -EINVAL;
+		}
+
+		dfu_crc_cache_open(i, image.fw_size, image.fw_crc);
+
+		if (image.fw_crc != DFU_IMAGE_NO_CRC) {
+			err_code = image_crc_check(&image);
+			if (err_code) {
+				return err_code;
+			}
+		}
+
+		if (i > 0) {
+			LOG_INF("Wait for bootloader...");
+
+			if (!dfu_host_bl_mode_wait(BL_REDETECT_TIMEOUT)) {
+				LOG_ERR("No bootloader after image %d", i - 1);
+				return -ETIMEDOUT;
+			}
+		}
+
+		LOG_INF("Image %d/%d: %s", i + 1, count, image_type_str[image.type]);
+
+		err_code = dfu_file_send(image.ip_addr, image.ip_size,
+			image.fw_addr, image.fw_size);
+
+		if (image.type == DFU_IMAGE_APPLICATION) {
+			*p_app = image;
+		}
+	}
+
+	return err_code;
+}
+
+/**@brief Start to send DFU delta file
+ *
+ * @details Firmware is reconstructed from the base firmware and the
+ * patch, and streamed to nrf52 object by object.
+ *
+ * @param[in] ip_addr: address of init packet
+ * @param[in] ip_size: file size of init packet
+ * @param[out] p_fw_size: size of the reconstructed firmware
+ *
+ * @return 0: success
+ * @return neg: error
+ */
+static int dfu_delta_file_send(u32_t ip_addr, u32_t ip_size, u32_t* p_fw_size)
+{
+	int err_code;
+
+	u32_t patch_addr = 0;
+	u32_t patch_size = 0;
+	u32_t base_size = 0;
+	u32_t base_crc = 0;
+	u32_t fw_size = 0;
+	u32_t fw_crc = 0;
+
+	u8_t* p_ip_data = (u8_t*)ip_addr;
+
+	dfu_file_delta_info(&patch_addr, &patch_size, &base_size, &base_crc,
+		&fw_size, &fw_crc);
+
+	err_code = dfu_delta_init((u8_t*)patch_addr, patch_size, base_size, base_crc);
+
+	if (!err_code) {
+		dfu_crc_cache_open(0, fw_size, fw_crc);
+	}
+
+	// Don't touch nrf52 if the patch can't produce the target firmware
+	if (!err_code) {
+		err_code = dfu_delta_verify(fw_size, fw_crc);
+	}
+
+	if (!err_code) {
+		err_code = dfu_host_setup();
+	}
+
+	if (!err_code) {
+		err_code = dfu_host_send_ip(p_ip_data, ip_size);
+	}
+
+	if (!err_code) {
+		err_code = dfu_host_send_fw_stream(dfu_delta_read, fw_size);
+	}
+
+	*p_fw_size = fw_size;
+
+	return err_code;
+}
+
 /**@brief Handler for start dfu worker */
 static void wk_start_dfu_handler(struct k_work* unused)
 {
 	int rc;
+	int img_type;
 
 	u32_t ip_addr = 0;
 	u32_t ip_size = 0;
 	u32_t fw_addr = 0;
 	u32_t fw_size = 0;
+	dfu_image_t app;
+
+	img_type = dfu_file_type();
 
-	if (dfu_file_type() != IMAGE_TYPE_NRF52) {
+	if (img_type != IMAGE_TYPE_NRF52 && img_type != IMAGE_TYPE_NRF52_DELTA) {
 		LOG_ERR("File type is invalid");
 		return;
 	}
 
 	LOG_INF("Start serial DFU...");
 
-	dfu_file_info(&ip_addr, &ip_size, &fw_addr, &fw_size);
+	if (img_type == IMAGE_TYPE_NRF52) {
+		rc = dfu_images_send(&app);
+	}
+	else {
+		LOG_INF("Delta file, reconstruct firmware from base");
+		dfu_file_info(&ip_addr, &ip_size, &fw_addr, &fw_size);
+		rc = dfu_delta_file_send(ip_addr, ip_size, &fw_size);
+	}
+
+	dfu_crc_cache_close();
 
-	rc = dfu_file_send(ip_addr, ip_size, fw_addr, fw_size);
 	if (rc == 0) {
 		LOG_INF("nRF52 Serial DFU success");
 	}
 	else {
 		LOG_ERR("DFU error: %d", rc);
+		return;
+	}
+
+	// Only a new application changes the base of next delta file
+	if (img_type == IMAGE_TYPE_NRF52 && app.type != DFU_IMAGE_APPLICATION) {
+		return;
+	}
+
+	// Keep the new nrf52 application as the base of next delta file,
+	// if it doesn't overlap the DFU file
+	if (dfu_file_size() > DELTA_BASE_OFFSET) {
+		rc = -ENOMEM;
+	}
+	else if (img_type == IMAGE_TYPE_NRF52) {
+		rc = dfu_delta_base_save((u8_t*)app.fw_addr, app.fw_size);
+	}
+	else {
+		rc = dfu_delta_base_update(dfu_file_size(), fw_size);
+	}
+
+	// The old base no longer matches nrf52, next DFU needs a full image
+	if (rc) {
+		LOG_ERR("Base firmware is not saved: %d", rc);
+		dfu_delta_base_invalidate();
 	}
 }
 
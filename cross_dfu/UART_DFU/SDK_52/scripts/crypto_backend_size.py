@@ -0,0 +1,173 @@
+"""
+Description: Code size of the secp256r1 signature check of each nrf_crypto backend
+
+The bootloader links the crypto libraries with --gc-sections, so only the
+sections reachable from the functions the backend calls take flash. They are
+followed through the relocations of the library objects, which gives the size
+of the library part without building the bootloader for each backend. The
+nrf_crypto backend glue, about 0.5 KB, is not included.
+
+readelf of the ARM toolchain, or llvm-readelf, is required.
+"""
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+
+
+SDK_EXTERNAL = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'sdk16.0', 'external')
+
+# Library and the functions called by the backend for init, SHA-256 and verify
+BACKENDS = (
+    ('micro-ecc', 'micro-ecc/nrf52hf_armgcc/armgcc/micro_ecc_lib_nrf52.a',
+     ('uECC_verify', 'uECC_secp256r1'), ()),
+    ('Oberon', 'nrf_oberon/lib/cortex-m4/hard-float/liboberon_3.0.1.a',
+     ('ocrypto_ecdsa_p256_verify_hash',), ()),
+    ('CC310_BL', 'nrf_cc310_bl/lib/cortex-m4/hard-float/libnrf_cc310_bl_0.9.12.a',
+     ('nrf_cc310_bl_init', 'nrf_cc310_bl_ecdsa_verify_secp256r1'),
+     ('nrf_cc310_bl_hash_sha256_init', 'nrf_cc310_bl_hash_sha256_update',
+      'nrf_cc310_bl_hash_sha256_finalize')),
+)
+
+SECTION_LINE = re.compile(r'^\s*\[\s*(\d+)\]\s+(\S+)\s+\S+\s+[0-9a-fA-F]+\s+[0-9a-fA-F]+\s+([0-9a-fA-F]+)\s+\S+\s+(\S*)')
+RELOC_SECTION = re.compile(r"^Relocation section '\.rela?(\S+)'")
+SYMBOL_LINE = re.compile(r'^\s*\d+:\s+[0-9a-fA-F]+\s+\d+\s+\S+\s+(\S+)\s+\S+\s+(\S+)\s+(\S+)')
+RELOC_LINE = re.compile(r'^[0-9a-fA-F]{8}\s+[0-9a-fA-F]{8}\s+\S+\s+[0-9a-fA-F]{8}\s+(\S+)')
+
+
+def find_readelf():
+    for tool in ('arm-none-eabi-readelf', 'llvm-readelf'):
+        if shutil.which(tool):
+            return tool
+    print('No readelf found, add arm-none-eabi-readelf or llvm-readelf to PATH')
+    exit(1)
+
+
+def ar_members(path):
+    """
+    Yield name and data of each object in an archive, GNU format.
+    """
+    with open(path, 'rb') as f:
+        data = f.read()
+
+    names = b''
+    pos = 8
+    while pos + 60 <= len(data):
+        header = data[pos:pos + 60]
+        name = header[:16].decode().strip()
+        size = int(header[48:58])
+        body = data[pos + 60:pos + 60 + size]
+        pos += 60 + size + (size & 1)
+
+        if name == '//':
+            names = body
+        elif name.startswith('/') and name[1:].isdigit():
+            start = int(name[1:])
+            yield names[start:names.index(b'/\n', start)].decode(), body
+        elif name not in ('/', '/SYM64/'):
+            yield name.rstrip('/'), body
+
+
+def parse_object(readelf, path):
+    """
+    Return sections {name: size}, symbols {name: (section, global)} and
+    relocations {section: [symbol]} of an object.
+    """
+    out = subprocess.run([readelf, '-S', '-s', '-r', '-W', path],
+                         capture_output=True, text=True).stdout
+    index = {}
+    sections = {}
+    symbols = {}
+    relocs = {}
+    current = None
+
+    for line in out.splitlines():
+        m = RELOC_SECTION.match(line)
+        if m:
+            current = m.group(1)
+            relocs[current] = []
+            continue
+
+        m = SECTION_LINE.match(line)
+        if m and 'A' in m.group(4):
+            index[m.group(1)] = m.group(2)
+            sections[m.group(2)] = int(m.group(3), 16)
+            continue
+
+        m = SYMBOL_LINE.match(line)
+        if m:
+            current = None
+            if m.group(2) in index:
+                symbols.setdefault(m.group(3), (index[m.group(2)], m.group(1) != 'LOCAL'))
+            continue
+
+        m = RELOC_LINE.match(line)
+        if m and current is not None:
+            relocs[current].append(m.group(1))
+
+    return sections, symbols, relocs
+
+
+def reachable_size(readelf, library, entries):
+    """
+    Return the size of the sections reachable from the entry functions,
+    like the linker with --gc-sections.
+    """
+    objects = {}
+    with tempfile.TemporaryDirectory() as tmp:
+        for i, (name, body) in enumerate(ar_members(library)):
+            path = os.path.join(tmp, '{}_{}'.format(i, name))
+            with open(path, 'wb') as f:
+                f.write(body)
+            objects[name + str(i)] = parse_object(readelf, path)
+
+    exported = {}
+    for obj, (_, symbols, _) in objects.items():
+        for symbol, (section, is_global) in symbols.items():
+            if is_global:
+                exported.setdefault(symbol, (obj, section))
+
+    todo = [exported[e] for e in entries]
+    seen = set()
+    size = 0
+    while todo:
+        obj, section = todo.pop()
+        if (obj, section) in seen:
+            continue
+        seen.add((obj, section))
+
+        sections, symbols, relocs = objects[obj]
+        size += sections.get(section, 0)
+
+        for target in relocs.get(section, []):
+            if target in symbols and not symbols[target][1]:
+                todo.append((obj, symbols[target][0]))
+            elif target in exported:
+                todo.append(exported[target])
+            elif target in sections:
+                todo.append((obj, target))
+
+    return size
+
+
+if __name__ == '__main__':
+    """
+    Usage: python crypto_backend_size.py [sdk-external-dir]
+    """
+    external = sys.argv[1] if len(sys.argv) > 1 else SDK_EXTERNAL
+    readelf = find_readelf()
+
+    print('{:>10} {:>10} {:>10}'.format('backend', 'verify', 'sha-256'))
+    for name, library, verify, sha256 in BACKENDS:
+        path = os.path.join(external, library)
+        if not os.path.exists(path):
+            print('{:>10} {:>10}'.format(name, 'missing'))
+            continue
+
+        verify_size = reachable_size(readelf, path, verify)
+        sha256_size = reachable_size(readelf, path, verify + sha256) - verify_size if sha256 else 0
+        print('{:>10} {:>10} {:>10}'.format(name, verify_size, sha256_size if sha256 else '-'))
+
+    exit(0)
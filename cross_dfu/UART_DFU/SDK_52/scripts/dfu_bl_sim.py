@@ -0,0 +1,757 @@
+"""
+Description: Simulate the nRF52 serial DFU bootloader on a PC
+
+The simulator answers the DFU requests of nRF91 (or any serial DFU host) the same way
+as nrf_dfu_req_handler of SDK 16.0: object select/create/write/CRC/execute, PRN, MTU
+and ping. Flash erase/write timing, RX buffers and faults can be configured, so the
+transfer time and the recovery of the host can be measured with one DK and a USB-UART,
+or with a pty on the PC.
+"""
+import argparse
+import hashlib
+import os
+import random
+import time
+import tty
+import zlib
+
+
+# SLIP special characters
+SLIP_END = 0xC0
+SLIP_ESC = 0xDB
+SLIP_ESC_END = 0xDC
+SLIP_ESC_ESC = 0xDD
+
+# DFU op codes
+OP_PROTOCOL_VERSION = 0x00
+OP_OBJECT_CREATE = 0x01
+OP_RECEIPT_NOTIF_SET = 0x02
+OP_CRC_GET = 0x03
+OP_OBJECT_EXECUTE = 0x04
+OP_OBJECT_SELECT = 0x06
+OP_MTU_GET = 0x07
+OP_OBJECT_WRITE = 0x08
+OP_PING = 0x09
+OP_HARDWARE_VERSION = 0x0A
+OP_FIRMWARE_VERSION = 0x0B
+OP_ABORT = 0x0C
+OP_RESPONSE = 0x60
+
+# DFU result codes
+RES_SUCCESS = 0x01
+RES_OP_CODE_NOT_SUPPORTED = 0x02
+RES_INVALID_PARAMETER = 0x03
+RES_INSUFFICIENT_RESOURCES = 0x04
+RES_INVALID_OBJECT = 0x05
+RES_OPERATION_NOT_PERMITTED = 0x08
+RES_EXT_ERROR = 0x0B
+EXT_ERROR_VERIFICATION_FAILED = 0x0C
+
+OBJ_TYPE_COMMAND = 0x01
+OBJ_TYPE_DATA = 0x02
+
+# Payload length of requests, a damaged packet may be shorter
+REQUEST_PAYLOAD_MIN = {
+    OP_OBJECT_CREATE: 5,
+    OP_RECEIPT_NOTIF_SET: 2,
+    OP_OBJECT_SELECT: 1,
+    OP_OBJECT_WRITE: 1,
+    OP_PING: 1,
+    OP_FIRMWARE_VERSION: 1,
+}
+
+# Constants of the SDK bootloader
+NRF_DFU_PROTOCOL_VERSION = 0x01
+INIT_COMMAND_MAX_SIZE = 512
+DATA_OBJECT_MAX_SIZE = 4096
+CODE_PAGE_SIZE = 4096
+RX_BUF_SIZE = 256             # NRF_DFU_SERIAL_UART_PAYLOAD_SIZE
+UART_HW_FIFO_SIZE = 6
+COMBINE_BUFFERS = 2           # NRF_DFU_FLASH_COMBINE_BUFFERS
+
+
+def get_le16(number: int):
+    return number.to_bytes(2, 'little')
+
+
+def get_le32(number: int):
+    return number.to_bytes(4, 'little')
+
+
+def crc32(data, crc=0):
+    """ Same as crc32_compute() of SDK, crc of previous data can be continued """
+    return zlib.crc32(data, crc)
+
+
+def slip_encode(data):
+    out = bytearray()
+    for b in data:
+        if b == SLIP_END:
+            out.extend((SLIP_ESC, SLIP_ESC_END))
+        elif b == SLIP_ESC:
+            out.extend((SLIP_ESC, SLIP_ESC_ESC))
+        else:
+            out.append(b)
+    out.append(SLIP_END)
+    return bytes(out)
+
+
+class SlipDecoder:
+    """ Byte by byte decoder, works like slip_decode_add_byte() of SDK """
+    def __init__(self, buffer_len):
+        self.buffer_len = buffer_len
+        self.buffer = bytearray()
+        self.escaped = False
+        self.broken = False
+
+    def add_byte(self, b):
+        """ Return a packet when it is complete, or None """
+        if b == SLIP_END:
+            packet = None if self.broken or self.escaped or not self.buffer else bytes(self.buffer)
+            self.buffer = bytearray()
+            self.escaped = False
+            self.broken = False
+            return packet
+
+        if self.escaped:
+            self.escaped = False
+            if b == SLIP_ESC_END:
+                b = SLIP_END
+            elif b == SLIP_ESC_ESC:
+                b = SLIP_ESC
+            else:
+                self.broken = True
+        elif b == SLIP_ESC:
+            self.escaped = True
+            return None
+
+        if len(self.buffer) >= self.buffer_len:
+            self.broken = True
+        elif not self.broken:
+            self.buffer.append(b)
+
+        return None
+
+
+def pb_fields(data):
+    """ Walk the fields of a protobuf message, yield (field, value) """
+    pos = 0
+
+    def varint():
+        nonlocal pos
+        value = shift = 0
+        while True:
+            b = data[pos]
+            pos += 1
+            value |= (b & 0x7F) << shift
+            shift += 7
+            if not b & 0x80:
+                return value
+
+    while pos < len(data):
+        key = varint()
+        wire_type = key & 7
+        if wire_type == 0:
+            yield key >> 3, varint()
+        elif wire_type == 2:
+            length = varint()
+            yield key >> 3, data[pos:pos + length]
+            pos += length
+        elif wire_type == 5:
+            yield key >> 3, data[pos:pos + 4]
+            pos += 4
+        elif wire_type == 1:
+            yield key >> 3, data[pos:pos + 8]
+            pos += 8
+        else:
+            raise ValueError('Unsupported wire type')
+
+
+def init_command_parse(packet):
+    """ Get the firmware size and hash from an init packet, see dfu-cc.proto """
+    command = None
+    for field, value in pb_fields(packet):
+        if field == 1:
+            command = value
+        elif field == 2:
+            command = dict(pb_fields(value)).get(1)
+    if command is None:
+        raise ValueError('No command in init packet')
+
+    init = dict(pb_fields(command)).get(2)
+    if init is None:
+        raise ValueError('No init command')
+
+    fields = dict(pb_fields(init))
+    fw_size = fields.get(5, 0) + fields.get(6, 0) + fields.get(7, 0)
+    fw_hash = dict(pb_fields(fields[8])).get(2) if 8 in fields else None
+
+    return fw_size, fw_hash
+
+
+class Stats:
+    def __init__(self):
+        self.start = None
+        self.first_data = None
+        self.end = None
+        self.rx_bytes = 0
+        self.fw_bytes = 0
+        self.fw_offset_max = 0
+        self.resent_bytes = 0
+        self.objects = 0
+        self.object_retries = 0
+        self.requests = {}
+        self.invalid_packets = 0
+        self.no_buffer_drops = 0
+        self.stall_drops = 0
+        self.busy_drops = 0
+        self.dropped_bytes = 0
+        self.corrupted_packets = 0
+        self.resets = 0
+        self.recover_offset = None
+        self.postvalidation = None
+        self.verify = 0.0
+        self.verify_last = 0.0
+        self.erases_avoided = 0
+
+    def report(self, name):
+        end = self.end or time.monotonic()
+        total = end - self.start if self.start else 0
+        data_time = end - self.first_data if self.first_data else 0
+        print('---- {} ----'.format(name))
+        print('Total time:        {:.2f} s'.format(total))
+        if data_time > 0:
+            print('Data time:         {:.2f} s, {:.1f} kB/s'.format(data_time, self.fw_bytes / data_time / 1024))
+        print('Firmware bytes:    {}, resent: {}'.format(self.fw_bytes, self.resent_bytes))
+        print('UART bytes:        {}, overhead: {:.1f}%'.format(
+            self.rx_bytes, (self.rx_bytes - self.fw_bytes) * 100.0 / max(self.fw_bytes, 1)))
+        print('Objects:           {}, re-created: {}, erases avoided: {}'.format(
+            self.objects, self.object_retries, self.erases_avoided))
+        if self.verify:
+            print('Verify in flash:   {:.0f} ms, last object: {:.1f} ms'.format(self.verify * 1000,
+                                                                         self.verify_last * 1000))
+        if self.postvalidation is not None:
+            print('Postvalidation:    {:.0f} ms'.format(self.postvalidation * 1000))
+        if self.recover_offset is not None:
+            print('Resumed at:        0x{:X}'.format(self.recover_offset))
+        print('Requests:          {}'.format(', '.join(
+            '{:02X}: {}'.format(op, n) for op, n in sorted(self.requests.items()))))
+        print('Lost packets:      invalid slip: {}, no rx buffer: {}, flash stall: {}, combine busy: {}'.format(
+            self.invalid_packets, self.no_buffer_drops, self.stall_drops, self.busy_drops))
+        print('Injected faults:   dropped bytes: {}, corrupted packets: {}, resets: {}'.format(
+            self.dropped_bytes, self.corrupted_packets, self.resets))
+
+
+class DfuBootloaderSim:
+    """
+    The bootloader model, bytes received from UART go to feed(), bytes to be
+    sent back to UART are returned. It can be used without a serial port.
+    """
+    def __init__(self, args):
+        self.args = args
+        self.mtu = args.mtu
+        self.flash = bytearray([0xFF]) * args.bank_size
+        self.rand = random.Random(args.seed)
+        self.decoder = SlipDecoder(self.mtu - 1)
+        self.reset_at = sorted(args.reset_at)
+
+        # Settings saved in flash survive a reset
+        self.init_command = b''
+        self.init_command_valid = False
+        self.command_offset = 0
+        self.fw_size = 0
+        self.fw_hash = None
+        self.offset_last = 0
+        self.crc_last = 0
+        self.hash_offset_saved = None
+
+        self.sessions = 0
+        self.stats = Stats()
+        self.power_on()
+
+    def power_on(self):
+        """ RAM state after reset, the progress is lost unless it was saved """
+        self.decoder = SlipDecoder(self.mtu - 1)
+        self.prn = 0
+        self.prn_count = 0
+        self.current_object = OBJ_TYPE_COMMAND
+        self.data_object_size = 0
+        self.fw_offset = self.offset_last
+        self.fw_crc = self.crc_last
+        self.hash_offset = None
+        self.flash_free_at = 0.0
+        self.pending_buffers = []
+        self.combine_len = 0
+        self.combine_buffers = []
+        self.pre_erase_offset = 0 if self.init_command_valid else None
+        self.offline_until = 0.0
+
+    def now(self):
+        return time.monotonic()
+
+    def flash_busy(self, now):
+        return self.flash_free_at > now
+
+    def flash_erase(self, pages):
+        now = self.now()
+        self.flash_free_at = max(now, self.flash_free_at) + pages * self.args.erase_ms / 1000.0
+
+    def flash_write(self, length, buffers=None):
+        """ With SoftDevice, the RX buffer is held until the data is in flash """
+        now = self.now()
+        self.flash_free_at = max(now, self.flash_free_at) + (length + 3) // 4 * self.args.write_us / 1e6
+        if self.args.fstorage == 'sd':
+            (self.pending_buffers if buffers is None else buffers).append(self.flash_free_at)
+
+    def combine_busy(self):
+        """ NRF_ERROR_BUSY of nrf_dfu_flash_store_combined(), no buffer is free to start """
+        now = self.now()
+        while self.combine_buffers and self.combine_buffers[0] <= now:
+            self.combine_buffers.pop(0)
+        return not self.combine_len and len(self.combine_buffers) >= COMBINE_BUFFERS
+
+    def combine_write(self, length):
+        """ NRF_DFU_FLASH_COMBINE_SIZE, the RX buffer is free once the data is copied """
+        self.combine_len += length
+        if (self.fw_offset + length) % self.args.combine_size == 0:
+            self.combine_flush()
+
+    def combine_flush(self):
+        if self.combine_len:
+            self.flash_write(self.combine_len, self.combine_buffers)
+            self.combine_len = 0
+
+    def pre_erase_step(self):
+        """ NRF_DFU_PRE_ERASE_ENABLED, a page ahead of the current object is erased between requests """
+        if self.pre_erase_offset is None or not self.init_command_valid or self.flash_busy(self.now()):
+            return
+        page_end = (self.fw_size + CODE_PAGE_SIZE - 1) // CODE_PAGE_SIZE * CODE_PAGE_SIZE
+        offset = self.offset_last + self.data_object_size
+        offset = max(self.pre_erase_offset, (offset + CODE_PAGE_SIZE - 1) // CODE_PAGE_SIZE * CODE_PAGE_SIZE)
+        while offset < page_end and self.flash[offset:offset + CODE_PAGE_SIZE].count(0xFF) == CODE_PAGE_SIZE:
+            offset += CODE_PAGE_SIZE
+        if offset >= page_end:
+            self.pre_erase_offset = None
+            return
+        self.flash[offset:offset + CODE_PAGE_SIZE] = bytearray([0xFF]) * CODE_PAGE_SIZE
+        self.flash_erase(1)
+        if self.args.fstorage == 'nvmc':
+            self.flash_wait()
+        self.pre_erase_offset = offset + CODE_PAGE_SIZE
+
+    def cpu_hash(self, length):
+        """ SHA-256 blocks the main loop, like flash operations of NVMC """
+        time.sleep(length / 1024.0 * self.args.hash_us / 1e6)
+
+    def cpu_crc(self, length):
+        """ CRC32 of an object in flash, blocks the main loop too """
+        time.sleep(length / 1024.0 * self.args.crc_us / 1e6)
+
+    def flash_wait(self):
+        delay = self.flash_free_at - self.now()
+        if delay > 0:
+            time.sleep(delay)
+
+    def reset(self, offline_s):
+        self.stats.resets += 1
+        if not self.args.save_progress:
+            self.offset_last = 0
+            self.crc_last = 0
+            self.hash_offset_saved = None
+        self.power_on()
+        self.offline_until = self.now() + offline_s
+        print('Reset, bootloader is back in {:.1f} s'.format(offline_s))
+
+    def feed(self, data):
+        now = self.now()
+        out = bytearray()
+
+        if now < self.offline_until:
+            return bytes(out)
+
+        if self.stats.start is not None:
+            self.stats.rx_bytes += len(data)
+
+        # CPU is halted while flash is erased or written, only the UART FIFO is kept
+        if self.args.cpu_stall and self.flash_busy(now) and len(data) > UART_HW_FIFO_SIZE:
+            self.stats.stall_drops += 1
+            data = data[:UART_HW_FIFO_SIZE]
+
+        for b in data:
+            if self.args.drop_rate and self.rand.random() < self.args.drop_rate:
+                self.stats.dropped_bytes += 1
+                continue
+
+            if b == SLIP_END and (self.decoder.broken or self.decoder.escaped):
+                self.stats.invalid_packets += 1
+
+            packet = self.decoder.add_byte(b)
+            if packet is None:
+                continue
+
+            now = self.now()
+            while self.pending_buffers and self.pending_buffers[0] <= now:
+                self.pending_buffers.pop(0)
+            if len(self.pending_buffers) >= self.args.rx_buffers:
+                self.stats.no_buffer_drops += 1
+                continue
+
+            if self.args.pre_erase:
+                self.pre_erase_step()
+
+            rsp = self.on_request(packet)
+            if rsp is not None:
+                out.extend(slip_encode(rsp))
+
+            if self.now() < self.offline_until:
+                break
+
+        return bytes(out)
+
+    def response(self, op, result=RES_SUCCESS, payload=b''):
+        if result != RES_SUCCESS:
+            print('Request {:02X} failed: {:02X}'.format(op, result))
+        return bytes((OP_RESPONSE, op, result)) + payload
+
+    def on_request(self, packet):
+        op = packet[0]
+        payload = packet[1:]
+        self.stats.requests[op] = self.stats.requests.get(op, 0) + 1
+
+        if len(payload) < REQUEST_PAYLOAD_MIN.get(op, 0):
+            return self.response(op, RES_INVALID_PARAMETER)
+
+        if op == OP_PROTOCOL_VERSION:
+            return self.response(op, payload=bytes((NRF_DFU_PROTOCOL_VERSION,)))
+        if op == OP_PING:
+            return self.response(op, payload=payload[:1])
+        if op == OP_MTU_GET:
+            return self.response(op, payload=get_le16(self.mtu))
+        if op == OP_RECEIPT_NOTIF_SET:
+            self.prn = int.from_bytes(payload[:2], 'little')
+            self.prn_count = self.prn
+            return self.response(op)
+        if op == OP_HARDWARE_VERSION:
+            return self.response(op, payload=get_le32(52832) + get_le32(0x41414230) +
+                                 get_le32(512 * 1024) + get_le32(64 * 1024) + get_le32(CODE_PAGE_SIZE))
+        if op == OP_ABORT:
+            self.init_command_valid = False
+            return self.response(op)
+
+        if op in (OP_OBJECT_SELECT, OP_OBJECT_CREATE):
+            self.current_object = payload[0]
+        if op not in (OP_OBJECT_SELECT, OP_OBJECT_CREATE, OP_OBJECT_WRITE, OP_OBJECT_EXECUTE, OP_CRC_GET):
+            return self.response(op, RES_OP_CODE_NOT_SUPPORTED)
+
+        if self.current_object == OBJ_TYPE_COMMAND:
+            return self.on_command_request(op, payload)
+        if self.current_object == OBJ_TYPE_DATA:
+            return self.on_data_request(op, payload)
+
+        return self.response(op, RES_INVALID_OBJECT)
+
+    def on_command_request(self, op, payload):
+        if op == OP_OBJECT_SELECT:
+            return self.response(op, payload=get_le32(INIT_COMMAND_MAX_SIZE) +
+                                 get_le32(self.command_offset) + get_le32(crc32(self.init_command)))
+        if op == OP_CRC_GET:
+            return self.response(op, payload=get_le32(self.command_offset) + get_le32(crc32(self.init_command)))
+        if op == OP_OBJECT_CREATE:
+            size = int.from_bytes(payload[1:5], 'little')
+            if size > INIT_COMMAND_MAX_SIZE:
+                return self.response(op, RES_INSUFFICIENT_RESOURCES)
+            if self.stats.start is None or self.stats.end is not None:
+                self.stats = Stats()
+                self.stats.start = self.now()
+            # All progress is reset by a new init command
+            self.init_command = b''
+            self.init_command_valid = False
+            self.command_offset = 0
+            self.offset_last = self.crc_last = 0
+            self.fw_offset = self.fw_crc = 0
+            self.data_object_size = 0
+            self.hash_offset_saved = None
+            return self.response(op)
+        if op == OP_OBJECT_WRITE:
+            if self.command_offset + len(payload) > INIT_COMMAND_MAX_SIZE:
+                return self.response(op, RES_INVALID_PARAMETER)
+            self.init_command += payload
+            self.command_offset += len(payload)
+            return self.prn_response(self.command_offset, crc32(self.init_command))
+        if op == OP_OBJECT_EXECUTE:
+            if self.init_command_valid:
+                # Executed before, the firmware transfer is resumed
+                return self.response(op)
+            try:
+                fw_size, fw_hash = init_command_parse(self.init_command)
+            except (ValueError, IndexError, KeyError):
+                return self.response(op, RES_EXT_ERROR, bytes((0x02,)))
+            self.init_command_valid = True
+            self.fw_size = fw_size
+            self.fw_hash = fw_hash
+            self.pre_erase_offset = 0
+            print('Init command executed, firmware size: {}'.format(fw_size))
+            return self.response(op)
+
+        return self.response(op, RES_OP_CODE_NOT_SUPPORTED)
+
+    def prn_response(self, offset, crc):
+        """ Write requests are answered by a CRC response when PRN is reached """
+        if self.prn == 0:
+            return None
+        self.prn_count -= 1
+        if self.prn_count != 0:
+            return None
+        self.prn_count = self.prn
+        return self.response(OP_CRC_GET, payload=get_le32(offset) + get_le32(crc))
+
+    def on_data_request(self, op, payload):
+        if op == OP_OBJECT_SELECT:
+            if self.fw_offset and self.stats.recover_offset is None and self.stats.fw_bytes == 0:
+                self.stats.recover_offset = self.fw_offset
+            return self.response(op, payload=get_le32(DATA_OBJECT_MAX_SIZE) +
+                                 get_le32(self.fw_offset) + get_le32(self.fw_crc))
+        if op == OP_CRC_GET:
+            return self.response(op, payload=get_le32(self.fw_offset) + get_le32(self.fw_crc))
+
+        if not self.init_command_valid:
+            return self.response(op, RES_OPERATION_NOT_PERMITTED)
+
+        if op == OP_OBJECT_CREATE:
+            size = int.from_bytes(payload[1:5], 'little')
+            if size == 0:
+                return self.response(op, RES_INVALID_PARAMETER)
+            if size & (CODE_PAGE_SIZE - 1) and self.offset_last + size != self.fw_size:
+                return self.response(op, RES_INVALID_PARAMETER)
+            if size > DATA_OBJECT_MAX_SIZE:
+                return self.response(op, RES_INSUFFICIENT_RESOURCES)
+            if self.offset_last + size > self.fw_size:
+                return self.response(op, RES_OPERATION_NOT_PERMITTED)
+
+            if self.stats.first_data is None:
+                self.stats.first_data = self.now()
+            if self.fw_offset != self.offset_last or self.data_object_size:
+                self.stats.object_retries += 1
+
+            self.prn_count = self.prn
+            self.data_object_size = size
+            self.fw_offset = self.offset_last
+            self.fw_crc = self.crc_last
+            # nrf_dfu_validation_fw_hash_restore()
+            self.hash_offset = self.offset_last if self.offset_last in (0, self.hash_offset_saved) else None
+            self.combine_flush()
+            pages = (size + CODE_PAGE_SIZE - 1) // CODE_PAGE_SIZE
+            page_range = slice(self.offset_last, self.offset_last + pages * CODE_PAGE_SIZE)
+            # NRF_DFU_FLASH_ERASED_MAP_ENABLED, blank pages are not erased again
+            if self.args.skip_erased and self.flash[page_range].count(0xFF) == pages * CODE_PAGE_SIZE:
+                self.stats.erases_avoided += pages
+            else:
+                self.flash[page_range] = bytearray([0xFF]) * (pages * CODE_PAGE_SIZE)
+                self.flash_erase(pages)
+
+            # NVMC erases the page before the response
+            if self.args.fstorage == 'nvmc':
+                self.flash_wait()
+            return self.response(op)
+
+        if op == OP_OBJECT_WRITE:
+            if self.fw_offset - self.offset_last + len(payload) > self.data_object_size:
+                return self.response(op, RES_INVALID_PARAMETER)
+
+            if self.args.corrupt_rate and self.rand.random() < self.args.corrupt_rate:
+                payload = bytearray(payload)
+                payload[self.rand.randrange(len(payload))] ^= 1 << self.rand.randrange(8)
+                self.stats.corrupted_packets += 1
+
+            # The write is not done, the host finds it by the CRC
+            if self.args.combine_size and self.combine_busy():
+                self.stats.busy_drops += 1
+                return self.prn_response(self.fw_offset, self.fw_crc)
+
+            # Data below the highest offset has been sent before
+            resent = min(len(payload), max(self.stats.fw_offset_max - self.fw_offset, 0))
+            self.stats.resent_bytes += resent
+            self.stats.fw_bytes += len(payload) - resent
+
+            self.flash[self.fw_offset:self.fw_offset + len(payload)] = payload
+            if self.args.combine_size:
+                self.combine_write(len(payload))
+            else:
+                self.flash_write(len(payload))
+            if self.args.streaming_hash:
+                if self.hash_offset == self.fw_offset:
+                    self.cpu_hash(len(payload))
+                    self.hash_offset += len(payload)
+                else:
+                    self.hash_offset = None
+            self.fw_crc = crc32(payload, self.fw_crc)
+            self.fw_offset += len(payload)
+            self.stats.fw_offset_max = max(self.stats.fw_offset_max, self.fw_offset)
+
+            if self.reset_at and self.fw_offset >= self.reset_at[0]:
+                self.reset_at.pop(0)
+                self.reset(self.args.reset_time)
+                return None
+
+            return self.prn_response(self.fw_offset, self.fw_crc)
+
+        if op == OP_OBJECT_EXECUTE:
+            if self.fw_offset - self.offset_last != self.data_object_size:
+                return self.response(op, RES_OPERATION_NOT_PERMITTED)
+
+            # Response is sent when all buffers are written into flash
+            self.combine_flush()
+            self.flash_wait()
+
+            # With the streaming hash, each object is read back for its CRC
+            if self.args.streaming_hash:
+                start = self.now()
+                self.cpu_crc(self.fw_offset - self.offset_last)
+                self.stats.verify_last = self.now() - start
+                self.stats.verify += self.stats.verify_last
+
+            self.data_object_size = 0
+            self.offset_last = self.fw_offset
+            self.crc_last = self.fw_crc
+            # An object executed again after a reset keeps the saved hash
+            if self.hash_offset_saved != self.fw_offset:
+                self.hash_offset_saved = self.hash_offset if self.hash_offset == self.fw_offset else None
+            self.stats.objects += 1
+
+            if self.fw_offset != self.fw_size:
+                return self.response(op)
+
+            # The image is hashed again unless the hash is complete
+            start = self.now()
+            if not self.args.streaming_hash or self.hash_offset_saved != self.fw_size:
+                self.cpu_hash(self.fw_size)
+            self.stats.postvalidation = self.now() - start
+
+            return self.on_firmware_received(op)
+
+        return self.response(op, RES_OP_CODE_NOT_SUPPORTED)
+
+    def on_firmware_received(self, op):
+        image = bytes(self.flash[:self.fw_size])
+        digest = hashlib.sha256(image).digest()
+        if self.fw_hash is not None and self.fw_hash not in (digest, digest[::-1]):
+            print('Firmware hash mismatch')
+            return self.response(op, RES_EXT_ERROR, bytes((EXT_ERROR_VERIFICATION_FAILED,)))
+
+        self.stats.end = self.now()
+        self.sessions += 1
+        self.stats.report('DFU {} done, {} bytes, crc 0x{:08X}'.format(self.sessions, self.fw_size, crc32(image)))
+
+        if self.args.out_dir:
+            path = os.path.join(self.args.out_dir, 'image_{}.bin'.format(self.sessions))
+            with open(path, 'wb') as f:
+                f.write(image)
+
+        rsp = self.response(op)
+
+        # The new image is activated, the bootloader starts again for the next image
+        self.init_command = b''
+        self.init_command_valid = False
+        self.command_offset = 0
+        self.offset_last = self.crc_last = 0
+        self.power_on()
+        self.offline_until = self.now() + self.args.activate_time
+
+        return rsp
+
+
+class PtyPort:
+    def __init__(self):
+        self.master, slave = os.openpty()
+        tty.setraw(slave)
+        print('Connect the DFU host to {}'.format(os.ttyname(slave)))
+        self.slave = slave
+
+    def read(self, timeout):
+        import select
+        ready, _, _ = select.select([self.master], [], [], timeout)
+        return os.read(self.master, 4096) if ready else b''
+
+    def write(self, data):
+        os.write(self.master, data)
+
+
+class SerialPort:
+    def __init__(self, name, baudrate, rtscts):
+        import serial
+        self.port = serial.Serial(name, baudrate, rtscts=rtscts, timeout=0)
+        print('Listening on {}, {} baud'.format(name, baudrate))
+
+    def read(self, timeout):
+        self.port.timeout = timeout
+        data = self.port.read(1)
+        if data:
+            self.port.timeout = 0
+            data += self.port.read(4096)
+        return data
+
+    def write(self, data):
+        self.port.write(data)
+
+
+def run(args):
+    port = PtyPort() if args.port == 'pty' else SerialPort(args.port, args.baudrate, args.rtscts)
+    sim = DfuBootloaderSim(args)
+
+    try:
+        while args.sessions == 0 or sim.sessions < args.sessions:
+            data = port.read(0.05)
+            if data:
+                rsp = sim.feed(data)
+                if rsp:
+                    port.write(rsp)
+    except KeyboardInterrupt:
+        if sim.stats.start is not None and sim.stats.end is None:
+            sim.stats.report('DFU not finished')
+
+
+if __name__ == '__main__':
+    """
+    Usage: python dfu_bl_sim.py pty
+           python dfu_bl_sim.py COM5 --erase-ms 85 --drop-rate 0.0001 --reset-at 0x8000
+    """
+    parser = argparse.ArgumentParser(description='Simulate the nRF52 serial DFU bootloader')
+    parser.add_argument('port', help='serial port connected to the DFU host, or "pty"')
+    parser.add_argument('--baudrate', type=int, default=115200)
+    parser.add_argument('--rtscts', action='store_true', help='enable HW flow control')
+    parser.add_argument('--mtu', type=int, default=2 * (RX_BUF_SIZE + 1) + 1,
+                        help='MTU reported to the host, the decoded packet is up to MTU - 1')
+    parser.add_argument('--rx-buffers', type=int, default=3, help='NRF_DFU_SERIAL_UART_RX_BUFFERS')
+    parser.add_argument('--fstorage', choices=('nvmc', 'sd'), default='nvmc',
+                        help='nvmc: flash operations block, sd: flash operations are queued by SoftDevice')
+    parser.add_argument('--erase-ms', type=float, default=85.0, help='flash page erase time')
+    parser.add_argument('--write-us', type=float, default=41.0, help='flash word write time')
+    parser.add_argument('--combine-size', type=int, default=0,
+                        help='NRF_DFU_FLASH_COMBINE_SIZE, 0: each RX buffer is written')
+    parser.add_argument('--skip-erased', action='store_true',
+                        help='NRF_DFU_FLASH_ERASED_MAP_ENABLED, blank pages are not erased on object create')
+    parser.add_argument('--pre-erase', action='store_true',
+                        help='NRF_DFU_PRE_ERASE_ENABLED, firmware pages are erased between requests, '
+                             'use with --skip-erased')
+    parser.add_argument('--cpu-stall', action='store_true',
+                        help='lose bytes beyond the UART FIFO while flash is busy')
+    parser.add_argument('--save-progress', action='store_true', help='NRF_DFU_SAVE_PROGRESS_IN_FLASH')
+    parser.add_argument('--streaming-hash', action='store_true', help='NRF_DFU_STREAMING_HASH')
+    parser.add_argument('--hash-us', type=float, default=1000.0, help='SHA-256 time of 1 KB, nrf_sw backend')
+    parser.add_argument('--crc-us', type=float, default=640.0, help='crc32_compute() time of 1 KB')
+    parser.add_argument('--drop-rate', type=float, default=0.0, help='probability to drop a received byte')
+    parser.add_argument('--corrupt-rate', type=float, default=0.0,
+                        help='probability to corrupt a received data packet')
+    parser.add_argument('--reset-at', type=lambda x: int(x, 0), action='append', default=[],
+                        help='reset when the firmware offset reaches the value, can be repeated')
+    parser.add_argument('--reset-time', type=float, default=1.0, help='time to restart after a reset')
+    parser.add_argument('--activate-time', type=float, default=3.0,
+                        help='time to activate an image before the bootloader is back')
+    parser.add_argument('--bank-size', type=lambda x: int(x, 0), default=0x80000)
+    parser.add_argument('--sessions', type=int, default=0, help='exit after the number of DFU, 0: never')
+    parser.add_argument('--seed', type=int, default=None, help='seed of the fault injection')
+    parser.add_argument('--out-dir', help='directory to save the received images')
+
+    run(parser.parse_args())
+
+    exit(0)
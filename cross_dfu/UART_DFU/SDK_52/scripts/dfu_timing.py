@@ -0,0 +1,119 @@
+"""
+Description: Per-stage time breakdown of a serial DFU from the bootloader log
+
+The bootloader built with NRF_DFU_STAGE_TIMING_ENABLED logs the time spent in each
+stage of every data object, in ticks of the DFU timer (RTC, 32768 Hz):
+
+    <info> nrf_dfu_req_handler: timing 0x00001000 erase=2790 rx=3106 crc=9 hash=134
+    <info> nrf_dfu_req_handler: timing 0x00001000 flash=101 verify=84 execute=3 validate=0
+    <info> nrf_dfu_req_handler: timing total objects=21 elapsed=92810
+
+The log of RTT viewer, or any log with these lines, is turned into a table of
+each object and the share of each stage, so the stage limiting the transfer is
+found: rx is the UART and SLIP decoding, the others are in the bootloader.
+"""
+import re
+import sys
+
+
+TICKS_PER_SECOND = 32768
+
+STAGES = ('erase', 'rx', 'crc', 'hash', 'flash', 'verify', 'execute', 'validate')
+
+TIMING_LINE = re.compile(r'timing (0x[0-9A-Fa-f]+|total|event)((?: \w+=-?\d+)+)')
+
+
+def ticks_to_ms(ticks):
+    return ticks * 1000.0 / TICKS_PER_SECOND
+
+
+def parse(lines):
+    """
+    Return the stages of each object in log order, the totals and the events.
+    An object logged again, e.g. after a reset, is counted once more.
+    """
+    objects = []
+    totals = {}
+    events = {}
+
+    for line in lines:
+        m = TIMING_LINE.search(line)
+        if m is None:
+            continue
+
+        fields = {k: int(v) for k, v in (kv.split('=') for kv in m.group(2).split())}
+        name = m.group(1)
+
+        if name == 'total':
+            totals.update(fields)
+        elif name == 'event':
+            events.update(fields)
+        else:
+            offset = int(name, 16)
+            # The two lines of an object have the same offset
+            if not objects or objects[-1][0] != offset or set(fields) & set(objects[-1][1]):
+                objects.append((offset, {}))
+            objects[-1][1].update(fields)
+
+    return objects, totals, events
+
+
+def report(objects, totals, events):
+    print('{:>10} {:>6}'.format('offset', 'bytes') + ''.join('{:>9}'.format(s) for s in STAGES) +
+          '{:>9}'.format('sum'))
+
+    sums = dict.fromkeys(STAGES, 0)
+    prev = 0
+    for offset, fields in objects:
+        size = offset - prev if offset > prev else '-'
+        prev = offset
+        row = [fields.get(s, 0) for s in STAGES]
+        for s, v in zip(STAGES, row):
+            sums[s] += v
+        print('0x{:08X} {:>6}'.format(offset, size) + ''.join('{:>9.1f}'.format(ticks_to_ms(v)) for v in row) +
+              '{:>9.1f}'.format(ticks_to_ms(sum(row))))
+
+    # The totals of the bootloader cover objects which are not in the log, e.g. it was cut
+    if totals:
+        sums = {s: totals.get(s, sums[s]) for s in STAGES}
+
+    total = sum(sums.values())
+    print()
+    print('Objects:   {}'.format(totals.get('objects', len(objects))))
+    if 'elapsed' in totals:
+        print('Elapsed:   {:.1f} ms since the first object was created'.format(ticks_to_ms(totals['elapsed'])))
+    if 'transport' in events and 'started' in events:
+        print('Startup:   {:.1f} ms from transport activation to DFU start'.format(
+            ticks_to_ms(events['started'] - events['transport'])))
+    print()
+    print('{:>10} {:>10} {:>7}'.format('stage', 'ms', 'share'))
+    for s in sorted(STAGES, key=lambda x: -sums[x]):
+        print('{:>10} {:>10.1f} {:>6.1f}%'.format(s, ticks_to_ms(sums[s]), sums[s] * 100.0 / max(total, 1)))
+
+    if total:
+        print()
+        print('Limited by: {}'.format(max(STAGES, key=lambda x: sums[x])))
+
+
+if __name__ == '__main__':
+    """
+    Usage: python dfu_timing.py <log-file>
+           JLinkRTTLogger ... | python dfu_timing.py -
+    """
+    if len(sys.argv) != 2:
+        print('Usage: python dfu_timing.py <log-file | ->')
+        exit(1)
+
+    if sys.argv[1] == '-':
+        result = parse(sys.stdin)
+    else:
+        with open(sys.argv[1], errors='replace') as f:
+            result = parse(f)
+
+    if not result[0] and not result[1]:
+        print('No timing found, is NRF_DFU_STAGE_TIMING_ENABLED set in the bootloader?')
+        exit(1)
+
+    report(*result)
+
+    exit(0)
@@ -28,13 +28,14 @@ class DfuImage:
         self.firmware_addr = 0
         self.firmware_size = 0
         self.firmware_data = []
+        self.firmware_crc = 0
 
     def __repr__(self):
         ret_msg = 'Image info:\n'
         ret_msg += 'Type: {}\n'.format(str(DfuImageType(self.type)))
         # ret_msg += 'Size(ip + fw): {:d} bytes\n'.format(self.size)
         ret_msg += 'Init packet\n name: {}\n addr: 0x{:08X}\n size: {} bytes\n'.format(self.init_packet_name, self.init_packet_addr, self.init_packet_size)
-        ret_msg += 'Firmware\n name: {}\n addr: 0x{:08X}\n size: {} bytes\n'.format(self.firmware_name, self.firmware_addr, self.firmware_size)
+        ret_msg += 'Firmware\n name: {}\n addr: 0x{:08X}\n size: {} bytes\n crc: 0x{:08X}\n'.format(self.firmware_name, self.firmware_addr, self.firmware_size, self.firmware_crc)
         return ret_msg
 
 
@@ -43,6 +44,11 @@ class DfuFlatFile:
     magic_number_dfufile = 0x49535951
     file_header_size_max = 128
     init_packet_size_max = 512
+    image_count_max = 4
+
+    # Images are sent in this order, nRF52 must run the new softdevice
+    # and bootloader before application is sent
+    image_order = ('softdevice_bootloader', 'softdevice', 'bootloader', 'application')
 
     def __init__(self):
         self.file_name = ''
@@ -59,9 +65,6 @@ class DfuFlatFile:
         self.file_name = out_file_path
 
         dfu_zip_file = zipfile.ZipFile(zip_file_path)
-        if not len(dfu_zip_file.infolist()) == 3:
-            print('Only support one file upgrading in this version')
-            exit(1)
 
         manifest = json.loads(dfu_zip_file.read('manifest.json'))
         if manifest is None:
@@ -70,11 +73,11 @@ class DfuFlatFile:
 
         self.file_size += DfuFlatFile.file_header_size_max
 
-        if len(manifest['manifest']) is not 1:
-            print('Warning: it only supports one step of update now')
+        if len(manifest['manifest']) > DfuFlatFile.image_count_max:
+            print('Too many images in DFU package')
             exit(1)
 
-        for image_type in ('application', 'softdevice', 'bootloader', 'softdevice_bootloader'):
+        for image_type in DfuFlatFile.image_order:
             if image_type in manifest['manifest']:
                 ip_file_name = manifest['manifest'][image_type]['dat_file']
                 fw_file_name = manifest['manifest'][image_type]['bin_file']
@@ -90,6 +93,7 @@ class DfuFlatFile:
                 image.firmware_addr = image.init_packet_addr + DfuFlatFile.init_packet_size_max
                 image.firmware_size = dfu_zip_file.getinfo(fw_file_name).file_size
                 image.firmware_data = dfu_zip_file.read(fw_file_name)
+                image.firmware_crc = CrcCalculator(Crc32.CRC32).calculate_checksum(image.firmware_data)
 
                 image.type = DfuImageType[image_type]
 
@@ -122,6 +126,7 @@ class DfuFlatFile:
             self.file_data.extend(DfuFlatFile.get_le32(img.init_packet_size))
             self.file_data.extend(DfuFlatFile.get_le32(img.firmware_addr))
             self.file_data.extend(DfuFlatFile.get_le32(img.firmware_size))
+            self.file_data.extend(DfuFlatFile.get_le32(img.firmware_crc))
 
         # Fill padding with 0xFF
         left = DfuFlatFile.file_header_size_max - len(self.file_data)
@@ -141,7 +146,7 @@ class DfuFlatFile:
             self.file_data.extend(img.firmware_data)
             # Fill padding with 0xFF
             if not img.firmware_size % 4 == 0:
-                left = 4 - (image.firmware_size & 3)
+                left = 4 - (img.firmware_size & 3)
                 self.file_data.extend([0xFF] * left)
 
 
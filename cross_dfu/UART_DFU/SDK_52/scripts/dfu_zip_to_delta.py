@@ -0,0 +1,234 @@
+"""
+Description: Generate a DFU delta file(*.bin) from a base firmware and a new DFU package
+
+The delta file carries the init packet of the new DFU package and a patch, nRF91
+reconstructs the new firmware from the base firmware it keeps and the patch.
+"""
+import zipfile
+import json
+import os
+import sys
+from crc.crc import Crc32, CrcCalculator
+
+
+# Patch op codes
+DELTA_OP_COPY = 0x01        # op[1], base offset[4], length[4]
+DELTA_OP_ADD = 0x02         # op[1], length[4], data[length]
+
+# Block size to search the base firmware, a copy shorter than
+# the op header is not worth it
+DELTA_BLOCK_SIZE = 16
+DELTA_COPY_MIN = 12
+DELTA_CANDIDATES_MAX = 8
+
+
+def get_le32(number: int):
+    return number.to_bytes(4, 'little')
+
+
+def crc32(data):
+    return CrcCalculator(Crc32.CRC32).calculate_checksum(data)
+
+
+def read_application(file_path):
+    """ Read init packet and application bin from a DFU package, or a raw bin file """
+    if not zipfile.is_zipfile(file_path):
+        with open(file_path, 'rb') as f:
+            return None, f.read()
+
+    dfu_zip_file = zipfile.ZipFile(file_path)
+    manifest = json.loads(dfu_zip_file.read('manifest.json'))
+
+    if 'application' not in manifest['manifest']:
+        print('Only application can be updated by delta file')
+        exit(1)
+
+    ip_file_name = manifest['manifest']['application']['dat_file']
+    fw_file_name = manifest['manifest']['application']['bin_file']
+
+    return dfu_zip_file.read(ip_file_name), dfu_zip_file.read(fw_file_name)
+
+
+def match_len(base, base_pos, target, target_pos):
+    n = 0
+    step = 64
+    limit = min(len(base) - base_pos, len(target) - target_pos)
+
+    # Compare by slices first, then byte by byte
+    while n + step <= limit and base[base_pos + n:base_pos + n + step] == target[target_pos + n:target_pos + n + step]:
+        n += step
+    while n < limit and base[base_pos + n] == target[target_pos + n]:
+        n += 1
+
+    return n
+
+
+def make_patch(base, target):
+    index = {}
+    for i in range(len(base) - DELTA_BLOCK_SIZE + 1):
+        candidates = index.setdefault(base[i:i + DELTA_BLOCK_SIZE], [])
+        if len(candidates) < DELTA_CANDIDATES_MAX:
+            candidates.append(i)
+
+    patch = bytearray()
+    literal = bytearray()
+    copy_count = 0
+    copy_size = 0
+
+    def flush_literal():
+        if literal:
+            patch.append(DELTA_OP_ADD)
+            patch.extend(get_le32(len(literal)))
+            patch.extend(literal)
+            literal.clear()
+
+    pos = 0
+    base_next = 0
+    while pos < len(target):
+        best_len = 0
+        best_pos = 0
+
+        # Data following the previous copy is the most likely match
+        candidates = [base_next] + index.get(target[pos:pos + DELTA_BLOCK_SIZE], [])
+        for base_pos in candidates:
+            if base_pos >= len(base):
+                continue
+            n = match_len(base, base_pos, target, pos)
+            if n > best_len:
+                best_len = n
+                best_pos = base_pos
+
+        if best_len >= DELTA_COPY_MIN:
+            flush_literal()
+            patch.append(DELTA_OP_COPY)
+            patch.extend(get_le32(best_pos))
+            patch.extend(get_le32(best_len))
+            copy_count += 1
+            copy_size += best_len
+            pos += best_len
+            base_next = best_pos + best_len
+        else:
+            literal.append(target[pos])
+            pos += 1
+            base_next += 1
+
+    flush_literal()
+
+    print('Copy ops: {}, copied: {} bytes, added: {} bytes'.format(
+        copy_count, copy_size, len(target) - copy_size))
+
+    return bytes(patch)
+
+
+def apply_patch(base, patch):
+    """ The same algorithm as dfu_delta.c, used to verify the patch """
+    out = bytearray()
+    pos = 0
+    while pos < len(patch):
+        op = patch[pos]
+        if op == DELTA_OP_COPY:
+            src = int.from_bytes(patch[pos + 1:pos + 5], 'little')
+            length = int.from_bytes(patch[pos + 5:pos + 9], 'little')
+            out.extend(base[src:src + length])
+            pos += 9
+        elif op == DELTA_OP_ADD:
+            length = int.from_bytes(patch[pos + 1:pos + 5], 'little')
+            out.extend(patch[pos + 5:pos + 5 + length])
+            pos += 5 + length
+        else:
+            raise ValueError('Invalid patch op: {:02X}'.format(op))
+    return bytes(out)
+
+
+class DfuDeltaFile:
+    magic_number_mcuboot = 0x96F3B83D
+    magic_number_delta = 0x49535944
+    file_header_size_max = 128
+    init_packet_size_max = 512
+    image_type_application = 0
+
+    # DFU files must fit below the base kept by nRF91, see DELTA_BASE_OFFSET
+    file_size_max = 0x40000
+
+    def __init__(self):
+        self.file_data = bytearray()
+
+    def make(self, base_file_path, zip_file_path, out_file_path):
+        _, base = read_application(base_file_path)
+        init_packet, target = read_application(zip_file_path)
+
+        if init_packet is None:
+            print('New firmware must be a DFU package')
+            exit(1)
+
+        if len(init_packet) > DfuDeltaFile.init_packet_size_max:
+            print('Init packet is too big')
+            exit(1)
+
+        patch = make_patch(base, target)
+
+        if apply_patch(base, patch) != target:
+            print('Patch verification failed')
+            exit(1)
+
+        ip_addr = DfuDeltaFile.file_header_size_max
+        patch_addr = ip_addr + DfuDeltaFile.init_packet_size_max
+        patch_padding = (4 - (len(patch) & 3)) & 3
+        file_size = patch_addr + len(patch) + patch_padding + 4
+
+        #  Fill file header
+        self.file_data.extend(get_le32(DfuDeltaFile.magic_number_mcuboot))
+        self.file_data.extend(get_le32(DfuDeltaFile.magic_number_delta))
+        self.file_data.extend(get_le32(file_size))
+        self.file_data.extend(get_le32(1))
+
+        # Fill image info
+        self.file_data.extend(get_le32(DfuDeltaFile.image_type_application))
+        self.file_data.extend(get_le32(ip_addr))
+        self.file_data.extend(get_le32(len(init_packet)))
+        self.file_data.extend(get_le32(patch_addr))
+        self.file_data.extend(get_le32(len(patch)))
+        self.file_data.extend(get_le32(len(base)))
+        self.file_data.extend(get_le32(crc32(base)))
+        self.file_data.extend(get_le32(len(target)))
+        self.file_data.extend(get_le32(crc32(target)))
+
+        # Fill padding with 0xFF
+        self.file_data.extend([0xFF] * (DfuDeltaFile.file_header_size_max - len(self.file_data)))
+
+        self.file_data.extend(init_packet)
+        self.file_data.extend([0xFF] * (DfuDeltaFile.init_packet_size_max - len(init_packet)))
+
+        self.file_data.extend(patch)
+        self.file_data.extend([0xFF] * patch_padding)
+
+        # Fill CRC32
+        self.file_data.extend(get_le32(crc32(self.file_data)))
+
+        if len(self.file_data) > DfuDeltaFile.file_size_max:
+            print('Delta file is too big, use full DFU file instead')
+            exit(1)
+
+        print('Base: {} bytes, firmware: {} bytes, patch: {} bytes ({:.1f}%)'.format(
+            len(base), len(target), len(patch), len(patch) * 100.0 / len(target)))
+
+        with open(out_file_path, 'wb+') as out_file:
+            out_file.write(bytes(self.file_data))
+
+
+if __name__ == '__main__':
+    """
+    Usage: python dfu_zip_to_delta.py dfu_pkg_old.zip dfu_pkg_new.zip dfu_delta.bin
+    """
+    if len(sys.argv) == 4:
+        for in_file in sys.argv[1:3]:
+            if not os.path.exists(in_file):
+                print('error: invalid file name')
+                exit(1)
+    else:
+        print('error. usage: python dfu_zip_to_delta.py <base_zip_or_bin> <zip_file> <bin_file>')
+        exit(1)
+
+    DfuDeltaFile().make(sys.argv[1], sys.argv[2], sys.argv[3])
+
+    exit(0)
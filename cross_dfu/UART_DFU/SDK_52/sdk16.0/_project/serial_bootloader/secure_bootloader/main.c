@@ -53,6 +53,7 @@
 #include "nrf_bootloader_app_start.h"
 #include "nrf_bootloader_dfu_timers.h"
 #include "nrf_dfu.h"
+#include "nrf_dfu_req_handler.h"
 #include "nrf_log.h"
 #include "nrf_log_ctrl.h"
 #include "nrf_log_default_backends.h"
@@ -61,6 +62,10 @@
 #include "nrf_bootloader_info.h"
 #include "nrf_delay.h"
 
+#ifndef NRF_DFU_STAGE_TIMING_ENABLED
+#define NRF_DFU_STAGE_TIMING_ENABLED 0
+#endif
+
 static void on_error(void)
 {
     NRF_LOG_FINAL_FLUSH();
@@ -104,6 +109,11 @@ static void dfu_observer(nrf_dfu_evt_type_t evt_type)
     switch (evt_type)
     {
         case NRF_DFU_EVT_DFU_FAILED:
+#if NRF_DFU_STAGE_TIMING_ENABLED
+            // Objects received before the failure.
+            nrf_dfu_req_handler_timing_log();
+#endif
+            // fall through
         case NRF_DFU_EVT_DFU_ABORTED:
         case NRF_DFU_EVT_DFU_INITIALIZED:
             bsp_board_init(BSP_INIT_LEDS);
@@ -112,10 +122,16 @@ static void dfu_observer(nrf_dfu_evt_type_t evt_type)
             bsp_board_led_off(BSP_BOARD_LED_2);
             break;
         case NRF_DFU_EVT_TRANSPORT_ACTIVATED:
+#if NRF_DFU_STAGE_TIMING_ENABLED
+            NRF_LOG_INFO("timing event transport=%d", nrf_bootloader_dfu_timer_counter_get());
+#endif
             bsp_board_led_off(BSP_BOARD_LED_1);
             bsp_board_led_on(BSP_BOARD_LED_2);
             break;
         case NRF_DFU_EVT_DFU_STARTED:
+#if NRF_DFU_STAGE_TIMING_ENABLED
+            NRF_LOG_INFO("timing event started=%d", nrf_bootloader_dfu_timer_counter_get());
+#endif
             break;
         default:
             break;
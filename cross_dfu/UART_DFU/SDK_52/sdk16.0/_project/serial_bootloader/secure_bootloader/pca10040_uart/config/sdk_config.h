@@ -238,6 +238,19 @@
 #define NRF_BL_FW_COPY_PROGRESS_STORE_STEP 8
 #endif
 
+// <q> NRF_BL_FW_COPY_JOURNAL_ENABLED  - Journal the progress of the copy of each page.
+ 
+
+// <i> The write offset is appended to a journal in the rest of the settings page
+// <i> after each copied page, one word per page, so the copy is resumed from the
+// <i> last page after a reset. The settings page is only erased and rewritten when
+// <i> the journal is full, or when the source of the copy could be overwritten.
+// <i> NRF_BL_FW_COPY_PROGRESS_STORE_STEP is not used when this is enabled.
+
+#ifndef NRF_BL_FW_COPY_JOURNAL_ENABLED
+#define NRF_BL_FW_COPY_JOURNAL_ENABLED 1
+#endif
+
 // <o> NRF_BL_RESET_DELAY_MS - Time to wait before resetting the bootloader. 
 // <i> Time (in ms) to wait before resetting the bootloader after DFU has been completed or aborted. This allows more time for e.g. disconnecting the BLE link or writing logs.
 
@@ -276,12 +289,43 @@
 #define NRF_CRYPTO_ALLOCATOR 1
 #endif
 
+// <o> NRF_DFU_ECDSA_BACKEND  - Backend of the secp256r1 signature check.
+ 
+
+// <i> Auto selects CC310_BL on nRF52840, and Oberon on chips without CC310.
+// <i> The backend entries below are set by this choice. SHA-256 is done by
+// <i> CC310_BL, with data in flash copied to RAM first, or by nRF SW otherwise.
+// <i> The default is micro-ecc: Oberon takes about 5.5 KB more and has not been
+// <i> checked against the 24 KB bootloader region of 52832, select it only when
+// <i> the link map shows that it fits. See "Signature backends" in the Scripts
+// <i> User Guide for the code size and estimated verify time of each backend.
+// <0=> Auto 
+// <1=> micro-ecc 
+// <2=> Oberon 
+// <3=> CC310_BL 
+
+#ifndef NRF_DFU_ECDSA_BACKEND
+#define NRF_DFU_ECDSA_BACKEND 1
+#endif
+
+#if NRF_DFU_ECDSA_BACKEND != 0
+#define NRF_DFU_ECDSA_BACKEND_SELECTED NRF_DFU_ECDSA_BACKEND
+#elif defined(NRF52840_XXAA)
+#define NRF_DFU_ECDSA_BACKEND_SELECTED 3
+#else
+#define NRF_DFU_ECDSA_BACKEND_SELECTED 2
+#endif
+
+#if NRF_DFU_ECDSA_BACKEND_SELECTED == 3 && !defined(NRF52840_XXAA)
+#error "NRF_DFU_ECDSA_BACKEND: CC310_BL is only available on nRF52840."
+#endif
+
 // <e> NRF_CRYPTO_BACKEND_CC310_BL_ENABLED - Enable the ARM Cryptocell CC310 reduced backend.
 
 // <i> The CC310 hardware-accelerated cryptography backend with reduced functionality and footprint (only available on nRF52840).
 //==========================================================
 #ifndef NRF_CRYPTO_BACKEND_CC310_BL_ENABLED
-#define NRF_CRYPTO_BACKEND_CC310_BL_ENABLED 0
+#define NRF_CRYPTO_BACKEND_CC310_BL_ENABLED (NRF_DFU_ECDSA_BACKEND_SELECTED == 3)
 #endif
 // <q> NRF_CRYPTO_BACKEND_CC310_BL_ECC_SECP224R1_ENABLED  - Enable the secp224r1 elliptic curve support using CC310_BL.
  
@@ -294,7 +338,7 @@
  
 
 #ifndef NRF_CRYPTO_BACKEND_CC310_BL_ECC_SECP256R1_ENABLED
-#define NRF_CRYPTO_BACKEND_CC310_BL_ECC_SECP256R1_ENABLED 1
+#define NRF_CRYPTO_BACKEND_CC310_BL_ECC_SECP256R1_ENABLED (NRF_DFU_ECDSA_BACKEND_SELECTED == 3)
 #endif
 
 // <q> NRF_CRYPTO_BACKEND_CC310_BL_HASH_SHA256_ENABLED  - CC310_BL SHA-256 hash functionality.
@@ -303,7 +347,7 @@
 // <i> CC310_BL backend implementation for hardware-accelerated SHA-256.
 
 #ifndef NRF_CRYPTO_BACKEND_CC310_BL_HASH_SHA256_ENABLED
-#define NRF_CRYPTO_BACKEND_CC310_BL_HASH_SHA256_ENABLED 1
+#define NRF_CRYPTO_BACKEND_CC310_BL_HASH_SHA256_ENABLED (NRF_DFU_ECDSA_BACKEND_SELECTED == 3)
 #endif
 
 // <q> NRF_CRYPTO_BACKEND_CC310_BL_HASH_AUTOMATIC_RAM_BUFFER_ENABLED  - nrf_cc310_bl buffers to RAM before running hash operation
@@ -312,7 +356,7 @@
 // <i> Enabling this makes hashing of addresses in FLASH range possible. Size of buffer allocated for hashing is set by NRF_CRYPTO_BACKEND_CC310_BL_HASH_AUTOMATIC_RAM_BUFFER_SIZE
 
 #ifndef NRF_CRYPTO_BACKEND_CC310_BL_HASH_AUTOMATIC_RAM_BUFFER_ENABLED
-#define NRF_CRYPTO_BACKEND_CC310_BL_HASH_AUTOMATIC_RAM_BUFFER_ENABLED 0
+#define NRF_CRYPTO_BACKEND_CC310_BL_HASH_AUTOMATIC_RAM_BUFFER_ENABLED (NRF_DFU_ECDSA_BACKEND_SELECTED == 3)
 #endif
 
 // <o> NRF_CRYPTO_BACKEND_CC310_BL_HASH_AUTOMATIC_RAM_BUFFER_SIZE - nrf_cc310_bl hash outputs digests in little endian 
@@ -765,7 +809,7 @@
 // <e> NRF_CRYPTO_BACKEND_MICRO_ECC_ENABLED - Enable the micro-ecc backend.
 //==========================================================
 #ifndef NRF_CRYPTO_BACKEND_MICRO_ECC_ENABLED
-#define NRF_CRYPTO_BACKEND_MICRO_ECC_ENABLED 1
+#define NRF_CRYPTO_BACKEND_MICRO_ECC_ENABLED (NRF_DFU_ECDSA_BACKEND_SELECTED == 1)
 #endif
 // <q> NRF_CRYPTO_BACKEND_MICRO_ECC_ECC_SECP192R1_ENABLED  - Enable secp192r1 (NIST 192-bit) curve
  
@@ -828,7 +872,7 @@
 // <i> The nRF SW cryptography backend (only used in bootloader context).
 //==========================================================
 #ifndef NRF_CRYPTO_BACKEND_NRF_SW_ENABLED
-#define NRF_CRYPTO_BACKEND_NRF_SW_ENABLED 1
+#define NRF_CRYPTO_BACKEND_NRF_SW_ENABLED (NRF_DFU_ECDSA_BACKEND_SELECTED != 3)
 #endif
 // <q> NRF_CRYPTO_BACKEND_NRF_SW_HASH_SHA256_ENABLED  - nRF SW hash backend support for SHA-256
  
@@ -836,7 +880,7 @@
 // <i> The nRF SW backend provide access to nRF SDK legacy hash implementation of SHA-256.
 
 #ifndef NRF_CRYPTO_BACKEND_NRF_SW_HASH_SHA256_ENABLED
-#define NRF_CRYPTO_BACKEND_NRF_SW_HASH_SHA256_ENABLED 1
+#define NRF_CRYPTO_BACKEND_NRF_SW_HASH_SHA256_ENABLED (NRF_DFU_ECDSA_BACKEND_SELECTED != 3)
 #endif
 
 // </e>
@@ -846,7 +890,7 @@
 // <i> The Oberon backend
 //==========================================================
 #ifndef NRF_CRYPTO_BACKEND_OBERON_ENABLED
-#define NRF_CRYPTO_BACKEND_OBERON_ENABLED 0
+#define NRF_CRYPTO_BACKEND_OBERON_ENABLED (NRF_DFU_ECDSA_BACKEND_SELECTED == 2)
 #endif
 // <q> NRF_CRYPTO_BACKEND_OBERON_CHACHA_POLY_ENABLED  - Enable the CHACHA-POLY mode using Oberon.
  
@@ -888,7 +932,7 @@
 // <i> Oberon backend implementation for SHA-256.
 
 #ifndef NRF_CRYPTO_BACKEND_OBERON_HASH_SHA256_ENABLED
-#define NRF_CRYPTO_BACKEND_OBERON_HASH_SHA256_ENABLED 1
+#define NRF_CRYPTO_BACKEND_OBERON_HASH_SHA256_ENABLED 0
 #endif
 
 // <q> NRF_CRYPTO_BACKEND_OBERON_HASH_SHA512_ENABLED  - Oberon SHA-512 hash functionality
@@ -1311,6 +1355,121 @@
 #define NRF_DFU_SAVE_PROGRESS_IN_FLASH 0
 #endif
 
+// <q> NRF_DFU_STREAMING_HASH  - Hash the firmware while it is received.
+ 
+
+// <i> The SHA-256 of the firmware is updated on each write and saved with the progress
+// <i> at the end of each data object, so the firmware is not hashed again after the last
+// <i> object is executed. Instead, each data object is read back and checked with the
+// <i> CRC of the received data when it is executed. If a transfer is resumed in the
+// <i> middle of an object, the whole firmware is hashed in postvalidation as before.
+
+#ifndef NRF_DFU_STREAMING_HASH
+#define NRF_DFU_STREAMING_HASH 1
+#endif
+
+// <q> NRF_DFU_HOT_PATH_LOG_ENABLED  - Log in the path of every packet.
+ 
+
+// <i> Debug messages of write requests, responses and flash writes are compiled out
+// <i> unless this is enabled, they cost more than handling the packet.
+
+#ifndef NRF_DFU_HOT_PATH_LOG_ENABLED
+#define NRF_DFU_HOT_PATH_LOG_ENABLED 0
+#endif
+
+// <q> NRF_DFU_CYCLE_TRACE_ENABLED  - Trace the CPU cycles of each request.
+ 
+
+// <i> The DWT cycle counter measures the handling of each request. The average and
+// <i> the maximum of write and other requests are logged at every executed data object.
+
+#ifndef NRF_DFU_CYCLE_TRACE_ENABLED
+#define NRF_DFU_CYCLE_TRACE_ENABLED 0
+#endif
+
+// <o> NRF_DFU_FLASH_COMBINE_SIZE  - Size of a combined flash write. 
+// <i> Contiguous data writes are copied into a buffer and written as one
+// <i> flash operation, RX buffers are free as soon as they are copied.
+// <i> Must be a divisor of the flash page size, 0 writes each RX buffer.
+
+#ifndef NRF_DFU_FLASH_COMBINE_SIZE
+#define NRF_DFU_FLASH_COMBINE_SIZE 4096
+#endif
+
+// <o> NRF_DFU_FLASH_COMBINE_BUFFERS  - Number of combine buffers. 
+// <i> A buffer is filled while another one is written. Each takes
+// <i> NRF_DFU_FLASH_COMBINE_SIZE bytes of RAM.
+
+#ifndef NRF_DFU_FLASH_COMBINE_BUFFERS
+#define NRF_DFU_FLASH_COMBINE_BUFFERS 2
+#endif
+
+// <o> NRF_DFU_FLASH_BACKLOG_SIZE  - Flash operations held while the fstorage queue is full. 
+// <i> Operations are submitted to fstorage in order when it has space,
+// <i> instead of being dropped. Must be larger than NRF_DFU_FLASH_COMBINE_BUFFERS.
+
+#ifndef NRF_DFU_FLASH_BACKLOG_SIZE
+#define NRF_DFU_FLASH_BACKLOG_SIZE 4
+#endif
+
+// <q> NRF_DFU_FLASH_STATS_ENABLED  - Histograms of flash operations.
+ 
+
+// <i> Queue depth at submission and latency to completion of flash
+// <i> operations are logged when the DFU is completed.
+
+#ifndef NRF_DFU_FLASH_STATS_ENABLED
+#define NRF_DFU_FLASH_STATS_ENABLED 0
+#endif
+
+// <q> NRF_DFU_FLASH_ERASED_MAP_ENABLED  - Skip the erase of blank pages.
+ 
+
+// <i> The pages of the firmware are blank checked when the init command is
+// <i> executed, and tracked in RAM afterwards. A data object on pages which are
+// <i> still blank, e.g. after a reset or a retry, is created without erasing them.
+
+#ifndef NRF_DFU_FLASH_ERASED_MAP_ENABLED
+#define NRF_DFU_FLASH_ERASED_MAP_ENABLED 1
+#endif
+
+// <q> NRF_DFU_PRE_ERASE_ENABLED  - Erase the firmware pages in the background.
+ 
+
+// <i> Once the init command is executed, the pages of the firmware which are
+// <i> not blank are erased one at a time between requests, ahead of the data
+// <i> object being received, so creating an object does not wait for an erase.
+// <i> Requires NRF_DFU_FLASH_ERASED_MAP_ENABLED. With NVMC, the CPU is halted
+// <i> during an erase, it only helps if data is received meanwhile without loss,
+// <i> i.e. NRF_DFU_SERIAL_UART_USES_LIBUARTE with NRF_DFU_SERIAL_UART_USES_HWFC.
+
+#ifndef NRF_DFU_PRE_ERASE_ENABLED
+#define NRF_DFU_PRE_ERASE_ENABLED 0
+#endif
+
+// <q> NRF_DFU_STAGE_TIMING_ENABLED  - Time the stages of each data object.
+ 
+
+// <i> Erase, reception, CRC, hash, flash, verify, execute and postvalidation times
+// <i> are logged in RTC ticks when each data object is executed, and the totals
+// <i> when the DFU is completed. Requires NRF_LOG_ENABLED with a backend other
+// <i> than the DFU UART, e.g. RTT. Parse the log with scripts/dfu_timing.py.
+
+#ifndef NRF_DFU_STAGE_TIMING_ENABLED
+#define NRF_DFU_STAGE_TIMING_ENABLED 0
+#endif
+
+// <q> NRF_DFU_SIGNATURE_BENCHMARK_ENABLED  - Time the signature check.
+ 
+
+// <i> The DWT cycle counter measures the SHA-256 and the ECDSA verify of the
+// <i> init command, they are logged with the backend of NRF_DFU_ECDSA_BACKEND.
+
+#ifndef NRF_DFU_SIGNATURE_BENCHMARK_ENABLED
+#define NRF_DFU_SIGNATURE_BENCHMARK_ENABLED 0
+#endif
+
 // <q> NRF_DFU_SUPPORTS_EXTERNAL_APP  - [Experimental] Support for external app.
  
 
@@ -1344,12 +1503,64 @@
 // <o> NRF_DFU_SERIAL_UART_RX_BUFFERS - Number of RX buffers. 
 // <i> Number of buffers depends on flash access vs.
 // <i> transport throughtput. If value is too low it may lead
-// <i> to received packets being dropped.
+// <i> to received packets being dropped. With the SoftDevice
+// <i> fstorage backend, NRF_FSTORAGE_SD_QUEUE_SIZE must not be less.
 
 #ifndef NRF_DFU_SERIAL_UART_RX_BUFFERS
 #define NRF_DFU_SERIAL_UART_RX_BUFFERS 3
 #endif
 
+// <o> NRF_DFU_SERIAL_UART_PAYLOAD_SIZE - Max payload of a packet  <64-1024> 
+// <i> MTU reported by NRF_DFU_OP_MTU_GET is (2 * (size + 1) + 1),
+// <i> each RX buffer holds a packet of MTU bytes, about
+// <i> (2 * size + 8) bytes of RAM.
+
+#ifndef NRF_DFU_SERIAL_UART_PAYLOAD_SIZE
+#define NRF_DFU_SERIAL_UART_PAYLOAD_SIZE 256
+#endif
+
+// <o> NRF_DFU_SERIAL_UART_RAM_BUDGET - RAM for transport buffers 
+// <i> RX buffers, the response buffer and libUARTE RX buffers
+// <i> are checked against it at build time.
+
+#ifndef NRF_DFU_SERIAL_UART_RAM_BUDGET
+#define NRF_DFU_SERIAL_UART_RAM_BUDGET 8192
+#endif
+
+// <e> NRF_DFU_SERIAL_UART_USES_LIBUARTE - Receive with libUARTE
+// <i> Data is received by EasyDMA into double buffers, a buffer is
+// <i> handed over when it is full or after an RX timeout, and SLIP is
+// <i> decoded per buffer instead of one interrupt per byte.
+// <i> It uses UARTE0, TIMER1 and TIMER2. UART0_ENABLED must be 0,
+// <i> NRF_LIBUARTE_DRV_UARTE0, NRFX_TIMER_ENABLED, NRFX_TIMER1_ENABLED,
+// <i> NRFX_TIMER2_ENABLED, NRFX_PPI_ENABLED and NRF_QUEUE_ENABLED must be 1.
+//==========================================================
+#ifndef NRF_DFU_SERIAL_UART_USES_LIBUARTE
+#define NRF_DFU_SERIAL_UART_USES_LIBUARTE 0
+#endif
+// <o> NRF_DFU_SERIAL_UART_LIBUARTE_RX_BUF_SIZE - Size of a libUARTE RX buffer  <1-255> 
+// <i> Limited by the EasyDMA MAXCNT of nRF52832.
+
+#ifndef NRF_DFU_SERIAL_UART_LIBUARTE_RX_BUF_SIZE
+#define NRF_DFU_SERIAL_UART_LIBUARTE_RX_BUF_SIZE 255
+#endif
+
+// <o> NRF_DFU_SERIAL_UART_LIBUARTE_RX_BUF_CNT - Number of libUARTE RX buffers  <3-8> 
+
+#ifndef NRF_DFU_SERIAL_UART_LIBUARTE_RX_BUF_CNT
+#define NRF_DFU_SERIAL_UART_LIBUARTE_RX_BUF_CNT 3
+#endif
+
+// <o> NRF_DFU_SERIAL_UART_LIBUARTE_TIMEOUT_US - RX timeout in us 
+// <i> Bytes of a partly filled buffer are handed over after the line
+// <i> is idle for this time. It should be a few bytes at the baudrate.
+
+#ifndef NRF_DFU_SERIAL_UART_LIBUARTE_TIMEOUT_US
+#define NRF_DFU_SERIAL_UART_LIBUARTE_TIMEOUT_US 100
+#endif
+
+// </e>
+
 // </h> 
 //==========================================================
 
@@ -1359,6 +1570,13 @@
 // <h> nRF_Drivers 
 
 //==========================================================
+// <q> NRFX_PPI_ENABLED  - nrfx_ppi - PPI peripheral allocator
+ 
+
+#ifndef NRFX_PPI_ENABLED
+#define NRFX_PPI_ENABLED 0
+#endif
+
 // <e> NRFX_PRS_ENABLED - nrfx_prs - Peripheral Resource Sharing module
 //==========================================================
 #ifndef NRFX_PRS_ENABLED
@@ -1452,6 +1670,93 @@
 
 // </e>
 
+// <e> NRFX_TIMER_ENABLED - nrfx_timer - TIMER periperal driver
+//==========================================================
+#ifndef NRFX_TIMER_ENABLED
+#define NRFX_TIMER_ENABLED 0
+#endif
+// <q> NRFX_TIMER0_ENABLED  - Enable TIMER0 instance
+ 
+
+#ifndef NRFX_TIMER0_ENABLED
+#define NRFX_TIMER0_ENABLED 0
+#endif
+
+// <q> NRFX_TIMER1_ENABLED  - Enable TIMER1 instance
+ 
+
+#ifndef NRFX_TIMER1_ENABLED
+#define NRFX_TIMER1_ENABLED 0
+#endif
+
+// <q> NRFX_TIMER2_ENABLED  - Enable TIMER2 instance
+ 
+
+#ifndef NRFX_TIMER2_ENABLED
+#define NRFX_TIMER2_ENABLED 0
+#endif
+
+// <o> NRFX_TIMER_DEFAULT_CONFIG_FREQUENCY  - Timer frequency if in Timer mode
+ 
+// <0=> 16 MHz 
+// <1=> 8 MHz 
+// <2=> 4 MHz 
+// <3=> 2 MHz 
+// <4=> 1 MHz 
+// <5=> 500 kHz 
+// <6=> 250 kHz 
+// <7=> 125 kHz 
+// <8=> 62.5 kHz 
+// <9=> 31.25 kHz 
+
+#ifndef NRFX_TIMER_DEFAULT_CONFIG_FREQUENCY
+#define NRFX_TIMER_DEFAULT_CONFIG_FREQUENCY 0
+#endif
+
+// <o> NRFX_TIMER_DEFAULT_CONFIG_MODE  - Timer mode or operation
+ 
+// <0=> Timer 
+// <1=> Counter 
+
+#ifndef NRFX_TIMER_DEFAULT_CONFIG_MODE
+#define NRFX_TIMER_DEFAULT_CONFIG_MODE 0
+#endif
+
+// <o> NRFX_TIMER_DEFAULT_CONFIG_BIT_WIDTH  - Timer counter bit width
+ 
+// <0=> 16 bit 
+// <1=> 8 bit 
+// <2=> 24 bit 
+// <3=> 32 bit 
+
+#ifndef NRFX_TIMER_DEFAULT_CONFIG_BIT_WIDTH
+#define NRFX_TIMER_DEFAULT_CONFIG_BIT_WIDTH 0
+#endif
+
+// <o> NRFX_TIMER_DEFAULT_CONFIG_IRQ_PRIORITY  - Interrupt priority
+ 
+// <0=> 0 (highest) 
+// <1=> 1 
+// <2=> 2 
+// <3=> 3 
+// <4=> 4 
+// <5=> 5 
+// <6=> 6 
+// <7=> 7 
+
+#ifndef NRFX_TIMER_DEFAULT_CONFIG_IRQ_PRIORITY
+#define NRFX_TIMER_DEFAULT_CONFIG_IRQ_PRIORITY 6
+#endif
+
+// <e> NRFX_TIMER_CONFIG_LOG_ENABLED - Enables logging in the module.
+//==========================================================
+#ifndef NRFX_TIMER_CONFIG_LOG_ENABLED
+#define NRFX_TIMER_CONFIG_LOG_ENABLED 0
+#endif
+// </e>
+
+// </e>
+
 // <e> NRFX_UARTE_ENABLED - nrfx_uarte - UARTE peripheral driver
 //==========================================================
 #ifndef NRFX_UARTE_ENABLED
@@ -2104,6 +2409,33 @@
 #define NRF_MEMOBJ_ENABLED 1
 #endif
 
+// <h> nrf_libuarte_drv - libUARTE library
+
+//==========================================================
+// <q> NRF_LIBUARTE_DRV_HWFC_ENABLED  - Enable HWFC support in the driver
+ 
+
+#ifndef NRF_LIBUARTE_DRV_HWFC_ENABLED
+#define NRF_LIBUARTE_DRV_HWFC_ENABLED 0
+#endif
+
+// <q> NRF_LIBUARTE_DRV_UARTE0  - UARTE0 instance
+ 
+
+#ifndef NRF_LIBUARTE_DRV_UARTE0
+#define NRF_LIBUARTE_DRV_UARTE0 0
+#endif
+
+// </h> 
+//==========================================================
+
+// <q> NRF_LIBUARTE_ASYNC_WITH_APP_TIMER  - nrf_libuarte_async - libUARTE_async library
+ 
+
+#ifndef NRF_LIBUARTE_ASYNC_WITH_APP_TIMER
+#define NRF_LIBUARTE_ASYNC_WITH_APP_TIMER 0
+#endif
+
 // <e> NRF_QUEUE_ENABLED - nrf_queue - Queue module
 //==========================================================
 #ifndef NRF_QUEUE_ENABLED
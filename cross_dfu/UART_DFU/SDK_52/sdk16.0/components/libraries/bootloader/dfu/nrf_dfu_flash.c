@@ -38,8 +38,11 @@
  *
  */
 
+
+#include <string.h>
 #include "nrf_dfu_flash.h"
 #include "nrf_dfu_types.h"
+#include "app_util_platform.h"
 
 #include "nrf_fstorage.h"
 #include "nrf_fstorage_sd.h"
@@ -51,6 +54,45 @@
 NRF_LOG_MODULE_REGISTER();
 
 
+#ifndef NRF_DFU_FLASH_COMBINE_SIZE
+#define NRF_DFU_FLASH_COMBINE_SIZE      0       /**< Size of a combined write, 0 to write each buffer as it is. */
+#endif
+
+#ifndef NRF_DFU_FLASH_COMBINE_BUFFERS
+#define NRF_DFU_FLASH_COMBINE_BUFFERS   2
+#endif
+
+#ifndef NRF_DFU_FLASH_BACKLOG_SIZE
+#define NRF_DFU_FLASH_BACKLOG_SIZE      4
+#endif
+
+#ifndef NRF_DFU_FLASH_STATS_ENABLED
+#define NRF_DFU_FLASH_STATS_ENABLED     0
+#endif
+
+#ifndef NRF_DFU_FLASH_ERASED_MAP_ENABLED
+#define NRF_DFU_FLASH_ERASED_MAP_ENABLED 0
+#endif
+
+#if NRF_DFU_FLASH_COMBINE_SIZE
+#define COMBINE_RESERVED                NRF_DFU_FLASH_COMBINE_BUFFERS   /**< Backlog entries kept for combined writes. */
+#else
+#define COMBINE_RESERVED                0
+#endif
+
+STATIC_ASSERT(NRF_DFU_FLASH_BACKLOG_SIZE > COMBINE_RESERVED,
+              "NRF_DFU_FLASH_BACKLOG_SIZE must be larger than NRF_DFU_FLASH_COMBINE_BUFFERS.");
+
+#if NRF_DFU_FLASH_STATS_ENABLED
+#include "nrf_bootloader_dfu_timers.h"
+
+#define STATS_DEPTH_BINS                8       /**< Queue depth of 0 to 6, and 7 or more. */
+#define STATS_LATENCY_BINS              9       /**< Latency below 1, 2, 4 ... 128 ms, and longer. */
+#define STATS_IN_FLIGHT_MAX             32      /**< Operations timed at the same time. */
+#define STATS_TICKS_PER_MS_SHIFT        5       /**< RTC ticks of about 1 ms, 32 at 32768 Hz. */
+#endif
+
+
 void dfu_fstorage_evt_handler(nrf_fstorage_evt_t * p_evt);
 
 
@@ -61,26 +103,345 @@ NRF_FSTORAGE_DEF(nrf_fstorage_t m_fs) =
     .end_addr    = BOOTLOADER_SETTINGS_ADDRESS + BOOTLOADER_SETTINGS_PAGE_SIZE
 };
 
-static uint32_t m_flash_operations_pending;
+
+/**@brief Flash operation waiting for space in the queue of nrf_fstorage. */
+typedef struct
+{
+    uint32_t                 addr;
+    void             const * p_src;     /**< Data to write, NULL to erase. */
+    uint32_t                 len;       /**< Number of bytes to write, or number of pages to erase. */
+    nrf_dfu_flash_callback_t callback;
+} flash_op_t;
+
+static uint32_t                 m_flash_operations_pending;
+static nrf_dfu_flash_callback_t m_idle_callback;    /**< Called when no flash operation is pending. */
+static void                   * mp_idle_context;
+
+static volatile bool            m_failed;           /**< A flash operation failed, see @ref nrf_dfu_flash_failed. */
+
+static flash_op_t               m_backlog[NRF_DFU_FLASH_BACKLOG_SIZE];
+static uint32_t                 m_backlog_first;
+static uint32_t                 m_backlog_count;
+static bool                     m_backlog_processing;
+
+#if NRF_DFU_FLASH_COMBINE_SIZE
+STATIC_ASSERT(((NRF_DFU_FLASH_COMBINE_SIZE % sizeof(uint32_t)) == 0) &&
+              ((CODE_PAGE_SIZE % NRF_DFU_FLASH_COMBINE_SIZE) == 0),
+              "NRF_DFU_FLASH_COMBINE_SIZE must be a divisor of the flash page size.");
+
+/**@brief Buffer to combine contiguous writes into one flash operation. */
+typedef struct
+{
+    uint32_t          addr;                                             /**< Flash address of the first byte. */
+    uint32_t          len;                                              /**< Number of bytes in the buffer. */
+    volatile bool     busy;                                             /**< Being filled, or written to flash. */
+    uint32_t          data[NRF_DFU_FLASH_COMBINE_SIZE / sizeof(uint32_t)];
+} combine_buf_t;
+
+static combine_buf_t            m_combine_bufs[NRF_DFU_FLASH_COMBINE_BUFFERS];
+static combine_buf_t          * mp_combine_fill;    /**< Buffer being filled, NULL if none. */
+#endif
+
+#if NRF_DFU_FLASH_ERASED_MAP_ENABLED
+#define ERASED_MAP_PAGES                (0x100000 / CODE_PAGE_SIZE)     /**< Pages of 1 MB of flash. */
+
+static uint32_t                 m_erased_map[ERASED_MAP_PAGES / 32];   /**< A bit is set if the page is known to be blank. */
+
+
+/**@brief Function for marking pages as blank, or as written. */
+static void erased_map_update(uint32_t page_addr, uint32_t num_pages, bool erased)
+{
+    uint32_t page = page_addr / CODE_PAGE_SIZE;
+
+    CRITICAL_REGION_ENTER();
+    for (; (num_pages > 0) && (page < ERASED_MAP_PAGES); num_pages--, page++)
+    {
+        if (erased)
+        {
+            m_erased_map[page / 32] |= (1UL << (page % 32));
+        }
+        else
+        {
+            m_erased_map[page / 32] &= ~(1UL << (page % 32));
+        }
+    }
+    CRITICAL_REGION_EXIT();
+}
+
+
+/**@brief Function for marking the pages of a write as written. */
+static void erased_map_write(uint32_t dest, uint32_t len)
+{
+    if (len > 0)
+    {
+        erased_map_update(dest - (dest % CODE_PAGE_SIZE),
+                          CEIL_DIV((dest % CODE_PAGE_SIZE) + len, CODE_PAGE_SIZE),
+                          false);
+    }
+}
+#else
+#define erased_map_update(page_addr, num_pages, erased)
+#define erased_map_write(dest, len)
+#endif // NRF_DFU_FLASH_ERASED_MAP_ENABLED
+
+#if NRF_DFU_FLASH_STATS_ENABLED
+typedef struct
+{
+    uint32_t depth[STATS_DEPTH_BINS];       /**< Operations pending or in the backlog when one is submitted. */
+    uint32_t latency[STATS_LATENCY_BINS];   /**< Time from submitting an operation to its completion. */
+    uint32_t backlogged;                    /**< Operations held while the queue of nrf_fstorage was full. */
+    uint32_t combined;                      /**< Writes copied into a combine buffer. */
+} flash_stats_t;
+
+static flash_stats_t            m_stats;
+static uint32_t                 m_stats_ticks[STATS_IN_FLIGHT_MAX];     /**< Submit time, in submit order. */
+static uint32_t                 m_stats_first;
+static uint32_t                 m_stats_count;
+
+
+/**@brief Function for recording an operation being submitted. */
+static void stats_op_submit(void)
+{
+    uint32_t depth = m_flash_operations_pending + m_backlog_count;
+
+    m_stats.depth[MIN(depth, STATS_DEPTH_BINS - 1)]++;
+
+    CRITICAL_REGION_ENTER();
+    if (m_stats_count < STATS_IN_FLIGHT_MAX)
+    {
+        m_stats_ticks[(m_stats_first + m_stats_count) % STATS_IN_FLIGHT_MAX] =
+            nrf_bootloader_dfu_timer_counter_get();
+        m_stats_count++;
+    }
+    CRITICAL_REGION_EXIT();
+}
+
+
+/**@brief Function for dropping the operation submitted last, it has failed. */
+static void stats_op_cancel(void)
+{
+    CRITICAL_REGION_ENTER();
+    if (m_stats_count > 0)
+    {
+        m_stats_count--;
+    }
+    CRITICAL_REGION_EXIT();
+}
+
+
+/**@brief Function for recording the completion of the oldest operation, nrf_fstorage completes them in order. */
+static void stats_op_done(void)
+{
+    uint32_t ticks = 0;
+    uint32_t bin   = 0;
+    bool     timed = false;
+
+    CRITICAL_REGION_ENTER();
+    if (m_stats_count > 0)
+    {
+        // The counter is 24 bits wide.
+        ticks = (nrf_bootloader_dfu_timer_counter_get() - m_stats_ticks[m_stats_first]) & 0xFFFFFF;
+        m_stats_first = (m_stats_first + 1) % STATS_IN_FLIGHT_MAX;
+        m_stats_count--;
+        timed = true;
+    }
+    CRITICAL_REGION_EXIT();
+
+    if (!timed)
+    {
+        return;
+    }
+
+    for (ticks >>= STATS_TICKS_PER_MS_SHIFT; (ticks > 0) && (bin < STATS_LATENCY_BINS - 1); ticks >>= 1)
+    {
+        bin++;
+    }
+
+    m_stats.latency[bin]++;
+}
+#else
+#define stats_op_submit()
+#define stats_op_cancel()
+#define stats_op_done()
+#endif // NRF_DFU_FLASH_STATS_ENABLED
+
+
+static void flash_operation_add(void)
+{
+    CRITICAL_REGION_ENTER();
+    m_flash_operations_pending++;
+    CRITICAL_REGION_EXIT();
+}
+
+
+static void flash_operation_cancel(void)
+{
+    CRITICAL_REGION_ENTER();
+    m_flash_operations_pending--;
+    CRITICAL_REGION_EXIT();
+}
+
+
+/**@brief Function for handing an operation to nrf_fstorage. */
+static ret_code_t flash_op_start(flash_op_t const * p_op)
+{
+    ret_code_t rc;
+
+    // Counted first, the NVMC backend completes the operation before returning.
+    flash_operation_add();
+
+    //lint -save -e611 (Suspicious cast)
+    if (p_op->p_src != NULL)
+    {
+        rc = nrf_fstorage_write(&m_fs, p_op->addr, p_op->p_src, p_op->len, (void *)p_op->callback);
+    }
+    else
+    {
+        rc = nrf_fstorage_erase(&m_fs, p_op->addr, p_op->len, (void *)p_op->callback);
+    }
+    //lint -restore
+
+    if (rc != NRF_SUCCESS)
+    {
+        flash_operation_cancel();
+    }
+
+    return rc;
+}
+
+
+/**@brief Function for submitting an operation, it is held in the backlog while the queue of
+ *        nrf_fstorage is full.
+ *
+ * @param[in]  p_op      Operation, copied.
+ * @param[in]  reserved  Number of backlog entries which must be left free.
+ */
+static ret_code_t flash_op_submit(flash_op_t const * p_op, uint32_t reserved)
+{
+    ret_code_t rc     = NRF_ERROR_NO_MEM;
+    bool       queued = false;
+
+    stats_op_submit();
+
+    // Nothing overtakes the backlog, operations complete in the order they are submitted.
+    if (m_backlog_count == 0)
+    {
+        rc = flash_op_start(p_op);
+        if (rc != NRF_ERROR_NO_MEM)
+        {
+            if (rc != NRF_SUCCESS)
+            {
+                stats_op_cancel();
+            }
+            return rc;
+        }
+    }
+
+    CRITICAL_REGION_ENTER();
+    if (m_backlog_count + reserved < NRF_DFU_FLASH_BACKLOG_SIZE)
+    {
+        m_backlog[(m_backlog_first + m_backlog_count) % NRF_DFU_FLASH_BACKLOG_SIZE] = *p_op;
+        m_backlog_count++;
+        queued = true;
+    }
+    CRITICAL_REGION_EXIT();
+
+    if (!queued)
+    {
+        stats_op_cancel();
+        return NRF_ERROR_NO_MEM;
+    }
+
+#if NRF_DFU_FLASH_STATS_ENABLED
+    m_stats.backlogged++;
+#endif
+
+    return NRF_SUCCESS;
+}
+
+
+/**@brief Function for moving operations from the backlog to nrf_fstorage, called when one has completed. */
+static void backlog_process(void)
+{
+    // The NVMC backend completes the operation, and calls this function again, before returning.
+    if (m_backlog_processing)
+    {
+        return;
+    }
+
+    m_backlog_processing = true;
+
+    while (m_backlog_count > 0)
+    {
+        flash_op_t const * p_op = &m_backlog[m_backlog_first];
+        ret_code_t         rc   = flash_op_start(p_op);
+
+        if (rc == NRF_ERROR_NO_MEM)
+        {
+            break;
+        }
+
+        if (rc != NRF_SUCCESS)
+        {
+            NRF_LOG_ERROR("Flash operation at 0x%x failed (0x%x).", p_op->addr, rc);
+            stats_op_done();
+
+            if (p_op->p_src == NULL)
+            {
+                erased_map_update(p_op->addr, p_op->len, false);
+            }
+
+            // The data was acknowledged already, the request handler fails the object.
+            m_failed = true;
+
+            // The buffer is released like after a completed operation.
+            if (p_op->callback != NULL)
+            {
+                p_op->callback((void *)p_op->p_src);
+            }
+        }
+
+        CRITICAL_REGION_ENTER();
+        m_backlog_first = (m_backlog_first + 1) % NRF_DFU_FLASH_BACKLOG_SIZE;
+        m_backlog_count--;
+        CRITICAL_REGION_EXIT();
+    }
+
+    m_backlog_processing = false;
+}
+
 
 void dfu_fstorage_evt_handler(nrf_fstorage_evt_t * p_evt)
 {
-    if (NRF_LOG_ENABLED && (m_flash_operations_pending > 0))
+    nrf_dfu_flash_callback_t idle_callback = NULL;
+
+    CRITICAL_REGION_ENTER();
+    if (m_flash_operations_pending > 0)
     {
         m_flash_operations_pending--;
     }
+    CRITICAL_REGION_EXIT();
+
+    stats_op_done();
 
     if (p_evt->result == NRF_SUCCESS)
     {
-        NRF_LOG_DEBUG("Flash %s success: addr=%p, pending %d",
-                      (p_evt->id == NRF_FSTORAGE_EVT_WRITE_RESULT) ? "write" : "erase",
-                      p_evt->addr, m_flash_operations_pending);
+        NRF_DFU_HOT_PATH_LOG("Flash %s success: addr=%p, pending %d",
+                             (p_evt->id == NRF_FSTORAGE_EVT_WRITE_RESULT) ? "write" : "erase",
+                             p_evt->addr, m_flash_operations_pending);
     }
     else
     {
         NRF_LOG_DEBUG("Flash %s failed (0x%x): addr=%p, len=0x%x bytes, pending %d",
                       (p_evt->id == NRF_FSTORAGE_EVT_WRITE_RESULT) ? "write" : "erase",
                       p_evt->result, p_evt->addr, p_evt->len, m_flash_operations_pending);
+
+        if (p_evt->id == NRF_FSTORAGE_EVT_ERASE_RESULT)
+        {
+            erased_map_update(p_evt->addr, p_evt->len, false);
+        }
+
+        m_failed = true;
     }
 
     if (p_evt->p_param)
@@ -89,6 +450,152 @@ void dfu_fstorage_evt_handler(nrf_fstorage_evt_t * p_evt)
         ((nrf_dfu_flash_callback_t)(p_evt->p_param))((void*)p_evt->p_src);
         //lint -restore
     }
+
+    backlog_process();
+
+    // The callback of the operation may have queued another one.
+    CRITICAL_REGION_ENTER();
+    if ((m_flash_operations_pending == 0) && (m_backlog_count == 0))
+    {
+        idle_callback   = m_idle_callback;
+        m_idle_callback = NULL;
+    }
+    CRITICAL_REGION_EXIT();
+
+    if (idle_callback != NULL)
+    {
+        idle_callback(mp_idle_context);
+    }
+}
+
+
+#if NRF_DFU_FLASH_COMBINE_SIZE
+/**@brief Function called when a combine buffer is written. */
+static void combine_buf_written(void * p_buf)
+{
+    for (uint32_t i = 0; i < NRF_DFU_FLASH_COMBINE_BUFFERS; i++)
+    {
+        if (m_combine_bufs[i].data == p_buf)
+        {
+            m_combine_bufs[i].busy = false;
+        }
+    }
+}
+
+
+/**@brief Function for getting the end of the combine window of an address. */
+static uint32_t combine_window_end(uint32_t addr)
+{
+    return (addr - (addr % NRF_DFU_FLASH_COMBINE_SIZE)) + NRF_DFU_FLASH_COMBINE_SIZE;
+}
+
+
+/**@brief Function for counting the combine buffers which are not being filled or written. */
+static uint32_t combine_bufs_free(void)
+{
+    uint32_t count = 0;
+
+    for (uint32_t i = 0; i < NRF_DFU_FLASH_COMBINE_BUFFERS; i++)
+    {
+        if (!m_combine_bufs[i].busy)
+        {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+
+/**@brief Function for taking a free combine buffer.
+ *
+ * The buffer starts at the word of @p addr, the bytes before it are 0xFF and leave the flash
+ * unchanged.
+ *
+ * @return The buffer, or NULL if all buffers are being written.
+ */
+static combine_buf_t * combine_buf_get(uint32_t addr)
+{
+    uint32_t const head = addr % sizeof(uint32_t);
+
+    for (uint32_t i = 0; i < NRF_DFU_FLASH_COMBINE_BUFFERS; i++)
+    {
+        if (!m_combine_bufs[i].busy)
+        {
+            m_combine_bufs[i].busy = true;
+            m_combine_bufs[i].addr = addr - head;
+            m_combine_bufs[i].len  = head;
+            memset(m_combine_bufs[i].data, 0xFF, head);
+            return &m_combine_bufs[i];
+        }
+    }
+
+    return NULL;
+}
+#endif // NRF_DFU_FLASH_COMBINE_SIZE
+
+
+/**@brief Function for writing the buffer being filled. */
+static void combine_flush(void)
+{
+#if NRF_DFU_FLASH_COMBINE_SIZE
+    combine_buf_t * p_buf = mp_combine_fill;
+
+    if (p_buf == NULL)
+    {
+        return;
+    }
+
+    mp_combine_fill = NULL;
+
+    // Pad to a whole word, writing 0xFF leaves the flash unchanged.
+    uint32_t   const len = ALIGN_NUM(sizeof(uint32_t), p_buf->len);
+    flash_op_t const op  =
+    {
+        .addr     = p_buf->addr,
+        .p_src    = p_buf->data,
+        .len      = len,
+        .callback = combine_buf_written,
+    };
+
+    memset((uint8_t *)p_buf->data + p_buf->len, 0xFF, len - p_buf->len);
+
+    NRF_DFU_HOT_PATH_LOG("Combined write (addr=%p, len=%d bytes)", op.addr, op.len);
+
+    // Backlog entries are reserved for the combine buffers, only an invalid address fails.
+    ret_code_t rc = flash_op_submit(&op, 0);
+    if (rc != NRF_SUCCESS)
+    {
+        NRF_LOG_ERROR("Combined write at 0x%x failed (0x%x).", op.addr, rc);
+        p_buf->busy = false;
+        m_failed    = true;
+    }
+#endif
+}
+
+
+/**@brief Function for writing the buffer being filled if its window is in the given pages.
+ *
+ * The buffer is written before the pages are erased, like the data of the caller would be.
+ * Erasing other pages, e.g. ahead of the data being received, leaves it filling.
+ */
+static void combine_flush_pages(uint32_t page_addr, uint32_t num_pages)
+{
+#if NRF_DFU_FLASH_COMBINE_SIZE
+    combine_buf_t const * p_buf = mp_combine_fill;
+
+    if (p_buf == NULL)
+    {
+        return;
+    }
+
+    uint32_t const window_start = combine_window_end(p_buf->addr) - NRF_DFU_FLASH_COMBINE_SIZE;
+
+    if ((window_start >= page_addr) && (window_start < page_addr + num_pages * CODE_PAGE_SIZE))
+    {
+        combine_flush();
+    }
+#endif
 }
 
 
@@ -119,20 +626,28 @@ ret_code_t nrf_dfu_flash_store(uint32_t                   dest,
                                uint32_t                   len,
                                nrf_dfu_flash_callback_t   callback)
 {
-    ret_code_t rc;
-
-    NRF_LOG_DEBUG("nrf_fstorage_write(addr=%p, src=%p, len=%d bytes), queue usage: %d",
-                  dest, p_src, len, m_flash_operations_pending);
+    ret_code_t       rc;
+    flash_op_t const op =
+    {
+        .addr     = dest,
+        .p_src    = p_src,
+        .len      = len,
+        .callback = callback,
+    };
 
-    //lint -save -e611 (Suspicious cast)
-    rc = nrf_fstorage_write(&m_fs, dest, p_src, len, (void *)callback);
-    //lint -restore
+    NRF_DFU_HOT_PATH_LOG("nrf_fstorage_write(addr=%p, src=%p, len=%d bytes), queue usage: %d",
+                         dest, p_src, len, m_flash_operations_pending);
 
-    if ((NRF_LOG_ENABLED) && (rc == NRF_SUCCESS))
+    if (p_src == NULL)
     {
-        m_flash_operations_pending++;
+        return NRF_ERROR_NULL;
     }
-    else
+
+    combine_flush();
+    erased_map_write(dest, len);
+
+    rc = flash_op_submit(&op, COMBINE_RESERVED);
+    if (rc != NRF_SUCCESS)
     {
         NRF_LOG_WARNING("nrf_fstorage_write() failed with error 0x%x.", rc);
     }
@@ -141,27 +656,226 @@ ret_code_t nrf_dfu_flash_store(uint32_t                   dest,
 }
 
 
+ret_code_t nrf_dfu_flash_store_combined(uint32_t                 dest,
+                                        void             const * p_src,
+                                        uint32_t                 len,
+                                        nrf_dfu_flash_callback_t callback)
+{
+#if NRF_DFU_FLASH_COMBINE_SIZE
+    combine_buf_t * p_buf = mp_combine_fill;
+    uint32_t        start = dest;
+
+    if (p_src == NULL)
+    {
+        return NRF_ERROR_NULL;
+    }
+
+    if ((p_buf != NULL) && (dest != p_buf->addr + p_buf->len))
+    {
+        combine_flush();
+        p_buf = NULL;
+    }
+
+    // The bytes up to the end of the window of the buffer being filled need no other buffer.
+    if (p_buf != NULL)
+    {
+        start = combine_window_end(p_buf->addr);
+    }
+
+    // Copied whole or not at all, fstorage only ever gets whole words from the combine buffers.
+    if ((dest + len > start) &&
+        (CEIL_DIV(dest + len - (start - (start % NRF_DFU_FLASH_COMBINE_SIZE)), NRF_DFU_FLASH_COMBINE_SIZE) >
+         combine_bufs_free()))
+    {
+        return NRF_ERROR_BUSY;
+    }
+
+    erased_map_write(dest, len);
+
+    for (uint32_t pos = 0; pos < len; )
+    {
+        if (p_buf == NULL)
+        {
+            p_buf           = combine_buf_get(dest + pos);
+            mp_combine_fill = p_buf;
+        }
+
+        uint32_t const window_end = combine_window_end(p_buf->addr);
+        uint32_t const chunk      = MIN(len - pos, window_end - (dest + pos));
+
+        memcpy((uint8_t *)p_buf->data + p_buf->len, (uint8_t const *)p_src + pos, chunk);
+        p_buf->len += chunk;
+        pos        += chunk;
+
+        if (p_buf->addr + p_buf->len == window_end)
+        {
+            combine_flush();
+            p_buf = NULL;
+        }
+    }
+
+#if NRF_DFU_FLASH_STATS_ENABLED
+    m_stats.combined++;
+#endif
+
+    // The data is copied, the buffer of the caller is free.
+    if (callback != NULL)
+    {
+        callback((void *)p_src);
+    }
+
+    return NRF_SUCCESS;
+#else
+    return nrf_dfu_flash_store(dest, p_src, len, callback);
+#endif
+}
+
+
 ret_code_t nrf_dfu_flash_erase(uint32_t                 page_addr,
                                uint32_t                 num_pages,
                                nrf_dfu_flash_callback_t callback)
 {
-    ret_code_t rc;
+    ret_code_t       rc;
+    flash_op_t const op =
+    {
+        .addr     = page_addr,
+        .p_src    = NULL,
+        .len      = num_pages,
+        .callback = callback,
+    };
 
     NRF_LOG_DEBUG("nrf_fstorage_erase(addr=0x%p, len=%d pages), queue usage: %d",
                   page_addr, num_pages, m_flash_operations_pending);
 
-    //lint -save -e611 (Suspicious cast)
-    rc = nrf_fstorage_erase(&m_fs, page_addr, num_pages, (void *)callback);
-    //lint -restore
+    combine_flush_pages(page_addr, num_pages);
 
-    if ((NRF_LOG_ENABLED) && (rc == NRF_SUCCESS))
+    rc = flash_op_submit(&op, COMBINE_RESERVED);
+    if (rc != NRF_SUCCESS)
     {
-        m_flash_operations_pending++;
+        NRF_LOG_WARNING("nrf_fstorage_erase() failed with error 0x%x.", rc);
     }
     else
     {
-        NRF_LOG_WARNING("nrf_fstorage_erase() failed with error 0x%x.", rc);
+        // Later writes are done after the erase, a failure is reported by the event.
+        erased_map_update(page_addr, num_pages, true);
     }
 
     return rc;
 }
+
+
+void nrf_dfu_flash_erased_scan(uint32_t page_addr, uint32_t num_pages)
+{
+#if NRF_DFU_FLASH_ERASED_MAP_ENABLED
+    bool busy;
+
+    combine_flush();
+
+    CRITICAL_REGION_ENTER();
+    busy = (m_flash_operations_pending != 0) || (m_backlog_count != 0);
+    CRITICAL_REGION_EXIT();
+
+    for (uint32_t i = 0; i < num_pages; i++)
+    {
+        uint32_t const * p_word = (uint32_t const *)(page_addr + i * CODE_PAGE_SIZE);
+        uint32_t const * p_end  = p_word + (CODE_PAGE_SIZE / sizeof(uint32_t));
+
+        // Pending writes are not in flash yet.
+        while (!busy && (p_word < p_end) && (*p_word == 0xFFFFFFFF))
+        {
+            p_word++;
+        }
+
+        erased_map_update(page_addr + i * CODE_PAGE_SIZE, 1, (p_word == p_end));
+    }
+#endif
+}
+
+
+bool nrf_dfu_flash_erased(uint32_t page_addr, uint32_t num_pages)
+{
+#if NRF_DFU_FLASH_ERASED_MAP_ENABLED
+    uint32_t page = page_addr / CODE_PAGE_SIZE;
+
+    if (((page_addr % CODE_PAGE_SIZE) != 0) || (num_pages == 0) || (page + num_pages > ERASED_MAP_PAGES))
+    {
+        return false;
+    }
+
+    for (; num_pages > 0; num_pages--, page++)
+    {
+        if ((m_erased_map[page / 32] & (1UL << (page % 32))) == 0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+ret_code_t nrf_dfu_flash_idle_notify(nrf_dfu_flash_callback_t callback, void * p_context)
+{
+    ret_code_t rc = NRF_SUCCESS;
+
+    combine_flush();
+
+    CRITICAL_REGION_ENTER();
+    if ((m_flash_operations_pending == 0) && (m_backlog_count == 0))
+    {
+        rc = NRF_ERROR_INVALID_STATE;
+    }
+    else
+    {
+        m_idle_callback = callback;
+        mp_idle_context = p_context;
+    }
+    CRITICAL_REGION_EXIT();
+
+    return rc;
+}
+
+
+bool nrf_dfu_flash_failed(void)
+{
+    return m_failed;
+}
+
+
+void nrf_dfu_flash_failed_clear(void)
+{
+    m_failed = false;
+}
+
+
+void nrf_dfu_flash_stats_log(void)
+{
+#if NRF_DFU_FLASH_STATS_ENABLED
+    NRF_LOG_INFO("Flash operations: %d combined writes, %d held in the backlog.",
+                 m_stats.combined, m_stats.backlogged);
+
+    for (uint32_t i = 0; i < STATS_DEPTH_BINS; i++)
+    {
+        if (m_stats.depth[i] != 0)
+        {
+            NRF_LOG_INFO("Queue depth %d%s: %d", i, (i == STATS_DEPTH_BINS - 1) ? "+" : "", m_stats.depth[i]);
+        }
+    }
+
+    for (uint32_t i = 0; i < STATS_LATENCY_BINS; i++)
+    {
+        if (m_stats.latency[i] != 0)
+        {
+            NRF_LOG_INFO("Latency %s %d ms: %d",
+                         (i == STATS_LATENCY_BINS - 1) ? ">=" : "<",
+                         (i == STATS_LATENCY_BINS - 1) ? (1 << (i - 1)) : (1 << i),
+                         m_stats.latency[i]);
+        }
+    }
+
+    memset(&m_stats, 0, sizeof(m_stats));
+#endif
+}
@@ -94,7 +94,8 @@ ret_code_t nrf_dfu_flash_init(bool sd_irq_initialized);
  * @retval  NRF_ERROR_INVALID_ADDR      If @p p_src or @p dest is not word-aligned.
  * @retval  NRF_ERROR_INVALID_LENGTH    If @p len is zero.
  * @retval  NRF_ERROR_NULL              If @p p_src is NULL.
- * @retval  NRF_ERROR_NO_MEM            If nrf_fstorage is out of memory.
+ * @retval  NRF_ERROR_NO_MEM            If nrf_fstorage is out of memory, and the backlog of
+ *                                      @c NRF_DFU_FLASH_BACKLOG_SIZE operations is full.
  */
 ret_code_t nrf_dfu_flash_store(uint32_t                     dest,
                                void                 const * p_src,
@@ -102,6 +103,30 @@ ret_code_t nrf_dfu_flash_store(uint32_t                     dest,
                                nrf_dfu_flash_callback_t     callback);
 
 
+/**@brief Function for storing data to flash, combined with contiguous writes.
+ *
+ * Contiguous writes are copied into a buffer of @c NRF_DFU_FLASH_COMBINE_SIZE bytes, which is
+ * written as one operation when it is full, or when a write which does not follow it, an erase
+ * of its page, or @ref nrf_dfu_flash_idle_notify is requested. A write may be at any address and of any
+ * length, it is split at the end of a buffer and the buffers are padded to whole words with 0xFF.
+ * The callback is called as soon as the data is copied. If combining is disabled, the data is
+ * written like @ref nrf_dfu_flash_store.
+ *
+ * @param[in]  dest      The address where the data should be stored.
+ * @param[in]  p_src     Pointer to the address where the data should be copied from.
+ * @param[in]  len       The number of bytes to be copied from @p p_src to @p dest.
+ * @param[in]  callback  Callback function.
+ *
+ * @retval  NRF_SUCCESS                 If the data is copied.
+ * @retval  NRF_ERROR_BUSY              If not enough combine buffers are free, nothing is copied.
+ * @retval  NRF_ERROR_NULL              If @p p_src is NULL.
+ */
+ret_code_t nrf_dfu_flash_store_combined(uint32_t                 dest,
+                                        void             const * p_src,
+                                        uint32_t                 len,
+                                        nrf_dfu_flash_callback_t callback);
+
+
 /**@brief Function for erasing data from flash.
  *
  * This functions is asynchronous when the SoftDevice is enabled and synchronous when
@@ -118,11 +143,74 @@ ret_code_t nrf_dfu_flash_store(uint32_t                     dest,
  *                                      operation would go beyond the flash memory boundaries.
  * @retval  NRF_ERROR_INVALID_LENGTH    If @p num_pages is zero.
  * @retval  NRF_ERROR_NULL              If @p page_addr is NULL.
- * @retval  NRF_ERROR_NO_MEM            If the queue of nrf_fstorage is full.
+ * @retval  NRF_ERROR_NO_MEM            If the queue of nrf_fstorage and the backlog are full.
  */
 ret_code_t nrf_dfu_flash_erase(uint32_t page_addr, uint32_t num_pages, nrf_dfu_flash_callback_t callback);
 
 
+/**@brief Function for checking which flash pages are blank.
+ *
+ * The pages found blank are recorded in a map in RAM, they are taken as erased by
+ * @ref nrf_dfu_flash_erased until they are written through this module. Nothing is recorded
+ * while flash operations are pending, or unless @c NRF_DFU_FLASH_ERASED_MAP_ENABLED is set.
+ *
+ * @param[in]  page_addr    The address of the first flash page to be checked.
+ * @param[in]  num_pages    The number of flash pages to be checked.
+ */
+void nrf_dfu_flash_erased_scan(uint32_t page_addr, uint32_t num_pages);
+
+
+/**@brief Function for checking if flash pages are known to be erased.
+ *
+ * A page is known to be erased if it was found blank by @ref nrf_dfu_flash_erased_scan, or
+ * erased by @ref nrf_dfu_flash_erase, and not written since.
+ *
+ * @param[in]  page_addr    The address of the first flash page.
+ * @param[in]  num_pages    The number of flash pages.
+ *
+ * @retval  true    If all pages are erased.
+ * @retval  false   If a page may be written, or @c NRF_DFU_FLASH_ERASED_MAP_ENABLED is not set.
+ */
+bool nrf_dfu_flash_erased(uint32_t page_addr, uint32_t num_pages);
+
+
+/**@brief Function for getting notified when all pending flash operations have completed.
+ *
+ * The buffer being combined is written first. The callback is called once, from the flash
+ * event handler of the last pending operation.
+ * It replaces a callback which has not been called yet.
+ *
+ * @param[in]  callback     Callback function.
+ * @param[in]  p_context    Parameter of the callback.
+ *
+ * @retval  NRF_SUCCESS                 If the callback will be called.
+ * @retval  NRF_ERROR_INVALID_STATE     If no flash operation is pending, the callback is not called.
+ */
+ret_code_t nrf_dfu_flash_idle_notify(nrf_dfu_flash_callback_t callback, void * p_context);
+
+
+/**@brief Function for checking whether a flash operation has failed.
+ *
+ * A write which failed after it was accepted, e.g. from the backlog or in nrf_fstorage, is only
+ * reported here. The failure is kept until @ref nrf_dfu_flash_failed_clear is called.
+ *
+ * @retval  true    If a flash operation has failed.
+ * @retval  false   If all flash operations have succeeded.
+ */
+bool nrf_dfu_flash_failed(void);
+
+
+/**@brief Function for clearing a failure reported by @ref nrf_dfu_flash_failed. */
+void nrf_dfu_flash_failed_clear(void);
+
+
+/**@brief Function for logging the queue depth and latency histograms of flash operations.
+ *
+ * The statistics are cleared. Nothing is logged unless @c NRF_DFU_FLASH_STATS_ENABLED is set.
+ */
+void nrf_dfu_flash_stats_log(void);
+
+
 #ifdef __cplusplus
 }
 #endif
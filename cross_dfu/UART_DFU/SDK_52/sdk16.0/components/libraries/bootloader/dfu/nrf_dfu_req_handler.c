@@ -60,6 +60,7 @@
 #include "nrf_crypto.h"
 #include "nrf_assert.h"
 #include "nrf_dfu_validation.h"
+#include "app_util_platform.h"
 
 #define NRF_LOG_MODULE_NAME nrf_dfu_req_handler
 #include "nrf_log.h"
@@ -71,6 +72,30 @@ NRF_LOG_MODULE_REGISTER();
 #define NRF_DFU_PROTOCOL_REDUCED 0
 #endif
 
+#ifndef NRF_DFU_CYCLE_TRACE_ENABLED
+#define NRF_DFU_CYCLE_TRACE_ENABLED 0
+#endif
+
+#ifndef NRF_DFU_STAGE_TIMING_ENABLED
+#define NRF_DFU_STAGE_TIMING_ENABLED 0
+#endif
+
+#ifndef NRF_DFU_STREAMING_HASH
+#define NRF_DFU_STREAMING_HASH 0
+#endif
+
+#ifndef NRF_DFU_PRE_ERASE_ENABLED
+#define NRF_DFU_PRE_ERASE_ENABLED 0
+#endif
+
+#if NRF_DFU_PRE_ERASE_ENABLED && !NRF_DFU_FLASH_ERASED_MAP_ENABLED
+#error "NRF_DFU_PRE_ERASE_ENABLED requires NRF_DFU_FLASH_ERASED_MAP_ENABLED."
+#endif
+
+#if NRF_DFU_CYCLE_TRACE_ENABLED && !defined(DWT_CTRL_CYCCNTENA_Msk)
+#error "NRF_DFU_CYCLE_TRACE_ENABLED requires the DWT cycle counter."
+#endif
+
 STATIC_ASSERT(DFU_SIGNED_COMMAND_SIZE <= INIT_COMMAND_MAX_SIZE);
 
 static uint32_t m_firmware_start_addr;          /**< Start address of the current firmware image. */
@@ -78,6 +103,183 @@ static uint32_t m_firmware_size_req;            /**< The size of the entire firm
 
 static nrf_dfu_observer_t m_observer;
 
+static nrf_dfu_request_t m_execute_req;         /**< Data execute request waiting for flash operations to complete. */
+
+static uint32_t m_erases_avoided;               /**< Pages found erased on data object create in this DFU. */
+
+#if NRF_DFU_PRE_ERASE_ENABLED
+static uint32_t m_pre_erase_addr;               /**< Next page to be erased in the background, 0 if none. */
+#endif
+
+#if NRF_DFU_CYCLE_TRACE_ENABLED
+/**@brief CPU cycles spent on handling requests since the last data object was executed. */
+typedef struct
+{
+    uint32_t count;     /**< Number of requests. */
+    uint32_t cycles;    /**< Sum of cycles. */
+    uint32_t max;       /**< Cycles of the slowest request. */
+} cycle_trace_t;
+
+static cycle_trace_t m_cycle_trace_write;
+static cycle_trace_t m_cycle_trace_other;
+
+
+static void cycle_trace_init(void)
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT       = 0;
+    DWT->CTRL        |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+
+static void cycle_trace_add(nrf_dfu_op_t request, uint32_t cycles)
+{
+    cycle_trace_t * p_trace = (request == NRF_DFU_OP_OBJECT_WRITE) ? &m_cycle_trace_write
+                                                                   : &m_cycle_trace_other;
+    p_trace->count++;
+    p_trace->cycles += cycles;
+    p_trace->max     = MAX(p_trace->max, cycles);
+}
+
+
+static void cycle_trace_log(char const * p_name, cycle_trace_t * p_trace)
+{
+    if (p_trace->count != 0)
+    {
+        NRF_LOG_INFO("%s: %d requests, %d cycles on average, %d max",
+                     p_name, p_trace->count, p_trace->cycles / p_trace->count, p_trace->max);
+    }
+
+    memset(p_trace, 0, sizeof(cycle_trace_t));
+}
+
+
+static void cycle_trace_report(void)
+{
+    cycle_trace_log("Write", &m_cycle_trace_write);
+    cycle_trace_log("Other", &m_cycle_trace_other);
+}
+#endif // NRF_DFU_CYCLE_TRACE_ENABLED
+
+
+#if NRF_DFU_STAGE_TIMING_ENABLED
+#include "nrf_bootloader_dfu_timers.h"
+
+/**@brief Time spent in each stage of a data object, in ticks of the DFU timer. */
+typedef struct
+{
+    uint32_t erase;     /**< Create request, including the erase with NVMC. */
+    uint32_t rx;        /**< Waiting for data between write requests: UART, SLIP decoding and responses. */
+    uint32_t crc;       /**< CRC of written data. */
+    uint32_t hash;      /**< Streaming hash of written data. */
+    uint32_t flash;     /**< Handing data to nrf_dfu_flash, and waiting for it to be written at execute. */
+    uint32_t verify;    /**< CRC of the object in flash at execute, with NRF_DFU_STREAMING_HASH. */
+    uint32_t execute;   /**< Execute request after the data is in flash, including saving the settings. */
+    uint32_t validate;  /**< Postvalidation, after the last object. */
+} stage_timing_t;
+
+static stage_timing_t m_stage_timing;           /**< Stages of the current object. */
+static stage_timing_t m_stage_timing_total;
+static uint32_t       m_stage_timing_objects;   /**< Number of executed objects. */
+static uint32_t       m_stage_timing_first;     /**< Start of the first create request. */
+static uint32_t       m_stage_timing_mark;      /**< End of the create request, or start of the execute request. */
+
+#define STAGE_TIMING_START()        uint32_t stage_start = nrf_bootloader_dfu_timer_counter_get()
+#define STAGE_TIMING_END(stage)     stage_start = stage_timing_add(&m_stage_timing.stage, stage_start)
+
+
+/**@brief Function for adding the time since @p start to a stage.
+ *
+ * @return The current time, start of the next stage.
+ */
+static uint32_t stage_timing_add(uint32_t * p_stage, uint32_t start)
+{
+    uint32_t now = nrf_bootloader_dfu_timer_counter_get();
+
+    *p_stage += now - start;
+
+    return now;
+}
+
+
+static void stage_timing_created(uint32_t start)
+{
+    if (m_stage_timing_objects == 0)
+    {
+        m_stage_timing_first = start;
+    }
+
+    memset(&m_stage_timing, 0, sizeof(m_stage_timing));
+    m_stage_timing_mark = stage_timing_add(&m_stage_timing.erase, start);
+}
+
+
+static void stage_timing_execute(void)
+{
+    uint32_t now = nrf_bootloader_dfu_timer_counter_get();
+
+    m_stage_timing.rx   = now - m_stage_timing_mark;
+    m_stage_timing.rx  -= MIN(m_stage_timing.rx, m_stage_timing.crc + m_stage_timing.hash + m_stage_timing.flash);
+    m_stage_timing_mark = now;
+}
+
+
+static void stage_timing_flash_idle(void)
+{
+    m_stage_timing_mark = stage_timing_add(&m_stage_timing.flash, m_stage_timing_mark);
+}
+
+
+static void stage_timing_executed(void)
+{
+    (void)stage_timing_add(&m_stage_timing.execute, m_stage_timing_mark);
+    m_stage_timing.execute -= MIN(m_stage_timing.execute, m_stage_timing.verify + m_stage_timing.validate);
+
+    m_stage_timing_total.erase    += m_stage_timing.erase;
+    m_stage_timing_total.rx       += m_stage_timing.rx;
+    m_stage_timing_total.crc      += m_stage_timing.crc;
+    m_stage_timing_total.hash     += m_stage_timing.hash;
+    m_stage_timing_total.flash    += m_stage_timing.flash;
+    m_stage_timing_total.verify   += m_stage_timing.verify;
+    m_stage_timing_total.execute  += m_stage_timing.execute;
+    m_stage_timing_total.validate += m_stage_timing.validate;
+    m_stage_timing_objects++;
+
+    NRF_LOG_INFO("timing 0x%08x erase=%d rx=%d crc=%d hash=%d",
+                 s_dfu_settings.progress.firmware_image_offset_last,
+                 m_stage_timing.erase, m_stage_timing.rx, m_stage_timing.crc, m_stage_timing.hash);
+    NRF_LOG_INFO("timing 0x%08x flash=%d verify=%d execute=%d validate=%d",
+                 s_dfu_settings.progress.firmware_image_offset_last,
+                 m_stage_timing.flash, m_stage_timing.verify, m_stage_timing.execute, m_stage_timing.validate);
+}
+#else
+#define STAGE_TIMING_START()
+#define STAGE_TIMING_END(stage)
+#define stage_timing_created(start)
+#define stage_timing_execute()
+#define stage_timing_flash_idle()
+#define stage_timing_executed()
+#endif // NRF_DFU_STAGE_TIMING_ENABLED
+
+
+void nrf_dfu_req_handler_timing_log(void)
+{
+#if NRF_DFU_STAGE_TIMING_ENABLED
+    NRF_LOG_INFO("timing total erase=%d rx=%d crc=%d hash=%d",
+                 m_stage_timing_total.erase, m_stage_timing_total.rx,
+                 m_stage_timing_total.crc, m_stage_timing_total.hash);
+    NRF_LOG_INFO("timing total flash=%d verify=%d execute=%d validate=%d",
+                 m_stage_timing_total.flash, m_stage_timing_total.verify,
+                 m_stage_timing_total.execute, m_stage_timing_total.validate);
+    NRF_LOG_INFO("timing total objects=%d elapsed=%d",
+                 m_stage_timing_objects,
+                 (m_stage_timing_objects != 0) ? nrf_bootloader_dfu_timer_counter_get() - m_stage_timing_first : 0);
+
+    memset(&m_stage_timing_total, 0, sizeof(m_stage_timing_total));
+    m_stage_timing_objects = 0;
+#endif
+}
+
 
 static void on_dfu_complete(nrf_fstorage_evt_t * p_evt)
 {
@@ -85,6 +287,13 @@ static void on_dfu_complete(nrf_fstorage_evt_t * p_evt)
 
     NRF_LOG_DEBUG("All flash operations have completed. DFU completed.");
 
+    NRF_LOG_INFO("%d page erases avoided.", m_erases_avoided);
+
+    // The bootloader resets on the event, before the observer of the user sees it.
+    nrf_dfu_req_handler_timing_log();
+
+    nrf_dfu_flash_stats_log();
+
     m_observer(NRF_DFU_EVT_DFU_COMPLETED);
 }
 
@@ -295,6 +504,97 @@ static void on_cmd_obj_write_request(nrf_dfu_request_t * p_req, nrf_dfu_response
 }
 
 
+#if NRF_DFU_PRE_ERASE_ENABLED
+static void pre_erase_sched(void * p_evt, uint16_t event_length);
+
+
+/**@brief Function called by nrf_dfu_flash when a page is erased, maybe from interrupt context. */
+static void pre_erase_on_erased(void * p_buf)
+{
+    UNUSED_PARAMETER(p_buf);
+
+    if (app_sched_event_put(NULL, 0, pre_erase_sched) != NRF_SUCCESS)
+    {
+        /* Pages left are erased when their objects are created. */
+        m_pre_erase_addr = 0;
+    }
+}
+
+
+/**@brief Function for erasing the next page of the firmware which is not erased yet.
+ *
+ * @details Called from the scheduler, so one page is erased between requests. Pages of the
+ *          data object being received, and the ones before it, are never erased.
+ */
+static void pre_erase_sched(void * p_evt, uint16_t event_length)
+{
+    UNUSED_PARAMETER(p_evt);
+    UNUSED_PARAMETER(event_length);
+
+    uint32_t const end   = m_firmware_start_addr + ALIGN_NUM(CODE_PAGE_SIZE, m_firmware_size_req);
+    uint32_t const floor = m_firmware_start_addr +
+                           ALIGN_NUM(CODE_PAGE_SIZE, s_dfu_settings.progress.firmware_image_offset_last +
+                                                     s_dfu_settings.progress.data_object_size);
+
+    if (m_pre_erase_addr == 0)
+    {
+        return;
+    }
+
+    m_pre_erase_addr = MAX(m_pre_erase_addr, floor);
+
+    while ((m_pre_erase_addr < end) && nrf_dfu_flash_erased(m_pre_erase_addr, 1))
+    {
+        m_pre_erase_addr += CODE_PAGE_SIZE;
+    }
+
+    if (m_pre_erase_addr >= end)
+    {
+        NRF_LOG_DEBUG("Firmware pages are erased.");
+        m_pre_erase_addr = 0;
+        return;
+    }
+
+    /* One page at a time, the next one is scheduled when it is erased. */
+    uint32_t const page_addr = m_pre_erase_addr;
+
+    m_pre_erase_addr += CODE_PAGE_SIZE;
+
+    if (nrf_dfu_flash_erase(page_addr, 1, pre_erase_on_erased) != NRF_SUCCESS)
+    {
+        m_pre_erase_addr = 0;
+    }
+}
+
+
+/**@brief Function for erasing the pages of the firmware in the background. */
+static void pre_erase_start(void)
+{
+    bool const running = (m_pre_erase_addr != 0);
+
+    m_pre_erase_addr = m_firmware_start_addr;
+
+    if (!running)
+    {
+        pre_erase_on_erased(NULL);
+    }
+}
+#endif // NRF_DFU_PRE_ERASE_ENABLED
+
+
+/**@brief Function for finding the blank pages of the firmware, they are not erased again. */
+static void firmware_erased_scan(void)
+{
+    m_erases_avoided = 0;
+
+    nrf_dfu_flash_erased_scan(m_firmware_start_addr, CEIL_DIV(m_firmware_size_req, CODE_PAGE_SIZE));
+
+#if NRF_DFU_PRE_ERASE_ENABLED
+    pre_erase_start();
+#endif
+}
+
+
 static void on_cmd_obj_execute_request(nrf_dfu_request_t const * p_req, nrf_dfu_response_t * p_res)
 {
     ASSERT(p_req);
@@ -308,6 +608,9 @@ static void on_cmd_obj_execute_request(nrf_dfu_request_t const * p_req, nrf_dfu_
 
     if (p_res->result == NRF_DFU_RES_CODE_SUCCESS)
     {
+        /* Before the settings are written, the scan is skipped while flash is busy. */
+        firmware_erased_scan();
+
         if (nrf_dfu_settings_write_and_backup(NULL) == NRF_SUCCESS)
         {
             /* Setting DFU to initialized */
@@ -397,6 +700,8 @@ static void on_data_obj_select_request(nrf_dfu_request_t * p_req, nrf_dfu_respon
 
 static void on_data_obj_create_request(nrf_dfu_request_t * p_req, nrf_dfu_response_t * p_res)
 {
+    STAGE_TIMING_START();
+
     NRF_LOG_DEBUG("Handle NRF_DFU_OP_OBJECT_CREATE (data)");
 
     if (!nrf_dfu_validation_init_cmd_present())
@@ -448,15 +753,29 @@ static void on_data_obj_create_request(nrf_dfu_request_t * p_req, nrf_dfu_respon
     s_dfu_settings.progress.firmware_image_offset = s_dfu_settings.progress.firmware_image_offset_last;
     s_dfu_settings.write_offset                   = s_dfu_settings.progress.firmware_image_offset_last;
 
-    /* Erase the page we're at. */
-    if (nrf_dfu_flash_erase((m_firmware_start_addr + s_dfu_settings.progress.firmware_image_offset),
-                            CEIL_DIV(p_req->create.object_size, CODE_PAGE_SIZE), NULL) != NRF_SUCCESS)
+    nrf_dfu_validation_fw_hash_restore(s_dfu_settings.progress.firmware_image_offset);
+
+    /* The object is written again, from its start. */
+    nrf_dfu_flash_failed_clear();
+
+    uint32_t const erase_addr  = m_firmware_start_addr + s_dfu_settings.progress.firmware_image_offset;
+    uint32_t const erase_pages = CEIL_DIV(p_req->create.object_size, CODE_PAGE_SIZE);
+
+    /* Erase the page we're at, unless nothing has been written since it was erased. */
+    if (nrf_dfu_flash_erased(erase_addr, erase_pages))
+    {
+        NRF_LOG_DEBUG("Page at 0x%08x is erased already.", erase_addr);
+        m_erases_avoided += erase_pages;
+    }
+    else if (nrf_dfu_flash_erase(erase_addr, erase_pages, NULL) != NRF_SUCCESS)
     {
         NRF_LOG_ERROR("Erase operation failed");
         p_res->result = NRF_DFU_RES_CODE_INVALID_OBJECT;
         return;
     }
 
+    stage_timing_created(stage_start);
+
     NRF_LOG_DEBUG("Creating object with size: %d. Offset: 0x%08x, CRC: 0x%08x",
                  s_dfu_settings.progress.data_object_size,
                  s_dfu_settings.progress.firmware_image_offset,
@@ -466,7 +785,7 @@ static void on_data_obj_create_request(nrf_dfu_request_t * p_req, nrf_dfu_respon
 
 static void on_data_obj_write_request(nrf_dfu_request_t * p_req, nrf_dfu_response_t * p_res)
 {
-    NRF_LOG_DEBUG("Handle NRF_DFU_OP_OBJECT_WRITE (data)");
+    NRF_DFU_HOT_PATH_LOG("Handle NRF_DFU_OP_OBJECT_WRITE (data)");
 
     if (!nrf_dfu_validation_init_cmd_present())
     {
@@ -475,6 +794,15 @@ static void on_data_obj_write_request(nrf_dfu_request_t * p_req, nrf_dfu_respons
         return;
     }
 
+    if (nrf_dfu_flash_failed())
+    {
+        /* Data of this object is missing in flash, the object must be created again. */
+        NRF_LOG_ERROR("Flash write failed, the object is invalid");
+        p_res->result = NRF_DFU_RES_CODE_OPERATION_FAILED;
+        p_req->callback.write((void*)p_req->write.p_data);
+        return;
+    }
+
     uint32_t const data_object_offset = s_dfu_settings.progress.firmware_image_offset -
                                         s_dfu_settings.progress.firmware_image_offset_last;
 
@@ -486,6 +814,8 @@ static void on_data_obj_write_request(nrf_dfu_request_t * p_req, nrf_dfu_respons
         return;
     }
 
+    STAGE_TIMING_START();
+
     uint32_t const write_addr = m_firmware_start_addr + s_dfu_settings.write_offset;
     /* CRC must be calculated before handing off the data to fstorage because the data is
      * freed on write completion.
@@ -493,14 +823,25 @@ static void on_data_obj_write_request(nrf_dfu_request_t * p_req, nrf_dfu_respons
     uint32_t const next_crc =
         crc32_compute(p_req->write.p_data, p_req->write.len, &s_dfu_settings.progress.firmware_image_crc);
 
+    STAGE_TIMING_END(crc);
+
+    /* The hash is invalidated by the next write if this one is not stored. */
+    nrf_dfu_validation_fw_hash_update(s_dfu_settings.progress.firmware_image_offset,
+                                      p_req->write.p_data,
+                                      p_req->write.len);
+
+    STAGE_TIMING_END(hash);
+
     ASSERT(p_req->callback.write);
 
     ret_code_t ret =
-        nrf_dfu_flash_store(write_addr, p_req->write.p_data, p_req->write.len, p_req->callback.write);
+        nrf_dfu_flash_store_combined(write_addr, p_req->write.p_data, p_req->write.len, p_req->callback.write);
+
+    STAGE_TIMING_END(flash);
 
     if (ret != NRF_SUCCESS)
     {
-        /* When nrf_dfu_flash_store() fails because there is no space in the queue,
+        /* When nrf_dfu_flash_store_combined() fails because no combine buffer is free,
          * stop processing the request so that the peer can detect a CRC error
          * and retransmit this object. Remember to manually free the buffer !
          */
@@ -533,44 +874,112 @@ static void on_data_obj_crc_request(nrf_dfu_request_t * p_req, nrf_dfu_response_
 }
 
 
+static void on_data_obj_execute_request_sched(void * p_evt, uint16_t event_length);
+
+
+/**@brief Function for checking the written data object in flash against the CRC of the received data.
+ *
+ * @details With NRF_DFU_STREAMING_HASH the firmware is not read from flash in postvalidation,
+ *          so a lost or short flash write is found here, one object at a time.
+ */
+static bool data_obj_flash_crc_ok(void)
+{
+    STAGE_TIMING_START();
+
+    uint32_t const offset = s_dfu_settings.progress.firmware_image_offset_last;
+    uint32_t const crc    = crc32_compute((uint8_t *)(m_firmware_start_addr + offset),
+                                          s_dfu_settings.progress.firmware_image_offset - offset,
+                                          &s_dfu_settings.progress.firmware_image_crc_last);
+
+    STAGE_TIMING_END(verify);
+
+    if (crc != s_dfu_settings.progress.firmware_image_crc)
+    {
+        NRF_LOG_ERROR("CRC of the object in flash is 0x%08x, received 0x%08x.",
+                      crc, s_dfu_settings.progress.firmware_image_crc);
+        return false;
+    }
+
+    return true;
+}
+
+
+/**@brief Function called by nrf_dfu_flash when all buffers are written, maybe from interrupt context. */
+static void on_flash_idle(void * p_context)
+{
+    UNUSED_PARAMETER(p_context);
+
+    ret_code_t ret = app_sched_event_put(NULL, 0, on_data_obj_execute_request_sched);
+    if (ret != NRF_SUCCESS)
+    {
+        NRF_LOG_ERROR("Failed to schedule object execute: 0x%x.", ret);
+    }
+}
+
+
 static void on_data_obj_execute_request_sched(void * p_evt, uint16_t event_length)
 {
+    UNUSED_PARAMETER(p_evt);
     UNUSED_PARAMETER(event_length);
 
     ret_code_t          ret;
-    nrf_dfu_request_t * p_req = (nrf_dfu_request_t *)(p_evt);
+    nrf_dfu_request_t * p_req = &m_execute_req;
 
     /* Wait for all buffers to be written in flash. */
-    if (nrf_fstorage_is_busy(NULL))
+    if (nrf_dfu_flash_idle_notify(on_flash_idle, NULL) == NRF_SUCCESS)
     {
-        ret = app_sched_event_put(p_req, sizeof(nrf_dfu_request_t), on_data_obj_execute_request_sched);
-        if (ret != NRF_SUCCESS)
-        {
-            NRF_LOG_ERROR("Failed to schedule object execute: 0x%x.", ret);
-        }
         return;
     }
 
+    stage_timing_flash_idle();
+
     nrf_dfu_response_t res =
     {
         .request = NRF_DFU_OP_OBJECT_EXECUTE,
     };
 
+    if (nrf_dfu_flash_failed() || (NRF_DFU_STREAMING_HASH && !data_obj_flash_crc_ok()))
+    {
+        /* The object is received again from its start. */
+        NRF_LOG_ERROR("Flash write failed, the object is invalid");
+
+        s_dfu_settings.progress.firmware_image_crc    = s_dfu_settings.progress.firmware_image_crc_last;
+        s_dfu_settings.progress.firmware_image_offset = s_dfu_settings.progress.firmware_image_offset_last;
+
+        res.result = NRF_DFU_RES_CODE_OPERATION_FAILED;
+        p_req->callback.response(&res, p_req->p_context);
+        return;
+    }
+
+    /* Update the offset and crc values for the last object written. */
+    s_dfu_settings.progress.data_object_size           = 0;
+    s_dfu_settings.progress.firmware_image_crc_last    = s_dfu_settings.progress.firmware_image_crc;
+    s_dfu_settings.progress.firmware_image_offset_last = s_dfu_settings.progress.firmware_image_offset;
+
+    nrf_dfu_validation_fw_hash_save(s_dfu_settings.progress.firmware_image_offset_last);
+
     if (s_dfu_settings.progress.firmware_image_offset == m_firmware_size_req)
     {
         NRF_LOG_DEBUG("Whole firmware image received. Postvalidating.");
 
+        STAGE_TIMING_START();
+
         #if NRF_DFU_IN_APP
         res.result = nrf_dfu_validation_post_data_execute(m_firmware_start_addr, m_firmware_size_req);
         #else
         res.result = nrf_dfu_validation_activation_prepare(m_firmware_start_addr, m_firmware_size_req);
         #endif
 
+        STAGE_TIMING_END(validate);
+
         res.result = ext_err_code_handle(res.result);
 
         /* Provide response to transport */
         p_req->callback.response(&res, p_req->p_context);
 
+        /* Logged before the settings are written, with NVMC the DFU is completed on return. */
+        stage_timing_executed();
+
         ret = nrf_dfu_settings_write_and_backup((nrf_dfu_flash_callback_t)on_dfu_complete);
         UNUSED_RETURN_VALUE(ret);
     }
@@ -587,6 +996,8 @@ static void on_data_obj_execute_request_sched(void * p_evt, uint16_t event_lengt
             ret = nrf_dfu_settings_write_and_backup(NULL);
             UNUSED_RETURN_VALUE(ret);
         }
+
+        stage_timing_executed();
     }
 
     NRF_LOG_DEBUG("Request handling complete. Result: 0x%x", res.result);
@@ -611,12 +1022,17 @@ static bool on_data_obj_execute_request(nrf_dfu_request_t * p_req, nrf_dfu_respo
         return true;
     }
 
-    /* Update the offset and crc values for the last object written. */
-    s_dfu_settings.progress.data_object_size           = 0;
-    s_dfu_settings.progress.firmware_image_crc_last    = s_dfu_settings.progress.firmware_image_crc;
-    s_dfu_settings.progress.firmware_image_offset_last = s_dfu_settings.progress.firmware_image_offset;
+    stage_timing_execute();
 
-    on_data_obj_execute_request_sched(p_req, 0);
+#if NRF_DFU_CYCLE_TRACE_ENABLED
+    cycle_trace_report();
+#endif
+
+    /* The request may be on the stack of the transport, keep it until the response is sent.
+     * The object is taken as written when all its data is in flash.
+     */
+    m_execute_req = *p_req;
+    on_data_obj_execute_request_sched(NULL, 0);
 
     m_observer(NRF_DFU_EVT_OBJECT_RECEIVED);
 
@@ -720,6 +1136,11 @@ static void nrf_dfu_req_handler_req_process(nrf_dfu_request_t * p_req)
 
     bool response_ready = true;
 
+#if NRF_DFU_CYCLE_TRACE_ENABLED
+    uint32_t const cycles_start = DWT->CYCCNT;
+    nrf_dfu_op_t const request  = p_req->request;
+#endif
+
     /* The request handlers assume these values to be set. */
     nrf_dfu_response_t response =
     {
@@ -785,7 +1206,7 @@ static void nrf_dfu_req_handler_req_process(nrf_dfu_request_t * p_req)
 
     if (response_ready)
     {
-        NRF_LOG_DEBUG("Request handling complete. Result: 0x%x", response.result);
+        NRF_DFU_HOT_PATH_LOG("Request handling complete. Result: 0x%x", response.result);
 
         p_req->callback.response(&response, p_req->p_context);
 
@@ -794,6 +1215,10 @@ static void nrf_dfu_req_handler_req_process(nrf_dfu_request_t * p_req)
             m_observer(NRF_DFU_EVT_DFU_FAILED);
         }
     }
+
+#if NRF_DFU_CYCLE_TRACE_ENABLED
+    cycle_trace_add(request, DWT->CYCCNT - cycles_start);
+#endif
 }
 
 
@@ -813,6 +1238,13 @@ ret_code_t nrf_dfu_req_handler_on_req(nrf_dfu_request_t * p_req)
         return NRF_ERROR_INVALID_PARAM;
     }
 
+    if (current_int_priority_get() == APP_IRQ_PRIORITY_THREAD)
+    {
+        /* Already in the main loop, no need to copy the request through the scheduler. */
+        nrf_dfu_req_handler_req_process(p_req);
+        return NRF_SUCCESS;
+    }
+
     ret = app_sched_event_put(p_req, sizeof(nrf_dfu_request_t), nrf_dfu_req_handler_req);
     if (ret != NRF_SUCCESS)
     {
@@ -853,10 +1285,16 @@ ret_code_t nrf_dfu_req_handler_init(nrf_dfu_observer_t observer)
             /* Init packet in flash is not valid! */
             return NRF_ERROR_INTERNAL;
         }
+
+        firmware_erased_scan();
     }
 
     m_observer = observer;
 
+#if NRF_DFU_CYCLE_TRACE_ENABLED
+    cycle_trace_init();
+#endif
+
     /* Initialize extended error handling with "No error" as the most recent error. */
     result = ext_error_set(NRF_DFU_EXT_ERROR_NO_ERROR);
     UNUSED_RETURN_VALUE(result);
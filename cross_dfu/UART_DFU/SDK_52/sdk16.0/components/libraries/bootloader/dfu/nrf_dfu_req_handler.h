@@ -334,6 +334,15 @@ ret_code_t nrf_dfu_req_handler_init(nrf_dfu_observer_t observer);
 ret_code_t nrf_dfu_req_handler_on_req(nrf_dfu_request_t * p_req);
 
 
+/**@brief  Function for logging the time spent in each stage of the data objects.
+ *
+ * The totals since the last call are logged and cleared, they are logged when the DFU is
+ * completed too. Each data object is logged when it is executed. Nothing is logged unless
+ * @c NRF_DFU_STAGE_TIMING_ENABLED is set. Times are in ticks of the DFU timer, 32768 Hz.
+ */
+void nrf_dfu_req_handler_timing_log(void);
+
+
 ANON_UNIONS_DISABLE;
 
 #ifdef __cplusplus
@@ -66,6 +66,21 @@ extern "C" {
 #endif
 
 
+#ifndef NRF_DFU_HOT_PATH_LOG_ENABLED
+#define NRF_DFU_HOT_PATH_LOG_ENABLED 0
+#endif
+
+/**@brief Macro for logging in the path of every packet, e.g. write requests.
+ *
+ * It is compiled out unless NRF_DFU_HOT_PATH_LOG_ENABLED is set, a log message costs
+ * more than the handling of a write request itself.
+ */
+#if NRF_DFU_HOT_PATH_LOG_ENABLED
+#define NRF_DFU_HOT_PATH_LOG(...)   NRF_LOG_DEBUG(__VA_ARGS__)
+#else
+#define NRF_DFU_HOT_PATH_LOG(...)
+#endif
+
 #define INIT_COMMAND_MAX_SIZE      512 /**< Maximum size of the init command stored in dfu_settings. */
 #define INIT_COMMAND_MAX_SIZE_v1   256 /**< Maximum size of the init command in settings version 1. */
 
@@ -279,6 +294,7 @@ STATIC_ASSERT(sizeof(nrf_dfu_adv_name_t)  == NRF_DFU_ADV_NAME_LEN,  "nrf_dfu_adv
 
 #define SETTINGS_RESERVED_AREA_SIZE    16 /**< The number of words in the reserved area of the DFU settings. */
 #define SETTINGS_BOOT_VALIDATION_SIZE  64 /**< The number of bytes reserved for boot_validation value. */
+#define SETTINGS_HASH_CONTEXT_SIZE    128 /**< The number of bytes reserved for the hash context of the firmware image in progress. */
 
 
 typedef enum
@@ -295,6 +311,20 @@ typedef struct
     uint8_t                bytes[SETTINGS_BOOT_VALIDATION_SIZE];
 } boot_validation_t;
 
+/**@brief Hash of the firmware image received so far, saved at the end of each executed data object.
+ *
+ * @details This is placed after the parts of the settings known by tools, so a settings page
+ *          generated by a tool leaves it erased. An erased or stale value is ignored, and the
+ *          whole image is hashed in postvalidation instead.
+ */
+typedef struct
+{
+    uint32_t crc;                                   /**< CRC of the rest of the parameters in this struct. */
+    uint32_t command_crc;                           /**< CRC of the init command the hash belongs to. */
+    uint32_t offset;                                /**< Number of firmware bytes in the hash. */
+    uint8_t  context[SETTINGS_HASH_CONTEXT_SIZE];   /**< nrf_crypto hash context. */
+} dfu_hash_progress_t;
+
 /**@brief DFU settings for application and bank data.
  */
 typedef struct
@@ -325,6 +355,8 @@ typedef struct
 
     nrf_dfu_peer_data_t peer_data;          /**< Not included in calculated CRC. */
     nrf_dfu_adv_name_t  adv_name;           /**< Not included in calculated CRC. */
+
+    dfu_hash_progress_t fw_hash_progress;   /**< Not included in calculated CRC. */
 } nrf_dfu_settings_t;
 
 #pragma pack() // revert pack settings
@@ -68,8 +68,25 @@ NRF_LOG_MODULE_REGISTER();
 #endif
 #endif
 
+#ifndef NRF_DFU_STREAMING_HASH
+#define NRF_DFU_STREAMING_HASH 0
+#endif
+
+#ifndef NRF_DFU_SIGNATURE_BENCHMARK_ENABLED
+#define NRF_DFU_SIGNATURE_BENCHMARK_ENABLED 0
+#endif
+
+#if NRF_DFU_SIGNATURE_BENCHMARK_ENABLED && !defined(DWT_CTRL_CYCCNTENA_Msk)
+#error "NRF_DFU_SIGNATURE_BENCHMARK_ENABLED requires the DWT cycle counter."
+#endif
+
 #define EXT_ERR(err) (nrf_dfu_result_t)((uint32_t)NRF_DFU_RES_CODE_EXT_ERROR + (uint32_t)err)
 
+#define FW_HASH_OFFSET_INVALID  0xFFFFFFFF
+
+STATIC_ASSERT(sizeof(nrf_crypto_hash_context_t) <= SETTINGS_HASH_CONTEXT_SIZE,
+              "SETTINGS_HASH_CONTEXT_SIZE is too small for the enabled hash backend.");
+
 /* Whether a complete init command has been received and prevalidated, but the firmware
  * is not yet fully transferred. This value will also be correct after reset.
  */
@@ -101,6 +118,14 @@ static nrf_crypto_hash_sha256_digest_t              m_sig_hash;
  */
 static nrf_crypto_hash_sha256_digest_t              m_fw_hash;
 
+/** @brief Hash of the firmware image received so far, see @ref nrf_dfu_validation_fw_hash_update.
+ */
+static nrf_crypto_hash_context_t                    m_fw_hash_context;
+
+/** @brief Number of firmware bytes in m_fw_hash_context, FW_HASH_OFFSET_INVALID if it is not usable.
+ */
+static uint32_t                                     m_fw_hash_offset = FW_HASH_OFFSET_INVALID;
+
 /** @brief Whether nrf_crypto and local keys have been initialized.
  */
 static bool                                         m_crypto_initialized = false;
@@ -205,6 +230,44 @@ static bool stored_init_cmd_decode(void)
 }
 
 
+#if NRF_DFU_SIGNATURE_BENCHMARK_ENABLED
+#if NRF_MODULE_ENABLED(NRF_CRYPTO_BACKEND_CC310_BL)
+#define SIGNATURE_BACKEND_NAME "CC310_BL"
+#elif NRF_MODULE_ENABLED(NRF_CRYPTO_BACKEND_OBERON)
+#define SIGNATURE_BACKEND_NAME "Oberon"
+#elif NRF_MODULE_ENABLED(NRF_CRYPTO_BACKEND_MICRO_ECC)
+#define SIGNATURE_BACKEND_NAME "micro-ecc"
+#else
+#define SIGNATURE_BACKEND_NAME "other"
+#endif
+
+/**@brief Function for reading the DWT cycle counter, it is started on the first call. */
+static uint32_t signature_benchmark_cycles(void)
+{
+    if ((DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk) == 0)
+    {
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT->CTRL        |= DWT_CTRL_CYCCNTENA_Msk;
+    }
+
+    return DWT->CYCCNT;
+}
+
+
+/**@brief Function for logging the cycles of the hash and the verify of a signature check. */
+static void signature_benchmark_log(uint32_t data_len, uint32_t hash_cycles, uint32_t verify_cycles)
+{
+    uint32_t cycles_per_us = SystemCoreClock / 1000000;
+
+    NRF_LOG_INFO("Signature benchmark: " SIGNATURE_BACKEND_NAME);
+    NRF_LOG_INFO("SHA-256 of %d bytes: %d cycles, %d us",
+                 data_len, hash_cycles, hash_cycles / cycles_per_us);
+    NRF_LOG_INFO("ECDSA verify: %d cycles, %d us",
+                 verify_cycles, verify_cycles / cycles_per_us);
+}
+#endif // NRF_DFU_SIGNATURE_BENCHMARK_ENABLED
+
+
 static void crypto_init(void)
 {
     ret_code_t err_code;
@@ -252,6 +315,7 @@ static void dfu_progress_reset(void)
 {
     memset(s_dfu_settings.init_command, 0xFF, INIT_COMMAND_MAX_SIZE); // Remove the last init command
     memset(&s_dfu_settings.progress, 0, sizeof(dfu_progress_t));
+    memset(&s_dfu_settings.fw_hash_progress, 0xFF, sizeof(dfu_hash_progress_t));
     s_dfu_settings.write_offset = 0;
 }
 
@@ -351,6 +415,11 @@ static nrf_dfu_result_t nrf_dfu_validation_signature_check(dfu_signature_type_t
     nrf_crypto_hash_context_t         hash_context   = {0};
     nrf_crypto_ecdsa_verify_context_t verify_context = {0};
 
+#if NRF_DFU_SIGNATURE_BENCHMARK_ENABLED
+    uint32_t hash_cycles;
+    uint32_t verify_cycles;
+#endif
+
     crypto_init();
 
     NRF_LOG_INFO("Signature required. Checking signature.")
@@ -367,12 +436,18 @@ static nrf_dfu_result_t nrf_dfu_validation_signature_check(dfu_signature_type_t
     }
 
     NRF_LOG_INFO("Calculating hash (len: %d)", data_len);
+#if NRF_DFU_SIGNATURE_BENCHMARK_ENABLED
+    hash_cycles = signature_benchmark_cycles();
+#endif
     err_code = nrf_crypto_hash_calculate(&hash_context,
                                          &g_nrf_crypto_hash_sha256_info,
                                          p_data,
                                          data_len,
                                          m_sig_hash,
                                          &hash_len);
+#if NRF_DFU_SIGNATURE_BENCHMARK_ENABLED
+    hash_cycles = signature_benchmark_cycles() - hash_cycles;
+#endif
     if (err_code != NRF_SUCCESS)
     {
         return NRF_DFU_RES_CODE_OPERATION_FAILED;
@@ -392,12 +467,19 @@ static nrf_dfu_result_t nrf_dfu_validation_signature_check(dfu_signature_type_t
     // The signature is in little-endian format. Change it to big-endian format for nrf_crypto use.
     nrf_crypto_internal_double_swap_endian_in_place(m_signature, sizeof(m_signature) / 2);
 
+#if NRF_DFU_SIGNATURE_BENCHMARK_ENABLED
+    verify_cycles = signature_benchmark_cycles();
+#endif
     err_code = nrf_crypto_ecdsa_verify(&verify_context,
                                        &m_public_key,
                                        m_sig_hash,
                                        hash_len,
                                        m_signature,
                                        sizeof(m_signature));
+#if NRF_DFU_SIGNATURE_BENCHMARK_ENABLED
+    verify_cycles = signature_benchmark_cycles() - verify_cycles;
+    signature_benchmark_log(data_len, hash_cycles, verify_cycles);
+#endif
     if (err_code != NRF_SUCCESS)
     {
         NRF_LOG_ERROR("Signature failed (err_code: 0x%x)", err_code);
@@ -636,6 +718,130 @@ nrf_dfu_result_t nrf_dfu_validation_init_cmd_execute(uint32_t * p_dst_data_addr,
 }
 
 
+static uint32_t fw_hash_progress_crc_get(dfu_hash_progress_t const * p_progress)
+{
+    return crc32_compute((uint8_t *)p_progress + sizeof(p_progress->crc),
+                         sizeof(dfu_hash_progress_t) - sizeof(p_progress->crc),
+                         NULL);
+}
+
+
+// Whether the hash saved in the settings belongs to the current init command and covers
+// the first fw_offset bytes of the firmware.
+static bool fw_hash_progress_valid(uint32_t fw_offset)
+{
+    dfu_hash_progress_t                const * p_progress    = &s_dfu_settings.fw_hash_progress;
+    nrf_crypto_hash_internal_context_t const * p_int_context =
+        (nrf_crypto_hash_internal_context_t const *)p_progress->context;
+
+    // The context holds a pointer into the image which saved it, e.g. the app with NRF_DFU_IN_APP.
+    return NRF_DFU_STREAMING_HASH
+           && (p_progress->offset      == fw_offset)
+           && (p_progress->command_crc == s_dfu_settings.progress.command_crc)
+           && (p_progress->crc         == fw_hash_progress_crc_get(p_progress))
+           && (p_int_context->p_info   == &g_nrf_crypto_hash_sha256_info);
+}
+
+
+void nrf_dfu_validation_fw_hash_restore(uint32_t offset)
+{
+    ret_code_t err_code = NRF_SUCCESS;
+
+    m_fw_hash_offset = FW_HASH_OFFSET_INVALID;
+
+    if (!NRF_DFU_STREAMING_HASH)
+    {
+        return;
+    }
+
+    if (offset == 0)
+    {
+        crypto_init();
+        err_code = nrf_crypto_hash_init(&m_fw_hash_context, &g_nrf_crypto_hash_sha256_info);
+    }
+    else if (fw_hash_progress_valid(offset))
+    {
+        memcpy(&m_fw_hash_context, s_dfu_settings.fw_hash_progress.context, sizeof(m_fw_hash_context));
+    }
+    else
+    {
+        NRF_LOG_DEBUG("No hash saved at offset 0x%x, the image is hashed in postvalidation.", offset);
+        return;
+    }
+
+    if (err_code != NRF_SUCCESS)
+    {
+        NRF_LOG_ERROR("Could not start hash of the image (err_code 0x%x).", err_code);
+        return;
+    }
+
+    m_fw_hash_offset = offset;
+}
+
+
+void nrf_dfu_validation_fw_hash_update(uint32_t offset, uint8_t const * p_data, uint32_t length)
+{
+    if (m_fw_hash_offset != offset)
+    {
+        // Data was skipped or written again without restarting the object.
+        m_fw_hash_offset = FW_HASH_OFFSET_INVALID;
+        return;
+    }
+
+    if (nrf_crypto_hash_update(&m_fw_hash_context, p_data, length) != NRF_SUCCESS)
+    {
+        m_fw_hash_offset = FW_HASH_OFFSET_INVALID;
+        return;
+    }
+
+    m_fw_hash_offset += length;
+}
+
+
+void nrf_dfu_validation_fw_hash_save(uint32_t offset)
+{
+    dfu_hash_progress_t * p_progress = &s_dfu_settings.fw_hash_progress;
+
+    // An object executed again after a reset has no new data, the saved hash still matches.
+    if (!NRF_DFU_STREAMING_HASH || fw_hash_progress_valid(offset))
+    {
+        return;
+    }
+
+    // Make sure a hash which does not match the progress is never used.
+    memset(p_progress, 0xFF, sizeof(dfu_hash_progress_t));
+
+    if (m_fw_hash_offset != offset)
+    {
+        return;
+    }
+
+    memcpy(p_progress->context, &m_fw_hash_context, sizeof(m_fw_hash_context));
+    p_progress->command_crc = s_dfu_settings.progress.command_crc;
+    p_progress->offset      = offset;
+    p_progress->crc         = fw_hash_progress_crc_get(p_progress);
+}
+
+
+// Function to compare m_fw_hash with the big-endian hash @p p_hash.
+static bool fw_hash_digest_ok(uint8_t const * p_hash)
+{
+    if (memcmp(m_fw_hash, p_hash, NRF_CRYPTO_HASH_SIZE_SHA256) != 0)
+    {
+        NRF_LOG_WARNING("Hash verification failed.");
+        NRF_LOG_DEBUG("Expected FW hash:")
+        NRF_LOG_HEXDUMP_DEBUG(p_hash, NRF_CRYPTO_HASH_SIZE_SHA256);
+        NRF_LOG_DEBUG("Actual FW hash:")
+        NRF_LOG_HEXDUMP_DEBUG(m_fw_hash, NRF_CRYPTO_HASH_SIZE_SHA256);
+        NRF_LOG_FLUSH();
+
+        return false;
+    }
+
+    return true;
+}
+
+
 // Function to check the hash received in the init command against the received firmware.
 // little_endian specifies the endianness of @p p_hash.
 static bool nrf_dfu_validation_hash_ok(uint8_t const * p_hash, uint32_t src_addr, uint32_t data_len, bool little_endian)
@@ -674,26 +880,54 @@ static bool nrf_dfu_validation_hash_ok(uint8_t const * p_hash, uint32_t src_addr
         NRF_LOG_ERROR("Could not run hash verification (err_code 0x%x).", err_code);
         result = false;
     }
-    else if (memcmp(m_fw_hash, p_hash, NRF_CRYPTO_HASH_SIZE_SHA256) != 0)
+    else
     {
-        NRF_LOG_WARNING("Hash verification failed.");
-        NRF_LOG_DEBUG("Expected FW hash:")
-        NRF_LOG_HEXDUMP_DEBUG(p_hash, NRF_CRYPTO_HASH_SIZE_SHA256);
-        NRF_LOG_DEBUG("Actual FW hash:")
-        NRF_LOG_HEXDUMP_DEBUG(m_fw_hash, NRF_CRYPTO_HASH_SIZE_SHA256);
-        NRF_LOG_FLUSH();
-
-        result = false;
+        result = fw_hash_digest_ok(p_hash);
     }
 
     return result;
 }
 
 
+// Function to check the hash received in the init command against the hash saved while
+// the firmware was received, so the firmware in flash is not read again.
+static bool fw_hash_progress_ok(uint8_t const * p_hash)
+{
+    ret_code_t                err_code;
+    uint8_t                   hash_be[NRF_CRYPTO_HASH_SIZE_SHA256];
+    size_t                    hash_len = NRF_CRYPTO_HASH_SIZE_SHA256;
+    nrf_crypto_hash_context_t hash_context;
+
+    // Finalize a copy, the saved hash is kept until the update is activated.
+    memcpy(&hash_context, s_dfu_settings.fw_hash_progress.context, sizeof(hash_context));
+
+    nrf_crypto_internal_swap_endian(hash_be, p_hash, NRF_CRYPTO_HASH_SIZE_SHA256);
+
+    NRF_LOG_DEBUG("Hash verification of the hash saved while receiving.");
+
+    err_code = nrf_crypto_hash_finalize(&hash_context, m_fw_hash, &hash_len);
+    if (err_code != NRF_SUCCESS)
+    {
+        NRF_LOG_ERROR("Could not run hash verification (err_code 0x%x).", err_code);
+        return false;
+    }
+
+    return fw_hash_digest_ok(hash_be);
+}
+
+
 // Function to check the hash received in the init command against the received firmware.
 bool fw_hash_ok(dfu_init_command_t const * p_init, uint32_t fw_start_addr, uint32_t fw_size)
 {
     ASSERT(p_init != NULL);
+
+    if (fw_hash_progress_valid(fw_size))
+    {
+        crypto_init();
+        // Each object was checked in flash when it was executed, see nrf_dfu_req_handler.c.
+        return fw_hash_progress_ok((uint8_t *)p_init->hash.hash.bytes);
+    }
+
     return nrf_dfu_validation_hash_ok((uint8_t *)p_init->hash.hash.bytes, fw_start_addr, fw_size, true);
 }
 
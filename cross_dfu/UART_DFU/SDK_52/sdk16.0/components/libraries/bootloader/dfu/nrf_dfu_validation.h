@@ -120,6 +120,35 @@ nrf_dfu_result_t nrf_dfu_validation_init_cmd_execute(uint32_t * p_dst_data_addr,
  */
 nrf_dfu_result_t nrf_dfu_validation_prevalidate(void);
 
+/**
+ * @brief Function for restarting the hash of the firmware image at the start of a data object.
+ *
+ * The hash saved at the end of the last executed data object is restored, so the hash
+ * is kept over a resumed transfer when NRF_DFU_SAVE_PROGRESS_IN_FLASH is enabled.
+ *
+ * @param[in] offset  Offset of the data object in the firmware image.
+ */
+void nrf_dfu_validation_fw_hash_restore(uint32_t offset);
+
+/**
+ * @brief Function for adding received firmware data to the hash of the firmware image.
+ *
+ * Data which does not follow the hashed data invalidates the hash until the next
+ * data object is created, the whole image is then hashed in postvalidation.
+ *
+ * @param[in] offset  Offset of the data in the firmware image.
+ * @param[in] p_data  Received data.
+ * @param[in] length  Length of the data.
+ */
+void nrf_dfu_validation_fw_hash_update(uint32_t offset, uint8_t const * p_data, uint32_t length);
+
+/**
+ * @brief Function for saving the hash of the firmware image to the settings at the end of a data object.
+ *
+ * @param[in] offset  Offset of the end of the data object in the firmware image.
+ */
+void nrf_dfu_validation_fw_hash_save(uint32_t offset);
+
 /**
  * @brief Function for validating the firmware for booting.
  *
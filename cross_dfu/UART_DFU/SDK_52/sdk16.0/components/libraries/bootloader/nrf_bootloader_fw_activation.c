@@ -49,9 +49,114 @@
 #include "nrf_bootloader_wdt.h"
 
 
+#ifndef NRF_BL_FW_COPY_JOURNAL_ENABLED
+#define NRF_BL_FW_COPY_JOURNAL_ENABLED 0
+#endif
+
+#if NRF_BL_FW_COPY_JOURNAL_ENABLED
+/* The journal takes the rest of the settings page after the settings. It is erased with the
+ * settings, and each copied page appends the write offset after it in the next word. Words
+ * are written once between erases, a word can only be written twice on nRF52.
+ */
+#define JOURNAL_START       (BOOTLOADER_SETTINGS_ADDRESS + ALIGN_NUM(sizeof(uint32_t), sizeof(nrf_dfu_settings_t)))
+#define JOURNAL_ENTRIES     ((BOOTLOADER_SETTINGS_ADDRESS + BOOTLOADER_SETTINGS_PAGE_SIZE - JOURNAL_START) / sizeof(uint32_t))
+#define JOURNAL_ENTRY_EMPTY 0xFFFFFFFF
+
+STATIC_ASSERT(JOURNAL_ENTRIES > 0, "No space for the copy journal in the settings page.");
+
+static uint32_t m_journal_count;        /**< Number of entries in the journal. */
+#endif
+
+static uint32_t m_settings_writes;      /**< Number of settings writes while copying, for the log. */
+static uint32_t m_journal_writes;       /**< Number of journal entries written while copying, for the log. */
+
 static volatile bool m_flash_write_done;
 
 
+#if NRF_BL_FW_COPY_JOURNAL_ENABLED
+/**@brief Function for taking the progress of an interrupted copy from the journal.
+ *
+ * @details Each entry must be one page, or the end of the image, after the previous one, starting
+ *          from the write offset in the settings. The journal is not appended after an entry which
+ *          is not, it is erased by the next settings write instead.
+ */
+static void journal_restore(void)
+{
+    uint32_t const * p_entry = (uint32_t const *)JOURNAL_START;
+    uint32_t         offset  = s_dfu_settings.write_offset;
+
+    for (m_journal_count = 0; m_journal_count < JOURNAL_ENTRIES; m_journal_count++)
+    {
+        uint32_t entry = p_entry[m_journal_count];
+
+        if (entry == JOURNAL_ENTRY_EMPTY)
+        {
+            break;
+        }
+
+        if ((entry <= offset) || (entry > offset + CODE_PAGE_SIZE))
+        {
+            NRF_LOG_WARNING("Copy journal is invalid at entry %d.", m_journal_count);
+            m_journal_count = JOURNAL_ENTRIES;
+            break;
+        }
+
+        offset = entry;
+    }
+
+    if (offset != s_dfu_settings.write_offset)
+    {
+        NRF_LOG_INFO("Copy resumed from the journal at 0x%x.", offset);
+        s_dfu_settings.write_offset = offset;
+    }
+}
+#endif
+
+
+/**@brief Function for storing the progress of the copy, in s_dfu_settings.write_offset.
+ *
+ * @details With NRF_BL_FW_COPY_JOURNAL_ENABLED, the offset is appended to the journal, and the
+ *          settings are only written when the journal is full, or when it has @p max_pages
+ *          entries so the source of the pages after the write offset in the settings is intact.
+ *
+ * @param[in] max_pages Pages which may be copied since the last settings write.
+ *
+ * @return NRF_SUCCESS or error code in case of failure.
+ */
+static uint32_t copy_progress_store(uint32_t max_pages)
+{
+#if NRF_BL_FW_COPY_JOURNAL_ENABLED
+    static uint32_t entry;
+
+    if (m_journal_count < MIN(JOURNAL_ENTRIES, max_pages))
+    {
+        entry = s_dfu_settings.write_offset;
+        m_journal_writes++;
+
+        uint32_t ret_val = nrf_dfu_flash_store(JOURNAL_START + m_journal_count * sizeof(uint32_t),
+                                               &entry,
+                                               sizeof(entry),
+                                               NULL);
+        if (ret_val == NRF_SUCCESS)
+        {
+            m_journal_count++;
+        }
+
+        return ret_val;
+    }
+
+    // The write offset differs from the settings in flash, so the page is erased
+    m_journal_count = 0;
+#else
+    UNUSED_PARAMETER(max_pages);
+#endif
+
+    m_settings_writes++;
+
+    return nrf_dfu_settings_write_and_backup(NULL);
+}
+
+
 /**
  * @brief Function for copying image. Image is copied in chunks. Frequency of storing progress
  *        in flash is configured by input parameter.
@@ -89,7 +194,23 @@ static uint32_t image_copy(uint32_t dst_addr,
     //Firmware copying is time consuming operation thus watchdog handling is started
     nrf_bootloader_wdt_init();
 
+#if NRF_BL_FW_COPY_JOURNAL_ENABLED
+    // Progress of each page goes to the journal
+    progress_update_step = 1;
+#else
     progress_update_step = MIN(progress_update_step, max_safe_progress_upd_step);
+#endif
+
+#if NRF_LOG_ENABLED && defined(DWT_CTRL_CYCCNTENA_Msk)
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL        |= DWT_CTRL_CYCCNTENA_Msk;
+
+    uint32_t cycles = DWT->CYCCNT;
+#endif
+    uint32_t copied = size;
+
+    m_settings_writes = 0;
+    m_journal_writes  = 0;
 
     while (size > 0)
     {
@@ -130,7 +251,7 @@ static uint32_t image_copy(uint32_t dst_addr,
         s_dfu_settings.write_offset += bytes;
 
         //store progress in flash on every successful chunk write
-        ret_val = nrf_dfu_settings_write_and_backup(NULL);
+        ret_val = copy_progress_store(max_safe_progress_upd_step);
         if (ret_val != NRF_SUCCESS)
         {
             NRF_LOG_ERROR("Failed to write image copying progress to settings page.");
@@ -138,6 +259,14 @@ static uint32_t image_copy(uint32_t dst_addr,
         }
     }
 
+#if NRF_LOG_ENABLED && defined(DWT_CTRL_CYCCNTENA_Msk)
+    cycles = DWT->CYCCNT - cycles;
+    NRF_LOG_INFO("Copied %d bytes in %d ms, %d settings writes, %d journal entries.",
+                 copied, cycles / (SystemCoreClock / 1000), m_settings_writes, m_journal_writes);
+#else
+    UNUSED_VARIABLE(copied);
+#endif
+
     return ret_val;
 }
 
@@ -378,6 +507,13 @@ nrf_bootloader_fw_activation_result_t nrf_bootloader_fw_activate(void)
 
     NRF_LOG_DEBUG("Enter nrf_bootloader_fw_activate");
 
+#if NRF_BL_FW_COPY_JOURNAL_ENABLED
+    if (p_bank->bank_code != NRF_DFU_BANK_INVALID)
+    {
+        journal_restore();
+    }
+#endif
+
     switch (p_bank->bank_code)
     {
        case NRF_DFU_BANK_VALID_APP:
@@ -67,7 +67,7 @@ static void response_send(nrf_dfu_serial_t         * p_transport,
     uint8_t   index            = 0;
     uint8_t * p_serialized_rsp = p_transport->p_rsp_buf;
 
-    NRF_LOG_DEBUG("Sending Response: [0x%01x, 0x%01x]", p_response->request, p_response->result);
+    NRF_DFU_HOT_PATH_LOG("Sending Response: [0x%01x, 0x%01x]", p_response->request, p_response->result);
 
     p_serialized_rsp[index++] = NRF_DFU_OP_RESPONSE;
     p_serialized_rsp[index++] = p_response->request;
@@ -43,11 +43,17 @@
 #include <string.h>
 #include "boards.h"
 #include "app_util_platform.h"
+#include "nrf_dfu.h"
 #include "nrf_dfu_transport.h"
 #include "nrf_dfu_req_handler.h"
 #include "slip.h"
 #include "nrf_balloc.h"
+#include "app_scheduler.h"
+#if NRF_DFU_SERIAL_UART_USES_LIBUARTE
+#include "nrf_libuarte_async.h"
+#else
 #include "nrf_drv_uart.h"
+#endif
 
 #define NRF_LOG_MODULE_NAME nrf_dfu_serial_uart
 #include "nrf_log.h"
@@ -62,16 +68,74 @@ NRF_LOG_MODULE_REGISTER();
 
 #define NRF_SERIAL_OPCODE_SIZE          (sizeof(uint8_t))
 #define NRF_UART_MAX_RESPONSE_SIZE_SLIP (2 * NRF_SERIAL_MAX_RESPONSE_SIZE + 1)
-#define RX_BUF_SIZE                     (64) //to get 64bytes payload
+#define RX_BUF_SIZE                     (NRF_DFU_SERIAL_UART_PAYLOAD_SIZE)
 #define OPCODE_OFFSET                   (sizeof(uint32_t) - NRF_SERIAL_OPCODE_SIZE)
 #define DATA_OFFSET                     (OPCODE_OFFSET + NRF_SERIAL_OPCODE_SIZE)
 #define UART_SLIP_MTU                   (2 * (RX_BUF_SIZE + 1) + 1)
-#define BALLOC_BUF_SIZE                 ((CEIL_DIV((RX_BUF_SIZE+OPCODE_SIZE),sizeof(uint32_t))*sizeof(uint32_t)))
+#define UART_PACKET_SIZE_MAX            (UART_SLIP_MTU - 1) //decoded packet of MTU bytes without escapes
+#define SLIP_BUF_LEN                    (UART_PACKET_SIZE_MAX + 1) //slip decoder needs a free byte to take END
+#define BALLOC_BUF_SIZE                 (CEIL_DIV((OPCODE_OFFSET + SLIP_BUF_LEN), sizeof(uint32_t)) * sizeof(uint32_t))
+
+#if NRF_DFU_SERIAL_UART_USES_LIBUARTE
+#define LIBUARTE_RAM_SIZE               (NRF_DFU_SERIAL_UART_LIBUARTE_RX_BUF_SIZE * NRF_DFU_SERIAL_UART_LIBUARTE_RX_BUF_CNT)
+#else
+#define LIBUARTE_RAM_SIZE               0
+#endif
+
+#define UART_TRANSPORT_RAM_SIZE         (BALLOC_BUF_SIZE * NRF_DFU_SERIAL_UART_RX_BUFFERS + \
+                                         NRF_UART_MAX_RESPONSE_SIZE_SLIP + LIBUARTE_RAM_SIZE)
+
+STATIC_ASSERT(UART_SLIP_MTU <= UINT16_MAX, "MTU is reported in 16 bits.");
+STATIC_ASSERT(UART_TRANSPORT_RAM_SIZE <= NRF_DFU_SERIAL_UART_RAM_BUDGET,
+              "UART transport buffers exceed NRF_DFU_SERIAL_UART_RAM_BUDGET.");
+
+#if defined(BLE_STACK_SUPPORT_REQD) || defined(ANT_STACK_SUPPORT_REQD)
+// A write holds its RX buffer until fstorage reports it, every buffer may be queued.
+STATIC_ASSERT(NRF_FSTORAGE_SD_QUEUE_SIZE >= NRF_DFU_SERIAL_UART_RX_BUFFERS,
+              "NRF_FSTORAGE_SD_QUEUE_SIZE is less than NRF_DFU_SERIAL_UART_RX_BUFFERS.");
+#endif
+
+/**@brief Decoded packet, handed from the UART interrupt to the main loop. */
+typedef struct
+{
+    nrf_dfu_serial_t * p_transport;
+    uint8_t          * p_data;
+    uint32_t           length;
+} rx_packet_t;
+
+STATIC_ASSERT(sizeof(rx_packet_t) <= NRF_DFU_SCHED_EVENT_DATA_SIZE);
+
+NRF_BALLOC_DEF(m_payload_pool, BALLOC_BUF_SIZE, NRF_DFU_SERIAL_UART_RX_BUFFERS);
+
+#if NRF_DFU_SERIAL_UART_USES_LIBUARTE
+
+#if UART0_ENABLED
+#error "UART0_ENABLED must be 0, UARTE0 is used by libUARTE."
+#endif
 
-NRF_BALLOC_DEF(m_payload_pool, (UART_SLIP_MTU + 1), NRF_DFU_SERIAL_UART_RX_BUFFERS);
+#if !NRF_QUEUE_ENABLED || !NRFX_PPI_ENABLED
+#error "libUARTE requires NRF_QUEUE_ENABLED and NRFX_PPI_ENABLED."
+#endif
 
+#if NRF_DFU_SERIAL_UART_USES_HWFC && !NRF_LIBUARTE_DRV_HWFC_ENABLED
+#error "HWFC with libUARTE requires NRF_LIBUARTE_DRV_HWFC_ENABLED and nrfx_gpiote."
+#endif
+
+#define LIBUARTE_UARTE_INSTANCE         0
+#define LIBUARTE_TIMER_INSTANCE         1   //!< Counts received bytes.
+#define LIBUARTE_TIMEOUT_TIMER_INSTANCE 2   //!< RX timeout, RTC2 is used by the DFU timers.
+
+NRF_LIBUARTE_ASYNC_DEFINE(m_libuarte,
+                          LIBUARTE_UARTE_INSTANCE,
+                          LIBUARTE_TIMER_INSTANCE,
+                          NRF_LIBUARTE_PERIPHERAL_NOT_USED,
+                          LIBUARTE_TIMEOUT_TIMER_INSTANCE,
+                          NRF_DFU_SERIAL_UART_LIBUARTE_RX_BUF_SIZE,
+                          NRF_DFU_SERIAL_UART_LIBUARTE_RX_BUF_CNT);
+#else
 static nrf_drv_uart_t m_uart =  NRF_DRV_UART_INSTANCE(0);
 static uint8_t m_rx_byte;
+#endif
 
 static nrf_dfu_serial_t m_serial;
 static slip_t m_slip;
@@ -100,40 +164,126 @@ static ret_code_t rsp_send(uint8_t const * p_data, uint32_t length)
     uint32_t slip_len;
     (void) slip_encode(m_rsp_buf, (uint8_t *)p_data, length, &slip_len);
 
+#if NRF_DFU_SERIAL_UART_USES_LIBUARTE
+    return nrf_libuarte_async_tx(&m_libuarte, m_rsp_buf, slip_len);
+#else
     return nrf_drv_uart_tx(&m_uart, m_rsp_buf, slip_len);
+#endif
 }
 
-static __INLINE void on_rx_complete(nrf_dfu_serial_t * p_transport, uint8_t * p_data, uint8_t len)
+/**@brief Handle a packet in the main loop, the request is then handled at once without
+ *        being copied through the scheduler again. */
+static void on_packet_sched(void * p_evt, uint16_t event_length)
 {
-    ret_code_t ret_code = NRF_ERROR_TIMEOUT;
+    rx_packet_t const * p_packet = (rx_packet_t const *)p_evt;
 
-    // Check if there is byte to process. Zero length transfer means that RXTO occured.
-    if (len)
+    UNUSED_PARAMETER(event_length);
+
+    nrf_dfu_serial_on_packet_received(p_packet->p_transport,
+                                      (uint8_t const *)p_packet->p_data,
+                                      p_packet->length);
+}
+
+static void on_packet_decoded(nrf_dfu_serial_t * p_transport)
+{
+    rx_packet_t packet =
+    {
+        .p_transport = p_transport,
+        .p_data      = m_slip.p_buffer,
+        .length      = m_slip.current_index,
+    };
+
+    if (app_sched_event_put(&packet, sizeof(packet), on_packet_sched) != NRF_SUCCESS)
     {
-        ret_code = slip_decode_add_byte(&m_slip, p_data[0]);
+        // Lost like a corrupted packet, the host retries after the CRC check.
+        NRF_LOG_WARNING("Scheduler ran out of space!");
+        payload_free(&packet.p_data[NRF_SERIAL_OPCODE_SIZE]);
     }
 
-    (void) nrf_drv_uart_rx(&m_uart, &m_rx_byte, 1);
+    uint8_t * p_rx_buf = nrf_balloc_alloc(&m_payload_pool);
+    if (p_rx_buf == NULL)
+    {
+        NRF_LOG_ERROR("Failed to allocate buffer");
+        return;
+    }
+    NRF_DFU_HOT_PATH_LOG("Allocated buffer %x", p_rx_buf);
+    // reset the slip decoding
+    m_slip.p_buffer      = &p_rx_buf[OPCODE_OFFSET];
+    m_slip.current_index = 0;
+    m_slip.state         = SLIP_STATE_DECODING;
+}
+
+static void on_rx_byte(nrf_dfu_serial_t * p_transport, uint8_t byte)
+{
+    ret_code_t ret_code = slip_decode_add_byte(&m_slip, byte);
 
     if (ret_code == NRF_SUCCESS)
     {
-        nrf_dfu_serial_on_packet_received(p_transport,
-                                         (uint8_t const *)m_slip.p_buffer,
-                                         m_slip.current_index);
-
-        uint8_t * p_rx_buf = nrf_balloc_alloc(&m_payload_pool);
-        if (p_rx_buf == NULL)
-        {
-            NRF_LOG_ERROR("Failed to allocate buffer");
-            return;
-        }
-        NRF_LOG_INFO("Allocated buffer %x", p_rx_buf);
-        // reset the slip decoding
-        m_slip.p_buffer      = &p_rx_buf[OPCODE_OFFSET];
+        on_packet_decoded(p_transport);
+    }
+    else if (ret_code == NRF_ERROR_NO_MEM)
+    {
+        // Longer than MTU, e.g. END of the previous packet is lost. Drop it up to the next END,
+        // which may be this byte.
         m_slip.current_index = 0;
-        m_slip.state         = SLIP_STATE_DECODING;
+        m_slip.state         = SLIP_STATE_CLEARING_INVALID_PACKET;
+        (void) slip_decode_add_byte(&m_slip, byte);
+    }
+}
+
+#if NRF_DFU_SERIAL_UART_USES_LIBUARTE
+
+/**@brief Decode a chunk received by DMA, it may hold several packets or a part of one. */
+static void on_rx_data(nrf_dfu_serial_t * p_transport, uint8_t const * p_data, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        on_rx_byte(p_transport, p_data[i]);
     }
+}
+
+static void libuarte_event_handler(void * p_context, nrf_libuarte_async_evt_t * p_evt)
+{
+    switch (p_evt->type)
+    {
+        case NRF_LIBUARTE_ASYNC_EVT_RX_DATA:
+            on_rx_data((nrf_dfu_serial_t *)p_context,
+                       p_evt->data.rxtx.p_data,
+                       p_evt->data.rxtx.length);
+            // Decoded data is copied to the payload buffer, DMA buffer can be reused at once.
+            nrf_libuarte_async_rx_free(&m_libuarte,
+                                       p_evt->data.rxtx.p_data,
+                                       p_evt->data.rxtx.length);
+            break;
+
+        case NRF_LIBUARTE_ASYNC_EVT_ERROR:
+            APP_ERROR_HANDLER(p_evt->data.errorsrc);
+            break;
+
+        case NRF_LIBUARTE_ASYNC_EVT_OVERRUN_ERROR:
+            // Lost bytes corrupt the current packet, the host retries after the CRC check.
+            NRF_LOG_WARNING("RX overrun: %d bytes", p_evt->data.overrun_err.overrun_length);
+            break;
 
+        default:
+            // No action.
+            break;
+    }
+}
+
+#else
+
+static __INLINE void on_rx_complete(nrf_dfu_serial_t * p_transport, uint8_t * p_data, uint8_t len)
+{
+    uint8_t byte = p_data[0];
+
+    (void) nrf_drv_uart_rx(&m_uart, &m_rx_byte, 1);
+
+    // Check if there is byte to process. Zero length transfer means that RXTO occured.
+    if (len)
+    {
+        on_rx_byte(p_transport, byte);
+    }
 }
 
 static void uart_event_handler(nrf_drv_uart_event_t * p_event, void * p_context)
@@ -156,6 +306,8 @@ static void uart_event_handler(nrf_drv_uart_event_t * p_event, void * p_context)
     }
 }
 
+#endif // NRF_DFU_SERIAL_UART_USES_LIBUARTE
+
 static uint32_t uart_dfu_transport_init(nrf_dfu_observer_t observer)
 {
     uint32_t err_code = NRF_SUCCESS;
@@ -179,7 +331,7 @@ static uint32_t uart_dfu_transport_init(nrf_dfu_observer_t observer)
 
     m_slip.p_buffer      =  &p_rx_buf[OPCODE_OFFSET];
     m_slip.current_index = 0;
-    m_slip.buffer_len    = UART_SLIP_MTU;
+    m_slip.buffer_len    = SLIP_BUF_LEN;
     m_slip.state         = SLIP_STATE_DECODING;
 
     m_serial.rsp_func           = rsp_send;
@@ -189,6 +341,31 @@ static uint32_t uart_dfu_transport_init(nrf_dfu_observer_t observer)
                                             NRF_SERIAL_MAX_RESPONSE_SIZE];
     m_serial.p_low_level_transport = &uart_dfu_transport;
 
+#if NRF_DFU_SERIAL_UART_USES_LIBUARTE
+    nrf_libuarte_async_config_t uart_config =
+    {
+        .rx_pin     = RX_PIN_NUMBER,
+        .tx_pin     = TX_PIN_NUMBER,
+        .cts_pin    = NRF_DFU_SERIAL_UART_USES_HWFC ? CTS_PIN_NUMBER : NRF_UARTE_PSEL_DISCONNECTED,
+        .rts_pin    = NRF_DFU_SERIAL_UART_USES_HWFC ? RTS_PIN_NUMBER : NRF_UARTE_PSEL_DISCONNECTED,
+        .timeout_us = NRF_DFU_SERIAL_UART_LIBUARTE_TIMEOUT_US,
+        .hwfc       = NRF_DFU_SERIAL_UART_USES_HWFC ?
+                          NRF_UARTE_HWFC_ENABLED : NRF_UARTE_HWFC_DISABLED,
+        .parity     = (nrf_uarte_parity_t)UART_DEFAULT_CONFIG_PARITY,
+        .baudrate   = (nrf_uarte_baudrate_t)UART_DEFAULT_CONFIG_BAUDRATE,
+        .pullup_rx  = false,
+        .int_prio   = UART_DEFAULT_CONFIG_IRQ_PRIORITY,
+    };
+
+    err_code = nrf_libuarte_async_init(&m_libuarte, &uart_config, libuarte_event_handler, &m_serial);
+    if (err_code != NRF_SUCCESS)
+    {
+        NRF_LOG_ERROR("Failed initializing uart");
+        return err_code;
+    }
+
+    nrf_libuarte_async_enable(&m_libuarte);
+#else
     nrf_drv_uart_config_t uart_config = NRF_DRV_UART_DEFAULT_CONFIG;
 
     uart_config.pseltxd   = TX_PIN_NUMBER;
@@ -211,8 +388,10 @@ static uint32_t uart_dfu_transport_init(nrf_dfu_observer_t observer)
     {
         NRF_LOG_ERROR("Failed initializing rx");
     }
+#endif
 
-    NRF_LOG_DEBUG("serial_dfu_transport_init() completed");
+    NRF_LOG_DEBUG("serial_dfu_transport_init() completed, MTU: %d, RX buffers: %d",
+                  UART_SLIP_MTU, NRF_DFU_SERIAL_UART_RX_BUFFERS);
 
     m_active = true;
 
@@ -229,7 +408,11 @@ static uint32_t uart_dfu_transport_close(nrf_dfu_transport_t const * p_exception
 {
     if ((m_active == true) && (p_exception != &uart_dfu_transport))
     {
+#if NRF_DFU_SERIAL_UART_USES_LIBUARTE
+        nrf_libuarte_async_uninit(&m_libuarte);
+#else
         nrf_drv_uart_uninit(&m_uart);
+#endif
         m_active = false;
     }
 
@@ -68,6 +68,31 @@ struct uart_data_t {
 	uint16_t len;
 };
 
+/* Fixed-size pool of UART buffers, with counters to size it. */
+struct uart_buf_pool {
+	struct k_mem_slab *slab;
+	const char *name;
+	atomic_t max_used;
+	atomic_t alloc_failures;
+	uint32_t reported_max_used;
+	uint32_t reported_failures;
+};
+
+K_MEM_SLAB_DEFINE_STATIC(uart_rx_slab, sizeof(struct uart_data_t),
+			 CONFIG_BT_NUS_UART_RX_BUF_COUNT, 4);
+K_MEM_SLAB_DEFINE_STATIC(uart_tx_slab, sizeof(struct uart_data_t),
+			 CONFIG_BT_NUS_UART_TX_BUF_COUNT, 4);
+
+static struct uart_buf_pool uart_rx_pool = {
+	.slab = &uart_rx_slab,
+	.name = "RX",
+};
+
+static struct uart_buf_pool uart_tx_pool = {
+	.slab = &uart_tx_slab,
+	.name = "TX",
+};
+
 static K_FIFO_DEFINE(fifo_uart_tx_data);
 static K_FIFO_DEFINE(fifo_uart_rx_data);
 
@@ -453,6 +478,85 @@ void Master_start_DFU(void)
 /*************************************END DFUMaster***************************************/
 
 
+static struct uart_data_t *uart_buf_alloc(struct uart_buf_pool *pool)
+{
+	struct uart_data_t *buf;
+	uint32_t used;
+
+	if (k_mem_slab_alloc(pool->slab, (void **)&buf, K_NO_WAIT)) {
+		atomic_inc(&pool->alloc_failures);
+		return NULL;
+	}
+
+	used = k_mem_slab_num_used_get(pool->slab);
+	if (used > atomic_get(&pool->max_used)) {
+		atomic_set(&pool->max_used, used);
+	}
+
+	buf->len = 0;
+
+	return buf;
+}
+
+static void uart_buf_free(struct uart_buf_pool *pool, struct uart_data_t *buf)
+{
+	k_mem_slab_free(pool->slab, (void **)&buf);
+}
+
+/* The DFU code also sends from flash, only slab buffers are freed. */
+static bool uart_buf_in_pool(struct uart_buf_pool *pool, const uint8_t *data)
+{
+	const char *start = pool->slab->buffer;
+	const char *end = start + pool->slab->num_blocks * pool->slab->block_size;
+
+	return ((const char *)data >= start) && ((const char *)data < end);
+}
+
+static void uart_buf_pool_report(struct uart_buf_pool *pool)
+{
+	uint32_t max_used = atomic_get(&pool->max_used);
+	uint32_t failures = atomic_get(&pool->alloc_failures);
+
+	if ((max_used == pool->reported_max_used) &&
+	    (failures == pool->reported_failures)) {
+		return;
+	}
+
+	pool->reported_max_used = max_used;
+	pool->reported_failures = failures;
+
+	LOG_INF("UART %s buffers: %u of %u used at most, %u allocation failures",
+		pool->name, max_used, pool->slab->num_blocks, failures);
+}
+
+/* Log the CPU cycles per byte of the UART async adapter interrupts since
+ * the last report.
+ */
+static void uart_adapter_stats_report(void)
+{
+	struct uart_async_adapter_stats stats;
+
+	uart_async_adapter_stats_get(async_adapter, &stats);
+	if (!stats.rx_bytes && !stats.tx_bytes) {
+		return;
+	}
+
+	LOG_INF("UART adapter: RX %u bytes, %u cycles/byte, TX %u bytes, %u cycles/byte",
+		stats.rx_bytes, stats.rx_cycles / MAX(stats.rx_bytes, 1),
+		stats.tx_bytes, stats.tx_cycles / MAX(stats.tx_bytes, 1));
+}
+
+/* Log the counters of the buffer pools when they change. */
+static void uart_buf_stats_report(void)
+{
+	uart_buf_pool_report(&uart_rx_pool);
+	uart_buf_pool_report(&uart_tx_pool);
+
+	if (IS_ENABLED(CONFIG_BT_NUS_UART_ASYNC_ADAPTER_STATS)) {
+		uart_adapter_stats_report();
+	}
+}
+
 static void uart_cb(const struct device *dev, struct uart_event *evt, void *user_data)
 {
 	ARG_UNUSED(dev);
@@ -466,6 +570,13 @@ static void uart_cb(const struct device *dev, struct uart_event *evt, void *user
 	case UART_TX_DONE:
 		LOG_DBG("UART_TX_DONE");
 		uart_tx_done = true;
+
+		if (evt->data.tx.buf &&
+		    uart_buf_in_pool(&uart_tx_pool, evt->data.tx.buf)) {
+			buf = CONTAINER_OF(evt->data.tx.buf, struct uart_data_t,
+					   data);
+			uart_buf_free(&uart_tx_pool, buf);
+		}
 		// if ((evt->data.tx.len == 0) ||
 		//     (!evt->data.tx.buf)) {
 		// 	return;
@@ -516,10 +627,8 @@ static void uart_cb(const struct device *dev, struct uart_event *evt, void *user
 		LOG_DBG("UART_RX_DISABLED");
 		disable_req = false;
 
-		buf = k_malloc(sizeof(*buf));
-		if (buf) {
-			buf->len = 0;
-		} else {
+		buf = uart_buf_alloc(&uart_rx_pool);
+		if (!buf) {
 			LOG_WRN("Not able to allocate UART receive buffer");
 			k_work_reschedule(&uart_work, UART_WAIT_FOR_BUF_DELAY);
 			return;
@@ -532,9 +641,8 @@ static void uart_cb(const struct device *dev, struct uart_event *evt, void *user
 
 	case UART_RX_BUF_REQUEST:
 		LOG_DBG("UART_RX_BUF_REQUEST");
-		buf = k_malloc(sizeof(*buf));
+		buf = uart_buf_alloc(&uart_rx_pool);
 		if (buf) {
-			buf->len = 0;
 			uart_rx_buf_rsp(uart, buf->data, sizeof(buf->data));
 		} else {
 			LOG_WRN("Not able to allocate UART receive buffer");
@@ -550,7 +658,7 @@ static void uart_cb(const struct device *dev, struct uart_event *evt, void *user
 		if (buf->len > 0) {
 			k_fifo_put(&fifo_uart_rx_data, buf);
 		} else {
-			k_free(buf);
+			uart_buf_free(&uart_rx_pool, buf);
 		}
 
 		break;
@@ -579,10 +687,8 @@ static void uart_work_handler(struct k_work *item)
 {
 	struct uart_data_t *buf;
 
-	buf = k_malloc(sizeof(*buf));
-	if (buf) {
-		buf->len = 0;
-	} else {
+	buf = uart_buf_alloc(&uart_rx_pool);
+	if (!buf) {
 		LOG_WRN("Not able to allocate UART receive buffer");
 		k_work_reschedule(&uart_work, UART_WAIT_FOR_BUF_DELAY);
 		return;
@@ -618,10 +724,8 @@ static int uart_init(void)
 		}
 	}
 
-	rx = k_malloc(sizeof(*rx));
-	if (rx) {
-		rx->len = 0;
-	} else {
+	rx = uart_buf_alloc(&uart_rx_pool);
+	if (!rx) {
 		return -ENOMEM;
 	}
 
@@ -663,14 +767,14 @@ static int uart_init(void)
 		}
 	}
 
-	tx = k_malloc(sizeof(*tx));
+	tx = uart_buf_alloc(&uart_tx_pool);
 
 	if (tx) {
 		pos = snprintf(tx->data, sizeof(tx->data),
 			       "Starting Nordic UART service example\r\n");
 
 		if ((pos < 0) || (pos >= sizeof(tx->data))) {
-			k_free(tx);
+			uart_buf_free(&uart_tx_pool, tx);
 			LOG_ERR("snprintf returned %d", pos);
 			return -ENOMEM;
 		}
@@ -829,7 +933,7 @@ static void bt_receive_cb(struct bt_conn *conn, const uint8_t *const data,
 	LOG_INF("Received data from: %s", addr);
 
 	for (uint16_t pos = 0; pos != len;) {
-		struct uart_data_t *tx = k_malloc(sizeof(*tx));
+		struct uart_data_t *tx = uart_buf_alloc(&uart_tx_pool);
 
 		if (!tx) {
 			LOG_WRN("Not able to allocate UART send data buffer");
@@ -985,6 +1089,7 @@ void main(void)
 
 	for (;;) {
 		dk_set_led(RUN_STATUS_LED, (++blink_status) % 2);
+		uart_buf_stats_report();
 		k_sleep(K_MSEC(RUN_LED_BLINK_INTERVAL));
 	}
 }
@@ -1003,7 +1108,7 @@ void ble_write_thread(void)
 			LOG_WRN("Failed to send data over BLE connection");
 		}
 
-		k_free(buf);
+		uart_buf_free(&uart_rx_pool, buf);
 	}
 }
 
@@ -24,6 +24,23 @@
 #include <zephyr/kernel.h>
 
 
+/**
+ * @brief UART async adapter statistics
+ *
+ * Bytes moved through the FIFOs of the target UART and the cycles spent in
+ * its interrupts doing so, collected with CONFIG_BT_NUS_UART_ASYNC_ADAPTER_STATS.
+ */
+struct uart_async_adapter_stats {
+	/** Bytes read from the RX FIFO */
+	uint32_t rx_bytes;
+	/** Cycles spent reading the RX FIFO */
+	uint32_t rx_cycles;
+	/** Bytes written to the TX FIFO */
+	uint32_t tx_bytes;
+	/** Cycles spent writing the TX FIFO */
+	uint32_t tx_cycles;
+};
+
 /**
  * @brief UART asynch adapter data structure
  *
@@ -71,11 +88,18 @@ struct uart_async_adapter_data {
 		size_t next_buf_len;
 		/** Timeout set by the user */
 		int32_t timeout;
+		/** Uptime in ticks of the last received data */
+		k_ticks_t last_rx;
 		/** Timer used for timeout */
 		struct k_timer timeout_timer;
+		/** Timeout timer is started */
+		bool timer_running;
 		/** RX state */
 		bool enabled;
 	} rx;
+
+	/** Statistics since they were last read */
+	struct uart_async_adapter_stats stats;
 };
 
 /**
@@ -123,4 +147,14 @@ extern const struct uart_driver_api uart_async_adapter_driver_api;
  */
 void uart_async_adapter_init(const struct device *dev, const struct device *target);
 
+/**
+ * @brief Get and clear the statistics of the adapter
+ *
+ * The statistics are only collected with CONFIG_BT_NUS_UART_ASYNC_ADAPTER_STATS.
+ *
+ * @param dev   The adapter interface
+ * @param stats Statistics since the last call
+ */
+void uart_async_adapter_stats_get(const struct device *dev, struct uart_async_adapter_stats *stats);
+
 /** @} */
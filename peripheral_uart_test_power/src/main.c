@@ -12,6 +12,7 @@
 #include <zephyr/types.h>
 #include <zephyr/kernel.h>
 #include <zephyr/drivers/uart.h>
+#include <zephyr/drivers/gpio.h>
 #include <zephyr/usb/usb_device.h>
 
 #include <zephyr/device.h>
@@ -55,6 +56,19 @@ LOG_MODULE_REGISTER(LOG_MODULE_NAME);
 #define UART_WAIT_FOR_BUF_DELAY K_MSEC(50)
 #define UART_WAIT_FOR_RX CONFIG_BT_NUS_UART_RX_WAIT_TIME
 
+/* While connected, the UART is suspended after CONFIG_BT_NUS_UART_IDLE_TIMEOUT
+ * without data, and woken by the nus-wake-gpios pin of the zephyr,user node:
+ * the RX pin or DTR.
+ */
+#define UART_WAKE_NODE DT_PATH(zephyr_user)
+#define UART_IDLE_SUSPEND (IS_ENABLED(CONFIG_BT_NUS_UART_IDLE_SUSPEND) && \
+			   DT_NODE_HAS_PROP(UART_WAKE_NODE, nus_wake_gpios))
+#if defined(CONFIG_BT_NUS_UART_IDLE_TIMEOUT)
+#define UART_IDLE_TIMEOUT CONFIG_BT_NUS_UART_IDLE_TIMEOUT
+#else
+#define UART_IDLE_TIMEOUT 0
+#endif
+
 static K_SEM_DEFINE(ble_init_ok, 0, 1);
 
 static struct bt_conn *current_conn;
@@ -70,9 +84,60 @@ struct uart_data_t {
 	uint16_t len;
 };
 
+/* Fixed-size pool of UART buffers, with counters to size it. */
+struct uart_buf_pool {
+	struct k_mem_slab *slab;
+	const char *name;
+	atomic_t max_used;
+	atomic_t alloc_failures;
+	uint32_t reported_max_used;
+	uint32_t reported_failures;
+};
+
+K_MEM_SLAB_DEFINE_STATIC(uart_rx_slab, sizeof(struct uart_data_t),
+			 CONFIG_BT_NUS_UART_RX_BUF_COUNT, 4);
+K_MEM_SLAB_DEFINE_STATIC(uart_tx_slab, sizeof(struct uart_data_t),
+			 CONFIG_BT_NUS_UART_TX_BUF_COUNT, 4);
+
+static struct uart_buf_pool uart_rx_pool = {
+	.slab = &uart_rx_slab,
+	.name = "RX",
+};
+
+static struct uart_buf_pool uart_tx_pool = {
+	.slab = &uart_tx_slab,
+	.name = "TX",
+};
+
 static K_FIFO_DEFINE(fifo_uart_tx_data);
 static K_FIFO_DEFINE(fifo_uart_rx_data);
 
+static const struct gpio_dt_spec uart_wake_gpio =
+	GPIO_DT_SPEC_GET_OR(UART_WAKE_NODE, nus_wake_gpios, {0});
+static struct gpio_callback uart_wake_cb;
+static struct k_work_delayable uart_idle_work;
+/* Suspended by the idle timeout */
+static atomic_t uart_idle;
+static uint32_t uart_last_activity;
+/* RX buffer kept while suspended, to receive at once when woken */
+static struct uart_data_t *uart_wake_buf;
+/* Orders the idle suspend with data from the connection, so the UART is
+ * not suspended between the wake-up and the send of that data.
+ */
+static K_MUTEX_DEFINE(uart_idle_lock);
+
+/* Counters of the UART power management, never cleared. */
+static struct {
+	/* Time the UART was suspended, until the last resume */
+	uint32_t suspended_ms;
+	/* Uptime when the UART was suspended, 0 while it is not */
+	int64_t suspended_at;
+	/* Suspensions after the idle timeout */
+	uint32_t idle_suspends;
+	/* Resumes on activity after the idle timeout */
+	uint32_t wakes;
+} uart_pm_stats;
+
 static const struct bt_data ad[] = {
 	BT_DATA_BYTES(BT_DATA_FLAGS, (BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR)),
 	BT_DATA(BT_DATA_NAME_COMPLETE, DEVICE_NAME, DEVICE_NAME_LEN),
@@ -89,18 +154,225 @@ static const struct device *const async_adapter;
 #endif
 
 
+static struct uart_data_t *uart_buf_alloc(struct uart_buf_pool *pool)
+{
+	struct uart_data_t *buf;
+	uint32_t used;
+
+	if (k_mem_slab_alloc(pool->slab, (void **)&buf, K_NO_WAIT)) {
+		atomic_inc(&pool->alloc_failures);
+		return NULL;
+	}
+
+	used = k_mem_slab_num_used_get(pool->slab);
+	if (used > atomic_get(&pool->max_used)) {
+		atomic_set(&pool->max_used, used);
+	}
+
+	buf->len = 0;
+
+	return buf;
+}
+
+static void uart_buf_free(struct uart_buf_pool *pool, struct uart_data_t *buf)
+{
+	k_mem_slab_free(pool->slab, (void **)&buf);
+}
+
+static void uart_buf_pool_report(struct uart_buf_pool *pool)
+{
+	uint32_t max_used = atomic_get(&pool->max_used);
+	uint32_t failures = atomic_get(&pool->alloc_failures);
+
+	if ((max_used == pool->reported_max_used) &&
+	    (failures == pool->reported_failures)) {
+		return;
+	}
+
+	pool->reported_max_used = max_used;
+	pool->reported_failures = failures;
+
+	LOG_INF("UART %s buffers: %u of %u used at most, %u allocation failures",
+		pool->name, max_used, pool->slab->num_blocks, failures);
+}
+
+/* Log the CPU cycles per byte of the UART async adapter interrupts since
+ * the last report.
+ */
+static void uart_adapter_stats_report(void)
+{
+	struct uart_async_adapter_stats stats;
+
+	uart_async_adapter_stats_get(async_adapter, &stats);
+	if (!stats.rx_bytes && !stats.tx_bytes) {
+		return;
+	}
+
+	LOG_INF("UART adapter: RX %u bytes, %u cycles/byte, TX %u bytes, %u cycles/byte",
+		stats.rx_bytes, stats.rx_cycles / MAX(stats.rx_bytes, 1),
+		stats.tx_bytes, stats.tx_cycles / MAX(stats.tx_bytes, 1));
+}
+
+/* Log the counters of the buffer pools when they change. */
+static void uart_buf_stats_report(void)
+{
+	uart_buf_pool_report(&uart_rx_pool);
+	uart_buf_pool_report(&uart_tx_pool);
+
+	if (IS_ENABLED(CONFIG_BT_NUS_UART_ASYNC_ADAPTER_STATS)) {
+		uart_adapter_stats_report();
+	}
+}
+
+/* Log the counters of the UART power management when they change. */
+static void uart_pm_stats_report(void)
+{
+	static uint32_t reported_suspends;
+	static uint32_t reported_wakes;
+	uint32_t suspended_ms = uart_pm_stats.suspended_ms;
+	int64_t suspended_at = uart_pm_stats.suspended_at;
+
+	if ((uart_pm_stats.idle_suspends == reported_suspends) &&
+	    (uart_pm_stats.wakes == reported_wakes)) {
+		return;
+	}
+
+	reported_suspends = uart_pm_stats.idle_suspends;
+	reported_wakes = uart_pm_stats.wakes;
+
+	if (suspended_at) {
+		suspended_ms += k_uptime_get() - suspended_at;
+	}
+
+	LOG_INF("UART suspended %u ms, %u idle suspensions, %u wake-ups",
+		suspended_ms, reported_suspends, reported_wakes);
+}
+
+static void uart_pm_suspend(void)
+{
+	pm_device_action_run(uart, PM_DEVICE_ACTION_SUSPEND);
+	uart_pm_stats.suspended_at = k_uptime_get();
+}
+
+static void uart_pm_resume(void)
+{
+	pm_device_action_run(uart, PM_DEVICE_ACTION_RESUME);
+
+	if (uart_pm_stats.suspended_at) {
+		uart_pm_stats.suspended_ms += k_uptime_get() -
+					      uart_pm_stats.suspended_at;
+		uart_pm_stats.suspended_at = 0;
+	}
+}
+
+/* Data received or sent on UART, the idle timeout restarts. */
+static inline void uart_activity(void)
+{
+	uart_last_activity = k_uptime_get_32();
+}
+
+/* Resume the UART suspended by the idle timeout. Called from the wake pin
+ * interrupt, so reception starts as soon as possible, and before data is
+ * sent on UART.
+ */
+static void uart_wake(void)
+{
+	if (!UART_IDLE_SUSPEND || !atomic_cas(&uart_idle, 1, 0)) {
+		return;
+	}
+
+	gpio_pin_interrupt_configure_dt(&uart_wake_gpio, GPIO_INT_DISABLE);
+
+	uart_pm_resume();
+	uart_pm_stats.wakes++;
+	uart_active = true;
+
+	uart_rx_enable(uart, uart_wake_buf->data, sizeof(uart_wake_buf->data),
+		       UART_WAIT_FOR_RX);
+	uart_wake_buf = NULL;
+
+	uart_activity();
+	k_work_reschedule(&uart_idle_work, K_MSEC(UART_IDLE_TIMEOUT));
+}
+
+static void uart_wake_handler(const struct device *port, struct gpio_callback *cb,
+			      gpio_port_pins_t pins)
+{
+	ARG_UNUSED(port);
+	ARG_UNUSED(cb);
+	ARG_UNUSED(pins);
+
+	uart_wake();
+}
+
+/* Data from the connection is about to be sent on UART: resume it and
+ * restart the idle timeout, so it is not suspended before the data is
+ * queued.
+ */
+static void uart_wake_for_tx(void)
+{
+	if (!UART_IDLE_SUSPEND) {
+		return;
+	}
+
+	k_mutex_lock(&uart_idle_lock, K_FOREVER);
+	uart_wake();
+	uart_activity();
+	k_mutex_unlock(&uart_idle_lock);
+}
+
+static void uart_idle_suspend(void)
+{
+	uint32_t idle = k_uptime_get_32() - uart_last_activity;
+
+	if (!uart_active) {
+		return;
+	}
+
+	/* Data was received or sent meanwhile */
+	if (idle < UART_IDLE_TIMEOUT) {
+		k_work_reschedule(&uart_idle_work, K_MSEC(UART_IDLE_TIMEOUT - idle));
+		return;
+	}
+
+	/* Wait for the data still to be sent on UART */
+	if (k_mem_slab_num_used_get(&uart_tx_slab)) {
+		k_work_reschedule(&uart_idle_work, K_MSEC(UART_IDLE_TIMEOUT));
+		return;
+	}
+
+	uart_wake_buf = uart_buf_alloc(&uart_rx_pool);
+	if (!uart_wake_buf) {
+		k_work_reschedule(&uart_idle_work, K_MSEC(UART_IDLE_TIMEOUT));
+		return;
+	}
+
+	uart_active = false;
+	uart_rx_disable(uart);
+	uart_pm_suspend();
+	uart_pm_stats.idle_suspends++;
+	atomic_set(&uart_idle, 1);
+
+	/* A level interrupt uses the low power sense of the pin */
+	gpio_pin_configure_dt(&uart_wake_gpio, GPIO_INPUT);
+	gpio_pin_interrupt_configure_dt(&uart_wake_gpio, GPIO_INT_LEVEL_ACTIVE);
+}
+
+static void uart_idle_work_handler(struct k_work *item)
+{
+	k_mutex_lock(&uart_idle_lock, K_FOREVER);
+	uart_idle_suspend();
+	k_mutex_unlock(&uart_idle_lock);
+}
+
 static void uart_enable(void)
 {
 	uart_active = true;
 	struct uart_data_t *buf;
 
-	pm_device_action_run(uart,PM_DEVICE_ACTION_RESUME);
-	buf = k_malloc(sizeof(*buf));
-	if (buf)
-	{
-		buf->len = 0;
-	}
-	else
+	uart_pm_resume();
+	buf = uart_buf_alloc(&uart_rx_pool);
+	if (!buf)
 	{
 		LOG_WRN("Not able to allocate UART receive buffer");
 		k_work_reschedule(&uart_work, UART_WAIT_FOR_BUF_DELAY);
@@ -108,13 +380,33 @@ static void uart_enable(void)
 	}
 
 	uart_rx_enable(uart, buf->data, sizeof(buf->data), UART_WAIT_FOR_RX);
+
+	if (UART_IDLE_SUSPEND) {
+		uart_activity();
+		k_work_reschedule(&uart_idle_work, K_MSEC(UART_IDLE_TIMEOUT));
+	}
 }
 
 static void uart_disable(void)
 {
+	if (UART_IDLE_SUSPEND) {
+		struct k_work_sync sync;
+
+		k_work_cancel_delayable_sync(&uart_idle_work, &sync);
+
+		/* Already suspended, it only stops waking up */
+		if (atomic_cas(&uart_idle, 1, 0)) {
+			gpio_pin_interrupt_configure_dt(&uart_wake_gpio,
+							GPIO_INT_DISABLE);
+			uart_buf_free(&uart_rx_pool, uart_wake_buf);
+			uart_wake_buf = NULL;
+			return;
+		}
+	}
+
 	uart_active = false;
 	uart_rx_disable(uart);
-	pm_device_action_run(uart,PM_DEVICE_ACTION_SUSPEND);
+	uart_pm_suspend();
 }
 
 static void uart_cb(const struct device *dev, struct uart_event *evt, void *user_data)
@@ -144,7 +436,8 @@ static void uart_cb(const struct device *dev, struct uart_event *evt, void *user
 					   data);
 		}
 
-		k_free(buf);
+		uart_buf_free(&uart_tx_pool, buf);
+		uart_activity();
 
 		buf = k_fifo_get(&fifo_uart_tx_data, K_NO_WAIT);
 		if (!buf) {
@@ -161,6 +454,7 @@ static void uart_cb(const struct device *dev, struct uart_event *evt, void *user
 		LOG_DBG("UART_RX_RDY");
 		buf = CONTAINER_OF(evt->data.rx.buf, struct uart_data_t, data);
 		buf->len += evt->data.rx.len;
+		uart_activity();
 
 		if (disable_req) {
 			return;
@@ -180,10 +474,8 @@ static void uart_cb(const struct device *dev, struct uart_event *evt, void *user
 
 		if(uart_active)
 		{
-			buf = k_malloc(sizeof(*buf));
-			if (buf) {
-				buf->len = 0;
-			} else {
+			buf = uart_buf_alloc(&uart_rx_pool);
+			if (!buf) {
 				LOG_WRN("Not able to allocate UART receive buffer");
 				k_work_reschedule(&uart_work, UART_WAIT_FOR_BUF_DELAY);
 				return;
@@ -196,9 +488,8 @@ static void uart_cb(const struct device *dev, struct uart_event *evt, void *user
 
 	case UART_RX_BUF_REQUEST:
 		LOG_DBG("UART_RX_BUF_REQUEST");
-		buf = k_malloc(sizeof(*buf));
+		buf = uart_buf_alloc(&uart_rx_pool);
 		if (buf) {
-			buf->len = 0;
 			uart_rx_buf_rsp(uart, buf->data, sizeof(buf->data));
 		} else {
 			LOG_WRN("Not able to allocate UART receive buffer");
@@ -214,7 +505,7 @@ static void uart_cb(const struct device *dev, struct uart_event *evt, void *user
 		if (buf->len > 0) {
 			k_fifo_put(&fifo_uart_rx_data, buf);
 		} else {
-			k_free(buf);
+			uart_buf_free(&uart_rx_pool, buf);
 		}
 
 		break;
@@ -245,10 +536,8 @@ static void uart_work_handler(struct k_work *item)
 
 	if(uart_active)
 	{
-		buf = k_malloc(sizeof(*buf));
-		if (buf) {
-			buf->len = 0;
-		} else {
+		buf = uart_buf_alloc(&uart_rx_pool);
+		if (!buf) {
 			LOG_WRN("Not able to allocate UART receive buffer");
 			k_work_reschedule(&uart_work, UART_WAIT_FOR_BUF_DELAY);
 			return;
@@ -270,7 +559,6 @@ static int uart_init(void)
 {
 	int err;
 	int pos;
-	struct uart_data_t *rx;
 	struct uart_data_t *tx;
 
 	if (!device_is_ready(uart)) {
@@ -285,15 +573,24 @@ static int uart_init(void)
 		}
 	}
 
-	rx = k_malloc(sizeof(*rx));
-	if (rx) {
-		rx->len = 0;
-	} else {
-		return -ENOMEM;
-	}
-
+	/* RX is enabled by uart_enable() with its own buffer. */
 	k_work_init_delayable(&uart_work, uart_work_handler);
 
+	if (UART_IDLE_SUSPEND) {
+		if (!device_is_ready(uart_wake_gpio.port)) {
+			return -ENODEV;
+		}
+
+		k_work_init_delayable(&uart_idle_work, uart_idle_work_handler);
+		gpio_init_callback(&uart_wake_cb, uart_wake_handler,
+				   BIT(uart_wake_gpio.pin));
+		err = gpio_add_callback(uart_wake_gpio.port, &uart_wake_cb);
+		if (err) {
+			LOG_ERR("Cannot add UART wake callback");
+			return err;
+		}
+	}
+
 
 	if (IS_ENABLED(CONFIG_BT_NUS_UART_ASYNC_ADAPTER) && !uart_test_async_api(uart)) {
 		/* Implement API adapter */
@@ -330,14 +627,14 @@ static int uart_init(void)
 		}
 	}
 
-	tx = k_malloc(sizeof(*tx));
+	tx = uart_buf_alloc(&uart_tx_pool);
 
 	if (tx) {
 		pos = snprintf(tx->data, sizeof(tx->data),
 			       "Starting Nordic UART service example\r\n");
 
 		if ((pos < 0) || (pos >= sizeof(tx->data))) {
-			k_free(tx);
+			uart_buf_free(&uart_tx_pool, tx);
 			LOG_ERR("snprintf returned %d", pos);
 			return -ENOMEM;
 		}
@@ -498,8 +795,11 @@ static void bt_receive_cb(struct bt_conn *conn, const uint8_t *const data,
 
 	LOG_INF("Received data from: %s", addr);
 
+	/* The data is sent as soon as the UART is resumed */
+	uart_wake_for_tx();
+
 	for (uint16_t pos = 0; pos != len;) {
-		struct uart_data_t *tx = k_malloc(sizeof(*tx));
+		struct uart_data_t *tx = uart_buf_alloc(&uart_tx_pool);
 
 		if (!tx) {
 			LOG_WRN("Not able to allocate UART send data buffer");
@@ -652,6 +952,8 @@ void main(void)
 
 	for (;;) {
 		dk_set_led(RUN_STATUS_LED, (++blink_status) % 2);
+		uart_buf_stats_report();
+		uart_pm_stats_report();
 		k_sleep(K_MSEC(RUN_LED_BLINK_INTERVAL));
 	}
 }
@@ -670,7 +972,7 @@ void ble_write_thread(void)
 			LOG_WRN("Failed to send data over BLE connection");
 		}
 
-		k_free(buf);
+		uart_buf_free(&uart_rx_pool, buf);
 	}
 }
 